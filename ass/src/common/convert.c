@@ -1,196 +1,216 @@
-#include <stdint.h>
-#include "headers/common.h"
-#include <stdlib.h>
-#include <string.h>
-#include <stdio.h>
-
-uint64_t string2uint(const char *str)
-{
-    return string2uint_range(str, 0, -1);
-}
-
-uint64_t string2uint_range(const char *str, int start, int end)
-{
-    end = (end == -1) ? strlen(str) - 1 : end;
-
-    uint64_t uv = 0;
-    int sign_bit = 0;
-
-    //DFA
-    int state = 0;
-
-    for (int i = start; i <= end; i++)
-   {
-        char c = str[i];
-
-        if (state == 0)
-        {
-            if (c == '0')
-            {
-                state = 1;
-                uv = 0;
-                continue;
-            }
-            else if ('1' <= c && c <= '9')
-            {
-                state = 2;
-                uv = c - '0';
-                continue;
-            }
-            else if (c == '-')
-            {
-                state = 3;
-                sign_bit = 1;
-                continue;
-            }
-            else if (c== ' ')
-            {
-                state  = 0;
-                continue;
-            }
-            else {goto fail;}
-        }
-
-        else if (state == 1)
-        {
-            if ('0' <= c && c <= '9')
-            {
-                state = 2;
-                uv = uv * 10 + c-'0';
-                continue;
-            }
-            else if (c =='x')
-            {
-                state = 4;
-                continue;
-            }
-            else if (c == ' ')
-            {
-                state = 6;
-                continue;
-            }
-            else {goto fail;}
-        }
-        else if (state == 2)
-        {
-            if ('0' <= c && c <= '9')
-            {
-                state = 2;
-                uint64_t pv = uv;
-
-                uv = uv * 10 + c - '0';
-
-                if (pv > uv)
-                {
-                    printf("(uint64_t)%s overflow: cannot convert\n", str);
-                    goto fail;
-                }
-                continue;
-                // maybe overflow
-            }
-            else if(c == ' ')
-            {
-                state = 6;
-                continue;
-            }
-            else {goto fail;}
-        }
-        else if (state == 3)
-        {
-            if (c == '0')
-            {
-                state = 1;
-                continue;
-            }
-            else if ('1' <= c && c <= '9')
-            {
-                state = 2;
-                uv = c - '0';
-                continue;
-            }
-            else {goto fail;}
-        }
-        else if (state == 4)
-        {
-            if ('0' <= c && c <= '9')
-            {
-                state = 5;
-                uv = uv * 16 + c - '0';
-                continue;
-            }
-            else if ('a' <= c && c <= 'f')
-            {
-                 state = 5;
-                 uv = uv * 16 + c - 'a' + 10;
-                 continue;
-            }
-            else {goto fail;}
-        }
-        else if (state == 5)
-        {
-            if ('0' <= c && c <= '9')
-            {
-                state = 5;
-                uint64_t pv = uv;
-
-                uv = uv * 16 + c - '0';
-
-                if (pv > uv)
-                {
-                    printf("(uint64_t)%s overflow: cannot convert\n", str);
-                    goto fail;
-                }
-                continue;
-
-            }
-            else if ('a' <=c && c <= 'f')
-            {
-                state = 5;
-                uint64_t pv = uv;
-
-                uv = uv * 16 + c - 'a' + 10;
-
-                if (pv > uv)
-                {
-                    printf("(uint64_t)%s overflow: cannot convert\n",str);
-                    goto fail;
-                }
-                continue;
-            }
-            else if (c == ' ')
-            {
-                state = 6;
-                continue;
-            }
-            else {goto fail;}
-        }
-        else if (state == 6)
-        {
-            if (c == ' ')
-            {
-                state = 6;
-                continue;
-            }
-            else {goto fail;}
-        }
-    }
-    if (sign_bit == 0)
-    {
-        return uv;
-    }
-    else
-    {
-        if ((uv & 0x8000000000000000) != 0)
-        {
-            printf("(int64_t) %s :signed overflow: cannot convert\n", str);
-            exit(0);
-        }
-        int64_t sv = -1 * (int64_t)uv;
-
-        return *((uint64_t *)&sv);
-    }
-
-    fail:
-    printf("type converter: <%s> cannot be converted to integer\n,", str);
-    exit(0);
-}
\ No newline at end of file
+#include <stdint.h>
+#include "headers/common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*======================================*/
+/*      SWAR digit conversion           */
+/*======================================*/
+
+// 8 characters are handled at once in a uint64_t word
+// the first character is the lowest byte (little-endian hosts)
+#define SWAR_ONES   0x0101010101010101ULL
+#define SWAR_HIGHS  0x8080808080808080ULL
+#define SWAR_LOWS   0x7f7f7f7f7f7f7f7fULL
+
+// high bit of each byte set if the byte is not '0' - '9'
+static inline uint64_t swar_nondigit(uint64_t w)
+{
+    uint64_t x = w ^ (SWAR_ONES * '0');
+    // x > 9, without carries between the bytes
+    return (((x & SWAR_LOWS) + SWAR_ONES * 0x76) | x) & SWAR_HIGHS;
+}
+
+// high bit of each byte set if the byte is not a hexadecimal digit
+static inline uint64_t swar_nonhex(uint64_t w)
+{
+    // 'a' - 'f' and 'A' - 'F' to 1 - 6
+    uint64_t y = (w | (SWAR_ONES * 0x20)) ^ (SWAR_ONES * 0x60);
+    uint64_t above = (((y & SWAR_LOWS) + SWAR_ONES * 0x79) | y) & SWAR_HIGHS;
+    uint64_t zero = ~(((y & SWAR_LOWS) + SWAR_LOWS) | y) & SWAR_HIGHS;
+    return swar_nondigit(w) & (above | zero);
+}
+
+// value of 8 decimal digits, the first one most significant
+static inline uint64_t swar_parse8_dec(uint64_t w)
+{
+    uint64_t v = w - SWAR_ONES * '0';
+    v = (v * 10 + (v >> 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v * 100 + (v >> 16)) & 0x0000ffff0000ffffULL;
+    v = (v * 10000 + (v >> 32)) & 0x00000000ffffffffULL;
+    return v;
+}
+
+// value of 8 hexadecimal digits, the first one most significant
+static inline uint64_t swar_parse8_hex(uint64_t w)
+{
+    // '0' - '9' to 0 - 9, letters to (c & 0xf) + 9
+    uint64_t v = (w & (SWAR_ONES * 0xf)) + ((w >> 6) & SWAR_ONES) * 9;
+    v = (v * 16 + (v >> 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v * 256 + (v >> 16)) & 0x0000ffff0000ffffULL;
+    v = (v * 65536 + (v >> 32)) & 0x00000000ffffffffULL;
+    return v;
+}
+
+// value of the digit c, -1 if c is not a digit of the base
+static inline int digit_value(char c, int hex)
+{
+    if ('0' <= c && c <= '9')
+    {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (hex == 1 && 'a' <= c && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*======================================*/
+/*      string to integer               */
+/*======================================*/
+
+// convert str[start, end] (end -1 for the whole string) to uint64_t
+// spaces around the number are ignored
+// decimal or 0x hexadecimal, negative numbers return the two's complement
+convert_status_t string2uint_checked(const char *str, int start, int end, uint64_t *value)
+{
+    end = (end == -1) ? (int)strlen(str) - 1 : end;
+
+    while (start <= end && str[start] == ' ')
+    {
+        start ++;
+    }
+    while (end >= start && str[end] == ' ')
+    {
+        end --;
+    }
+
+    int sign_bit = 0;
+    if (start <= end && str[start] == '-')
+    {
+        sign_bit = 1;
+        start ++;
+    }
+
+    int hex = 0;
+    if (start + 1 <= end && str[start] == '0' && str[start + 1] == 'x')
+    {
+        hex = 1;
+        start += 2;
+    }
+
+    const char *p = str + start;
+    int len = end - start + 1;
+    if (len <= 0)
+    {
+        return CONVERT_INVALID;
+    }
+
+    // the leading len % 8 digits one by one, they never overflow
+    uint64_t uv = 0;
+    int head = len % 8;
+    for (int i = 0; i < head; ++ i)
+    {
+        int d = digit_value(p[i], hex);
+        if (d < 0)
+        {
+            return CONVERT_INVALID;
+        }
+        uv = hex == 1 ? (uv << 4) | d : uv * 10 + d;
+    }
+
+    // then 8 digits per step
+    for (int i = head; i < len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+
+        if (hex == 1)
+        {
+            if (swar_nonhex(w) != 0)
+            {
+                return CONVERT_INVALID;
+            }
+            // leading zeros never overflow
+            if ((uv >> 32) != 0)
+            {
+                return CONVERT_OVERFLOW;
+            }
+            uv = (uv << 32) | swar_parse8_hex(w);
+        }
+        else
+        {
+            if (swar_nondigit(w) != 0)
+            {
+                return CONVERT_INVALID;
+            }
+            if (__builtin_mul_overflow(uv, 100000000, &uv) ||
+                __builtin_add_overflow(uv, swar_parse8_dec(w), &uv))
+            {
+                return CONVERT_OVERFLOW;
+            }
+        }
+    }
+
+    if (sign_bit == 1)
+    {
+        // down to INT64_MIN, whose magnitude is 1 << 63
+        if (uv > 0x8000000000000000)
+        {
+            return CONVERT_OVERFLOW;
+        }
+        uv = 0 - uv;
+    }
+
+    *value = uv;
+    return CONVERT_OK;
+}
+
+// convert a column of count strings into values
+// status (optional) gets the result of each string
+// return the number of strings failed, their values are 0
+uint64_t string2uint_batch(const char **strs, uint64_t count, uint64_t *values,
+    convert_status_t *status)
+{
+    uint64_t num_failed = 0;
+    for (uint64_t i = 0; i < count; ++ i)
+    {
+        convert_status_t s = string2uint_checked(strs[i], 0, -1, &values[i]);
+        if (s != CONVERT_OK)
+        {
+            values[i] = 0;
+            num_failed ++;
+        }
+        if (status != NULL)
+        {
+            status[i] = s;
+        }
+    }
+    return num_failed;
+}
+
+uint64_t string2uint(const char *str)
+{
+    return string2uint_range(str, 0, -1);
+}
+
+uint64_t string2uint_range(const char *str, int start, int end)
+{
+    uint64_t uv = 0;
+    convert_status_t s = string2uint_checked(str, start, end, &uv);
+
+    if (s == CONVERT_OVERFLOW)
+    {
+        printf("(uint64_t)%s overflow: cannot convert\n", str);
+        exit(0);
+    }
+    else if (s == CONVERT_INVALID)
+    {
+        printf("type converter: <%s> cannot be converted to integer\n,", str);
+        exit(0);
+    }
+    return uv;
+}
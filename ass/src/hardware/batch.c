@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <headers/common.h>
+#include <headers/machine.h>
+#include <headers/batch.h>
+
+/*======================================*/
+/*      job ranges                      */
+/*======================================*/
+
+// the jobs not yet taken by a worker: [head, tail) packed in one word
+// so that the owner and the thieves take them by compare-and-swap
+// the owner takes the first job, a thief takes the last half
+typedef struct
+{
+    uint64_t range;     // tail << 32 | head
+} __attribute__((aligned(HOST_CACHE_LINE_SIZE))) job_range_t;
+
+#define RANGE_PACK(head, tail)  (((uint64_t)(tail) << 32) | (head))
+#define RANGE_HEAD(range)       ((range) & 0xffffffff)
+#define RANGE_TAIL(range)       ((range) >> 32)
+
+typedef struct
+{
+    const batch_job_t *jobs;
+    batch_result_t *results;
+    job_range_t *ranges;
+    uint64_t num_workers;
+} batch_t;
+
+typedef struct
+{
+    batch_t *batch;
+    uint64_t id;
+    machine_t *machine;
+} worker_t;
+
+// take the first job of the worker, return 0 if it has none
+static int take_job(job_range_t *r, uint64_t *job)
+{
+    uint64_t range = __atomic_load_n(&(r->range), __ATOMIC_ACQUIRE);
+    while (RANGE_HEAD(range) < RANGE_TAIL(range))
+    {
+        uint64_t next = RANGE_PACK(RANGE_HEAD(range) + 1, RANGE_TAIL(range));
+        if (__atomic_compare_exchange_n(&(r->range), &range, next, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *job = RANGE_HEAD(range);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// move the last half of the jobs of the victim to the empty range of the thief
+// return 0 if the victim has none
+static int steal_jobs(job_range_t *victim, job_range_t *thief)
+{
+    uint64_t range = __atomic_load_n(&(victim->range), __ATOMIC_ACQUIRE);
+    while (RANGE_HEAD(range) < RANGE_TAIL(range))
+    {
+        uint64_t head = RANGE_HEAD(range);
+        uint64_t tail = RANGE_TAIL(range);
+        uint64_t middle = tail - (tail - head + 1) / 2;
+        if (__atomic_compare_exchange_n(&(victim->range), &range, RANGE_PACK(head, middle), 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            // nobody else writes an empty range
+            __atomic_store_n(&(thief->range), RANGE_PACK(middle, tail), __ATOMIC_RELEASE);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*======================================*/
+/*      running a job                   */
+/*======================================*/
+
+#define FNV_OFFSET  0xcbf29ce484222325
+#define FNV_PRIME   0x00000100000001b3
+
+static uint64_t fnv1a(uint64_t hash, const void *data, uint64_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    for (uint64_t i = 0; i < len; ++ i)
+    {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// the frames never written are zero: only those in written_frames are read,
+// so the checksum costs the pages written, not the size of the memory
+// a frame written back to zero is skipped too: the checksum depends on the contents only
+static uint64_t memory_checksum(machine_t *m)
+{
+    uint64_t page_size = 1 << PHYSICAL_PAGE_OFFSET_LENGTH;
+    static const uint8_t zero[1 << PHYSICAL_PAGE_OFFSET_LENGTH];
+
+    uint64_t hash = FNV_OFFSET;
+    uint64_t num_frames = m->pm_size / page_size;
+    for (uint64_t i = 0; i < (num_frames + 63) / 64; ++ i)
+    {
+        uint64_t bits = m->written_frames[i];
+        while (bits != 0)
+        {
+            uint64_t ppn = i * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            uint8_t *page = m->pm + ppn * page_size;
+            if (memcmp(page, zero, page_size) == 0)
+            {
+                continue;
+            }
+            hash = fnv1a(hash, &ppn, sizeof(ppn));
+            hash = fnv1a(hash, page, page_size);
+        }
+    }
+    return hash;
+}
+
+// copy the segment page by page: the pages are not contiguous in the physical memory
+static void load_segment(const batch_segment_t *seg, core_t *cr)
+{
+    uint64_t page_size = 1 << PHYSICAL_PAGE_OFFSET_LENGTH;
+    uint64_t done = 0;
+    while (done < seg->len)
+    {
+        uint64_t vaddr = seg->vaddr + done;
+        uint64_t len = page_size - vaddr % page_size;
+        if (len > seg->len - done)
+        {
+            len = seg->len - done;
+        }
+        writecode_dram(va2pa(vaddr, cr), seg->data + done, len, cr);
+        done += len;
+    }
+}
+
+static void run_job(const batch_job_t *job, batch_result_t *result, machine_t *m)
+{
+    reset_machine(m);
+
+    core_t *cr = &(m->cores[0]);
+    for (uint64_t i = 0; i < job->num_segments; ++ i)
+    {
+        load_segment(&(job->segments[i]), cr);
+    }
+    cr->reg = job->reg;
+    cr->rip = job->rip;
+    cr->fetch_mode = job->fetch_mode;
+    // the segments are loaded at their physical addresses, page tables included
+    cr->pdbr = job->pdbr;
+
+    run_result_t run = run_until(cr, job->max_num_inst, 0, 0);
+    flush_store_buffer(cr);
+    sync_cflags(cr);
+
+    result->reason = run.reason;
+    result->num_inst = run.num_inst;
+    result->reg = cr->reg;
+    result->rip = cr->rip;
+
+    uint64_t hash = fnv1a(FNV_OFFSET, &(cr->reg), sizeof(reg_t));
+    hash = fnv1a(hash, &(cr->rip), sizeof(cr->rip));
+    result->reg_checksum = fnv1a(hash, &(cr->flags), sizeof(cpu_flag_t));
+    result->mem_checksum = memory_checksum(m);
+}
+
+static void *run_worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    batch_t *b = w->batch;
+    job_range_t *own = &(b->ranges[w->id]);
+
+    while (1)
+    {
+        uint64_t job;
+        while (take_job(own, &job) == 1)
+        {
+            run_job(&(b->jobs[job]), &(b->results[job]), w->machine);
+        }
+
+        // jobs are never added: when every range is seen empty, the worker is done
+        // a range in the middle of a steal may be missed, its thief runs it
+        int stolen = 0;
+        for (uint64_t i = 1; i < b->num_workers && stolen == 0; ++ i)
+        {
+            stolen = steal_jobs(&(b->ranges[(w->id + i) % b->num_workers]), own);
+        }
+        if (stolen == 0)
+        {
+            return NULL;
+        }
+    }
+}
+
+/*======================================*/
+/*      batch                           */
+/*======================================*/
+
+void run_batch(const batch_job_t *jobs, uint64_t num_jobs, uint64_t num_threads,
+    uint64_t pm_size, batch_result_t *results)
+{
+    if (num_jobs > 0xffffffff)
+    {
+        printf("batch of %lu jobs: at most 0xffffffff\n", num_jobs);
+        exit(0);
+    }
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+    if (num_threads > num_jobs)
+    {
+        num_threads = num_jobs == 0 ? 1 : num_jobs;
+    }
+
+    batch_t b;
+    b.jobs = jobs;
+    b.results = results;
+    b.num_workers = num_threads;
+
+    worker_t *workers = calloc(num_threads, sizeof(worker_t));
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL ||
+        posix_memalign((void **)&(b.ranges), HOST_CACHE_LINE_SIZE, num_threads * sizeof(job_range_t)) != 0)
+    {
+        printf("cannot allocate the workers of the batch\n");
+        exit(0);
+    }
+
+    for (uint64_t i = 0; i < num_threads; ++ i)
+    {
+        // the initial ranges split the jobs evenly, the steals balance the rest
+        b.ranges[i].range = RANGE_PACK(num_jobs * i / num_threads, num_jobs * (i + 1) / num_threads);
+
+        workers[i].batch = &b;
+        workers[i].id = i;
+        // by this thread: init_machine is not thread-safe on its first call
+        if (posix_memalign((void **)&(workers[i].machine), HOST_CACHE_LINE_SIZE, sizeof(machine_t)) != 0)
+        {
+            printf("cannot allocate the machine of a worker\n");
+            exit(0);
+        }
+        init_machine(workers[i].machine, pm_size);
+    }
+
+    for (uint64_t i = 1; i < num_threads; ++ i)
+    {
+        if (pthread_create(&(threads[i]), NULL, run_worker, &(workers[i])) != 0)
+        {
+            printf("cannot create the thread of worker %lu\n", i);
+            exit(0);
+        }
+    }
+    // this thread is the first worker
+    run_worker(&(workers[0]));
+    for (uint64_t i = 1; i < num_threads; ++ i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (uint64_t i = 0; i < num_threads; ++ i)
+    {
+        free_machine(workers[i].machine);
+        free(workers[i].machine);
+    }
+    free(b.ranges);
+    free(threads);
+    free(workers);
+}
+
+void write_batch_results(const char *filename, const batch_result_t *results, uint64_t num_jobs)
+{
+    static const char *reason_names[] = {
+        "budget", "rip", "breakpoint", "halt", "invalid", "page_fault", "bus_error",
+        "split_lock",
+    };
+
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        printf("cannot open the batch results file %s\n", filename);
+        exit(0);
+    }
+
+    fprintf(fp, "# job reason num_inst rip reg_checksum mem_checksum\n");
+    for (uint64_t i = 0; i < num_jobs; ++ i)
+    {
+        const batch_result_t *r = &(results[i]);
+        fprintf(fp, "%lu %s %lu 0x%016lx 0x%016lx 0x%016lx\n",
+            i, reason_names[r->reason], r->num_inst, r->rip, r->reg_checksum, r->mem_checksum);
+    }
+    fclose(fp);
+}
@@ -1,848 +1,4164 @@
-#include<stdio.h>
-#include<stdlib.h>
-#include<string.h>
-#include<headers/cpu.h>
-#include<headers/memory.h>
-#include<headers/common.h>
-
-
-/*======================================*/
-/*      parse assembly instruction      */
-/*======================================*/
-static void parse_instruction(const char *str, inst_t *inst, core_t *cr);
-static void parse_operand(const char *str, od_t *od, core_t *cr);
-static uint64_t decode_operand(od_t *od);
-
-static uint64_t decode_operand(od_t *od)
-{
-     if (od->type == IMM)
-    {
-        // immediate signed number can be negative: convert to bitmap
-        return *(uint64_t *)&od->imm;
-    }
-    else if (od->type == REG)
-    {
-        // default register 1
-        return od->reg1;
-    }
-    else if (od->type == EMPTY)
-    {
-        return 0;
-    }
-    else
-    {
-        // access memory: return the physical address
-        uint64_t vaddr = 0;
-
-        if (od->type == MEM_IMM)
-        {
-            vaddr = od->imm;
-        }
-        else if (od->type == MEM_REG1)
-        {
-            vaddr = *((uint64_t *)od->reg1);
-        }
-        else if (od->type == MEM_IMM_REG1)
-        {
-            vaddr = od->imm + (*((uint64_t *)od->reg1));
-        }
-        else if (od->type == MEM_REG1_REG2)
-        {
-            vaddr = (*((uint64_t *)od->reg1)) + (*((uint64_t *)od->reg2));
-        }
-        else if (od->type == MEM_IMM_REG1_REG2)
-        {
-            vaddr = od->imm +  (*((uint64_t *)od->reg1)) + (*((uint64_t *)od->reg2));
-        }
-        else if (od->type == MEM_REG2_SCAL)
-        {
-            vaddr = (*((uint64_t *)od->reg2)) * od->scal;
-        }
-        else if (od->type == MEM_IMM_REG2_SCAL)
-        {
-            vaddr = od->imm + (*((uint64_t *)od->reg2)) * od->scal;
-        }
-        else if (od->type == MEM_REG1_REG2_SCAL)
-        {
-            vaddr = (*((uint64_t *)od->reg1)) + (*((uint64_t *)od->reg2)) * od->scal;
-        }
-        else if (od->type == MEM_IMM_REG1_REG2_SCAL)
-        {
-            vaddr = od->imm + (*((uint64_t *)od->reg1)) + (*((uint64_t *)od->reg2)) * od->scal;
-        }
-        return vaddr;
-    }
-}
-
-static const char *reg_name_list[72] = {
-    "%rax","%eax","%ax","%ah","%al",
-    "%rbx","%ebx","%bx","%bh","%bl",
-    "%rcx","%ecx","%cx","%ch","%cl",
-    "%rdx","%edx","%dx","%dh","%dl",
-    "%rsi","%esi","%si","%sih","%sil",
-    "%rdi","%edi","%di","%dih","%dil",
-    "%rbp","%ebp","%bp","%bph","%bpl",
-    "%rsp","%esp","%sp","%sph","%spl",
-    "%r8","%r8d","%r8w","%r8b",
-    "%r9","%r9d","%r9w","%r9b",
-    "%r10","%r10d","%r10w","%r10b",
-    "%r11","%r11d","%r11w","%r11b",
-    "%r12","%r12d","%r12w","%r12b",
-    "%r13","%r13d","%r13w","%r13b",
-    "%r14","%r14d","%r14w","%r14b",
-    "%r15","%r15d","%r15w","%r15b", 
-};
-
-static uint64_t reflect_register(const char *str, core_t *cr)
-{
-    reg_t *reg = &(cr->reg);
-    uint64_t reg_addr[72] = {
-        (uint64_t)&(reg->rax),(uint64_t)&(reg->eax),(uint64_t)&(reg->ax),(uint64_t)&(reg->ah),(uint64_t)&(reg->al),
-        (uint64_t)&(reg->rbx),(uint64_t)&(reg->ebx),(uint64_t)&(reg->bx),(uint64_t)&(reg->bh),(uint64_t)&(reg->bl),
-        (uint64_t)&(reg->rcx),(uint64_t)&(reg->ecx),(uint64_t)&(reg->cx),(uint64_t)&(reg->ch),(uint64_t)&(reg->cl),
-        (uint64_t)&(reg->rdx),(uint64_t)&(reg->edx),(uint64_t)&(reg->dx),(uint64_t)&(reg->dh),(uint64_t)&(reg->dl),
-        (uint64_t)&(reg->rsi),(uint64_t)&(reg->esi),(uint64_t)&(reg->si),(uint64_t)&(reg->sih),(uint64_t)&(reg->sil),
-        (uint64_t)&(reg->rdi),(uint64_t)&(reg->edi),(uint64_t)&(reg->di),(uint64_t)&(reg->dih),(uint64_t)&(reg->dil),
-        (uint64_t)&(reg->rbp),(uint64_t)&(reg->ebp),(uint64_t)&(reg->bp),(uint64_t)&(reg->bph),(uint64_t)&(reg->bpl),
-        (uint64_t)&(reg->rsp),(uint64_t)&(reg->esp),(uint64_t)&(reg->sp),(uint64_t)&(reg->sph),(uint64_t)&(reg->spl),
-        (uint64_t)&(reg->r8),(uint64_t)&(reg->r8d),(uint64_t)&(reg->r8w),(uint64_t)&(reg->r8b),
-        (uint64_t)&(reg->r9),(uint64_t)&(reg->r9d),(uint64_t)&(reg->r9w),(uint64_t)&(reg->r9b),
-        (uint64_t)&(reg->r10),(uint64_t)&(reg->r10d),(uint64_t)&(reg->r10w),(uint64_t)&(reg->r10b),
-        (uint64_t)&(reg->r11),(uint64_t)&(reg->r11d),(uint64_t)&(reg->r11w),(uint64_t)&(reg->r11b),
-        (uint64_t)&(reg->r12),(uint64_t)&(reg->r12d),(uint64_t)&(reg->r12w),(uint64_t)&(reg->r12b),
-        (uint64_t)&(reg->r13),(uint64_t)&(reg->r13d),(uint64_t)&(reg->r13w),(uint64_t)&(reg->r13b),
-        (uint64_t)&(reg->r14),(uint64_t)&(reg->r14d),(uint64_t)&(reg->r14w),(uint64_t)&(reg->r14b),
-        (uint64_t)&(reg->r15),(uint64_t)&(reg->r15d),(uint64_t)&(reg->r15w),(uint64_t)&(reg->r15b),
-    };
-
-    for (int i = 0; i < 72; i++)
-    {
-        if (strcmp(str,reg_name_list[i]) == 0)
-        {
-            return reg_addr[i];
-        }
-    }
-
-    printf("parse register %s error\n", str);
-    exit(0);
-}
-
-
-static void parse_instruction(const char *str, inst_t *inst, core_t *cr)
-{
-    char op_str[64] = {'\0'};
-    int op_len = 0;
-    char src_str[64] = {'\0'};
-    int src_len = 0;
-    char dst_str[64] = {'\0'};
-    int dst_len = 0;
-
-    char c;
-    int count_parentheses = 0;
-    int state = 0;
-
-    for (int i = 0; i < strlen(str); i++)
-    {
-        c = str[i];
-        if (c == '(' || c == ')')
-        {
-            count_parentheses++;
-        }        
-
-        if (state == 0 && c != ' ')
-        {
-            state = 1;
-        }
-        else if (state == 1 && c == ' ')
-        {
-            state = 2;
-            continue;
-        }
-        else if (state == 2 && c != ' ')
-        {
-            state = 3;
-        }
-        else if (state == 3 && c == ',' && (count_parentheses == 0 || count_parentheses == 2))
-        {
-            state = 4;
-            continue;
-        }
-        else if (state == 4 && c != ' ' && c != ',')
-        {
-            state = 5;
-        }
-        else if (state == 5 && c == ' ')
-        {
-            state = 6;
-            continue;
-        }
-
-        if (state == 1)
-        {
-            op_str[op_len] = c;
-            op_len ++;
-        }
-        else if (state == 3)
-        {
-            src_str[src_len] = c;
-            src_len ++;
-        }
-        else if (state == 5)
-        {
-            dst_str[dst_len] = c;
-            dst_len ++;
-            continue;
-        }
-    }
-
-    //op_str, src_str, dst_str
-    parse_operand(src_str, &(inst->src), cr);
-    parse_operand(dst_str, &(inst->dst), cr);
-
-    if (strcmp(op_str, "mov") == 0 || strcmp(op_str, "movq") == 0)
-    {
-        inst->op = INST_MOV;
-    }
-    else if (strcmp(op_str, "push") == 0)
-    {
-        inst->op = INST_PUSH;
-    }
-    else if (strcmp(op_str, "pop") == 0)
-    {
-        inst->op = INST_POP;
-    }
-    else if (strcmp(op_str, "leaveq") == 0)
-    {
-        inst->op = INST_LEAVE;
-    }
-    else if (strcmp(op_str, "callq") == 0)
-    {
-        inst->op = INST_CALL;
-    }
-    else if (strcmp(op_str, "callq") == 0)
-    {
-        inst->op = INST_CALL;
-    }
-    else if (strcmp(op_str, "retq") == 0)
-    {
-        inst->op = INST_RET;
-    }
-    else if (strcmp(op_str, "callq") == 0)
-    {
-        inst->op = INST_CALL;
-    }
-    else if (strcmp(op_str, "add") == 0)
-    {
-        inst->op = INST_ADD;
-    }
-    else if (strcmp(op_str, "sub") == 0)
-    {
-        inst->op = INST_SUB;
-    }
-    else if (strcmp(op_str, "cmpq") == 0)
-    {
-        inst->op = INST_CMP;
-    }
-    else if (strcmp(op_str, "jne") == 0)
-    {
-        inst->op = INST_JNE;
-    }
-    else if (strcmp(op_str, "jmp") == 0)
-    {
-        inst->op = INST_JMP;
-    }
-
-    debug_printf(DEBUG_PARSEINST, "[%s (%d)] [%s (%d)] [%s (%d)]\n" ,
-    op_str, inst->op, src_str, inst->src.type,dst_str,inst->dst.type);
-
-    return;
-}
-
-static void parse_operand(const char *str, od_t *od, core_t *cr)
-{
-   // str: assembly code string, e.g. mov $rsp, $rbp
-   // od: pointer to the address to store the parsed operand
-   // cr: active core
-   od->type = EMPTY;
-   od->imm = 0;
-   od->scal = 0;
-   od->reg1  = 0;
-   od->reg2  = 0;
-
-   int str_len = strlen(str);
-
-   if (str_len == 0)
-   {
-        return;
-   }
-
-   if (str[0] == '$')
-   {
-      od->type = IMM;
-      od->imm = string2uint_range(str, 1, -1);
-      //imm
-   }
-   else if (str[0] == '%')
-   {
-      //reg
-      od->type = REG;
-      od->reg1 = reflect_register(str, cr);
-   }
-   else
-   {
-       //memory
-       char imm[64] = {'\0'};
-       int imm_len = 0;
-       char reg1[64]= {'\0'};
-       int reg1_len = 0;
-       char reg2[64]= {'\0'};
-       int reg2_len = 0;
-       char scal[64] = {'\0'};
-       int scal_len = 0;
-
-       int ca = 0; // ()
-       int cb = 0; //,
-
-       for(int i = 0; i < str_len; i++)
-       {
-            char c = str[i];
-
-            if (c == '(' || c == ')')
-            {
-                ca++;
-                continue;
-            }
-            else if (c == ',')
-            {
-                cb++;
-                continue;
-            }
-            else
-            {
-                //parse imm(reg1,reg2,scal)
-                if (ca == 0)
-                {
-                    //xxx
-                    imm[imm_len] = c;
-                    imm_len++;
-                    continue;
-                }
-                else if (ca == 1)
-                {
-                    if(cb == 0)
-                    {  
-                        //?(xxx
-                        //(xxx
-                        reg1[reg1_len] = c;
-                        reg1_len++;
-                        continue;
-                    }
-                    else if (cb == 1)
-                    {
-                        // (???,xxx
-                        // ???(???,xxx
-                        // (,xxx
-                        // ???(, xxx
-                        reg2[reg2_len] = c;
-                        reg2_len++;
-                        continue; 
-                    }
-                    else if (cb == 2)
-                    {
-                        // (???,???,xxx
-                        scal[scal_len] = c;
-                        scal_len++;
-                        continue;
-                    }
-                }
-            }
-       }
-
-       if (imm_len > 0)
-       {
-           od->imm = string2uint(imm);
-           if (ca == 0)
-           {
-              od->type = MEM_IMM;
-              return;
-           }
-       }
-
-       if (scal_len > 0)
-       {
-          od->scal = string2uint(scal);
-          if (od->scal != 1 && od->scal != 2 && od->scal != 4 && od->scal != 8)
-          {
-              printf("%s is not a legal scaler\n", scal);
-              exit(0);
-          }
-       }
-
-       if (reg1_len > 0)
-       {
-           od->reg1 = reflect_register(reg1,cr);
-       }
-
-       if (reg2_len > 0)
-       {
-           od->reg2 = reflect_register(reg2,cr);
-       }
-
-       if (cb == 0)
-       {
-            if(imm_len > 0)
-            {
-                od->type = MEM_IMM_REG1;
-                return;
-            }
-            else
-            {
-                od->type = MEM_REG1;
-                return;
-            }
-       }
-       else if (cb == 1)
-       {
-            if(imm_len > 0)
-            {
-                od->type = MEM_IMM_REG1_REG2;
-                return;
-            }
-            else
-            {
-                od->type = MEM_REG1_REG2;
-                return;
-            }
-       }
-       else if (cb == 2)
-       {
-            if (reg1_len > 0)
-            {
-                if(imm_len > 0)
-                {
-                    od->type = MEM_IMM_REG1_REG2_SCAL;
-                    return;
-                }
-                else
-                {
-                    od->type = MEM_REG1_REG2_SCAL;
-                    return;
-                }
-            }
-            else
-            {
-                if(imm_len > 0)
-                {
-                    od->type = MEM_IMM_REG2_SCAL;
-                    return;
-                }
-                else
-                {
-                    od->type = MEM_REG2_SCAL;
-                    return;
-                }
-            }
-       }
-   }
-}
-
-/*======================================*/
-/*      instruction handlers            */
-/*======================================*/
-
-// insturction (sub)set
-// In this simulator, the instructions have been decoded and fetched
-// so there will be no page fault during fetching
-// otherwise the instructions must handle the page fault (swap in from disk) first
-// and then re-fetch the instruction and do decoding
-// and finally re-run the instruction
-
-static void mov_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void push_handler            (od_t *src_od, od_t *dst_od, core_t *cr);
-static void pop_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void leave_handler           (od_t *src_od, od_t *dst_od, core_t *cr);
-static void call_handler            (od_t *src_od, od_t *dst_od, core_t *cr);
-static void ret_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void add_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void sub_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void cmp_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void jne_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-static void jmp_handler             (od_t *src_od, od_t *dst_od, core_t *cr);
-
-typedef void (*handler_t)(od_t *, od_t *, core_t *);
-
-static handler_t handler_table[NUM_INSTRTYPE] = {
-    &mov_handler,               // 0
-    &push_handler,              // 1
-    &pop_handler,               // 2
-    &leave_handler,             // 3
-    &call_handler,              // 4
-    &ret_handler,               // 5
-    &add_handler,               // 6
-    &sub_handler,               // 7
-    &cmp_handler,               // 8
-    &jne_handler,               // 9
-    &jmp_handler,               // 10
-};
-
-// reset the condition flags
-// inline to reduce cost
-static inline void reset_cflags(core_t *cr)
-{
-   cr->flags._cpu_flag_value = 0;
-}
-
-// update the rip pointer to the next instruction sequentially
-static inline void next_rip(core_t *cr)
-{
-    // we are handling the fixed-length of assembly string here
-    // but their size can be variable as true X86 instructions
-    // that's because the operands' sizes follow the specific encoding rule
-    // the risc-v is a fixed length ISA
-    cr->rip = cr->rip + sizeof(char) * MAX_INSTRUCTION_CHAR;
-}
-
-static void mov_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    uint64_t dst = decode_operand(dst_od);
-
-    if (src_od->type == REG && dst_od->type == REG)
-    {
-        *(uint64_t *)dst = *(uint64_t *)src;
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-    else if (src_od->type == REG && dst_od->type >= MEM_IMM)
-    {
-        write64bits_dram(va2pa(dst, cr), *(uint64_t*)src, cr);
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-    else if (src_od->type >= MEM_IMM && dst_od->type == REG)
-    {
-        *(uint64_t *)dst = read64bits_dram(va2pa(src, cr), cr);
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-    else if (src_od->type == IMM && dst_od->type == REG)
-    {
-        *(uint64_t *)dst = src;
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-}
-
-static void push_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-
-    if (src_od->type == REG)
-    {
-        (cr->reg).rsp = (cr->reg).rsp - 8;
-        write64bits_dram(va2pa((cr->reg).rsp, cr), *(uint64_t *)src, cr);
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-}
-
-static void pop_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-
-    if (src_od->type == REG)
-    {
-        uint64_t old_val = read64bits_dram(va2pa((cr->reg).rsp, cr),cr);
-        (cr->reg).rsp = (cr->reg).rsp + 8;
-        *(uint64_t *)src = old_val;
-        next_rip(cr);
-        reset_cflags(cr);
-        return;
-    }
-}
-
-static void leave_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    // movq %rbp %rsp
-    // popq %rbp
-    cr->reg.rsp = cr->reg.rbp;
-    
-    uint64_t old_val = read64bits_dram(va2pa((cr->reg).rsp, cr),cr);
-    (cr->reg).rsp = (cr->reg).rsp + 8;
-    (cr->reg).rbp = old_val;
-    next_rip(cr);
-    reset_cflags(cr);
-}
-
-
-static void call_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-
-    (cr->reg).rsp = (cr->reg).rsp - 8;
-    write64bits_dram(va2pa((cr->reg).rsp, cr), cr->rip + sizeof(char) * MAX_INSTRUCTION_CHAR, cr);
-    // jump to target function address
-    // support pc relative addressing
-
-    cr->rip = src;
-    reset_cflags(cr);
-}
-
-static void ret_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t ret_addr = read64bits_dram(va2pa((cr->reg).rsp, cr),cr);
-    (cr->reg).rsp = (cr->reg).rsp + 8;
-    // jump to return address
-    cr->rip = ret_addr;
-    reset_cflags(cr);
-}
-
-static void add_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    uint64_t dst = decode_operand(dst_od);
-
-    if (src_od->type == REG && dst_od->type == REG)
-    {
-        // src: register (value: int64_t bit map)
-        // dst: register (value: int64_t bit map)
-        uint64_t val = *(uint64_t *)dst + *(uint64_t *)src;
-
-        int val_sign = ((val) >> 63) & 0x1;
-        int src_sign = ((*(uint64_t*)src) >> 63) & 0x1;
-        int dst_sign = ((*(uint64_t*)dst) >> 63) & 0x1;
-
-        // set condition flags
-        cr->flags.CF = (val < *(uint64_t*)src);
-        cr->flags.ZF = (val == 0);
-        cr->flags.SF = val_sign;
-        cr->flags.OF = (src_sign == 0 && dst_sign == 0 && val_sign == 1) || 
-        (src_sign == 1 && dst_sign == 1 && val_sign == 0);
-
-        // update registers
-        *(uint64_t *)dst = val;
-        // signed and unsigned value follow the same addition. e.g.
-        // 5 = 0000000000000101, 3 = 0000000000000011, -3 = 1111111111111101, 5 + (-3) = 0000000000000010
-        next_rip(cr);
-        return;
-    }
-}
-
-static void sub_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    uint64_t dst = decode_operand(dst_od);
-
-    if (src_od->type == IMM && dst_od->type == REG)
-    {
-       // dst = dst - src
-        uint64_t val = *(uint64_t *)dst + (~src + 1);
-      
-        int val_sign = ((val) >> 63) & 0x1;
-        int src_sign = ((src) >> 63) & 0x1;
-        int dst_sign = ((*(uint64_t*)dst) >> 63) & 0x1;
-
-        // set conditional flag
-        cr->flags.CF = (val > *(uint64_t*)dst);  //unsigned
-        cr->flags.ZF = (val == 0);
-        cr->flags.SF = ((val >> 63) & 0x1);
-        cr->flags.OF = (src_sign == 1 && dst_sign == 0 && val_sign == 1) || 
-        (src_sign == 0 && dst_sign == 1 && val_sign == 0);
-
-        *(uint64_t*)dst = val;
-
-        next_rip(cr);
-    }
-
-}
-
-static void cmp_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    uint64_t dst = decode_operand(dst_od);
-
-    if (src_od->type == IMM && dst_od->type >= MEM_IMM)
-    {
-        // dst = dst - src
-        uint64_t dval = read64bits_dram(va2pa(dst, cr), cr);
-
-        uint64_t val = dval + (~src + 1);
-
-        int val_sign = ((val) >> 63) & 0x1;
-        int src_sign = ((src) >> 63) & 0x1;
-        int dst_sign = (dval >> 63) & 0x1;
-        
-        cr->flags.CF = (val > dval); //unsigned
-        cr->flags.ZF = (val == 0);
-        cr->flags.SF = ((val >> 63) & 0x1);
-        cr->flags.OF = (src_sign == 1 && dst_sign == 0 && val_sign == 1) || 
-        (src_sign == 0 && dst_sign == 1 && val_sign == 0);
-        
-        next_rip(cr);
-
-        return;
-    }
-
-}
-
-static void jne_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    
-    if (cr->flags.ZF == 0)
-    {
-        cr->rip = src;
-    }
-    else
-    {
-        next_rip(cr);
-    }
-
-    reset_cflags(cr);
-}
-
-static void jmp_handler(od_t *src_od, od_t *dst_od, core_t *cr)
-{
-    uint64_t src = decode_operand(src_od);
-    cr->rip = src;
-    reset_cflags(cr);
-}
-
-// instruction cycle is implemented in CPU
-// the only exposed interface outside CPU
-void instruction_cycle(core_t *cr)
-{
-    // FETCH: get the instruction string by program counter
-    //const char *inst_str = (const char *)cr->rip;
-    char inst_str[MAX_INSTRUCTION_CHAR + 10];
-    readinst_dram(va2pa(cr->rip, cr), inst_str, cr);
-
-    debug_printf(DEBUG_INSTRUCTION, "%lx    %s\n", cr->rip, inst_str);
-
-    // DECODE: decode the run-time instruction operands
-    inst_t inst;
-    parse_instruction(inst_str, &inst, cr);
-
-    // EXECUTE: get the function pointer or handler by the operator
-    handler_t handler = handler_table[inst.op];
-    // update CPU and memory according the instruction
-    handler(&(inst.src), &(inst.dst), cr);
-}
-
-void print_register(core_t *cr)
-{
-    if ((DEBUG_VERBOSE_SET & DEBUG_REGISTER) == 0x0)
-    {
-        return;
-    }
-
-    reg_t reg = cr->reg;
-
-    printf("rax = %16lx\trbx = %16lx\trcx = %16lx\trdx = %16lx\n",
-        reg.rax, reg.rbx, reg.rcx, reg.rdx);
-    printf("rsi = %16lx\trdi = %16lx\trbp = %16lx\trsp = %16lx\n",
-        reg.rsi, reg.rdi, reg.rbp, reg.rsp);
-    printf("rip = %16lx\n", cr->rip);
-    printf("CF = %u\tZF = %u\tSF = %u\tOF = %u\n",
-        cr->flags.CF, cr->flags.ZF, cr->flags.SF, cr->flags.OF);
-}
-
-void print_stack(core_t *cr)
-{
-    if ((DEBUG_VERBOSE_SET & DEBUG_PRINTSTACK) == 0x0)
-    {
-        return;
-    }
-
-    int n = 10;    
-    uint64_t *high = (uint64_t*)&pm[va2pa((cr->reg).rsp, cr)];
-    high = &high[n];
-    uint64_t va = (cr->reg).rsp + n * 8;
-
-    for (int i = 0; i < 2 * n; ++ i)
-    {
-        uint64_t *ptr = (uint64_t *)(high - i);
-        printf("0x%16lx : %16lx", va, (uint64_t)*ptr);
-
-        if (i == n)
-        {
-            printf(" <== rsp");
-        }
-
-        printf("\n");
-        va -= 8;
-    }
-}
-
-void TestParseOperand()
-{
-    core_t *ac = (core_t*)&cores[0];
-
-    const char *strs[11] = {
-       "$0x1234",
-       "%rax",
-       "0xabcd",
-       "(%rsp)",
-       "0xabcd(%rsp)",
-       "(%rsp,%rbx)",
-       "0xabcd(%rsp,%rbx)",
-       "(,%rbx,8)",
-       "0xabcd(,%rbx,8)",
-       "(%rsp,%rbx,8)",
-       "0xabcd(%rsp,%rbx,8)",
-    };
-
-    printf("rax %p\n", &(ac->reg.rax));
-    printf("rsp %p\n", &(ac->reg.rsp));
-    printf("rbx %p\n", &(ac->reg.rbx));
-
-    for (int i = 0; i < 11; i++)
-    {
-        od_t od;
-        parse_operand(strs[i], &od, ac);
-
-        printf("\n%s\n", strs[i]);
-        printf("od enum type: %d\n", od.type);
-        printf("od imm: %lx\n", od.imm);
-        printf("od reg1: %lx\n", od.reg1);
-        printf("od reg2: %lx\n", od.reg2);
-        printf("od scal: %lx\n", od.scal);
-    }
-}
-
-void TestParseInstruction()
-{
-    ACTIVE_CORE = 0x0;
-    core_t *ac = (core_t*)&cores[ACTIVE_CORE];
-       
-    char assembly[15][MAX_INSTRUCTION_CHAR] = {
-        "push   %rbp",              // 0
-        "mov    %rsp,%rbp",         // 1
-        "mov    %rdi,-0x18(%rbp)",  // 2
-        "mov    %rsi,-0x20(%rbp)",  // 3
-        "mov    -0x18(%rbp),%rdx",  // 4
-        "mov    -0x20(%rbp),%rax",  // 5
-        "add    %rdx,%rax",         // 6
-        "mov    %rax,-0x8(%rbp)",   // 7
-        "mov    -0x8(%rbp),%rax",   // 8
-        "pop    %rbp",              // 9
-        "retq",                     // 10
-        "mov    %rdx,%rsi",         // 11
-        "mov    %rax,%rdi",         // 12
-        "callq  0",                 // 13
-        "mov    %rax,-0x8(%rbp)",   // 14
-    };
-
-    inst_t inst;
-    for (int i = 0; i < 15; i++)
-    {
-        parse_instruction(assembly[i], &inst, ac);
-    }
-}
-
-
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stddef.h>
+#include<time.h>
+#include<setjmp.h>
+#include<sys/mman.h>
+#include<headers/cpu.h>
+#include<headers/memory.h>
+#include<headers/machine.h>
+#include<headers/common.h>
+#if ENABLE_SIMD_TOKENIZER == 1
+#include<emmintrin.h>
+#endif
+
+
+/*======================================*/
+/*      parse assembly instruction      */
+/*======================================*/
+typedef struct TOKEN_MASK_STRUCT token_mask_t;
+static int parse_instruction(const char *slot, inst_t *inst);
+static int parse_operand(const char *slot, const token_mask_t *m, int start, int end,
+    od_t *od);
+static uint64_t decode_operand(od_t *od, core_t *cr);
+
+// host address of the register operand in the core
+static inline uint64_t reg_addr(uint64_t id, core_t *cr)
+{
+    // the high byte registers (ah, bh, ...) are the second byte of the register
+    return (uint64_t)&(cr->reg.regs[REG_NUM(id)]) + (REG_WIDTH(id) == REG_8H);
+}
+
+// the register file entries of the operand
+#define OD_REG1(od, cr) ((cr)->reg.regs[REG_NUM((od)->reg1)])
+#define OD_REG2(od, cr) ((cr)->reg.regs[REG_NUM((od)->reg2)])
+
+// all the memory operand types
+#define FOR_EACH_MEM_TYPE(X)    \
+    X(MEM_IMM)                  \
+    X(MEM_REG1)                 \
+    X(MEM_IMM_REG1)             \
+    X(MEM_REG1_REG2)            \
+    X(MEM_IMM_REG1_REG2)        \
+    X(MEM_REG2_SCAL)            \
+    X(MEM_IMM_REG2_SCAL)        \
+    X(MEM_REG1_REG2_SCAL)       \
+    X(MEM_IMM_REG1_REG2_SCAL)
+
+// effective (virtual) address of each memory operand type: ea_MEM_IMM, etc.
+#define DEFINE_EA(type, expr)                                       \
+    static inline uint64_t ea_##type(const od_t *od, core_t *cr)    \
+    {                                                               \
+        return (expr);                                              \
+    }
+
+DEFINE_EA(MEM_IMM,                  od->imm)
+DEFINE_EA(MEM_REG1,                 OD_REG1(od, cr))
+DEFINE_EA(MEM_IMM_REG1,             od->imm + OD_REG1(od, cr))
+DEFINE_EA(MEM_REG1_REG2,            OD_REG1(od, cr) + OD_REG2(od, cr))
+DEFINE_EA(MEM_IMM_REG1_REG2,        od->imm + OD_REG1(od, cr) + OD_REG2(od, cr))
+DEFINE_EA(MEM_REG2_SCAL,            OD_REG2(od, cr) * od->scal)
+DEFINE_EA(MEM_IMM_REG2_SCAL,        od->imm + OD_REG2(od, cr) * od->scal)
+DEFINE_EA(MEM_REG1_REG2_SCAL,       OD_REG1(od, cr) + OD_REG2(od, cr) * od->scal)
+DEFINE_EA(MEM_IMM_REG1_REG2_SCAL,   od->imm + OD_REG1(od, cr) + OD_REG2(od, cr) * od->scal)
+
+#undef DEFINE_EA
+
+static uint64_t decode_operand(od_t *od, core_t *cr)
+{
+     if (od->type == IMM)
+    {
+        // immediate signed number can be negative: convert to bitmap
+        return *(uint64_t *)&od->imm;
+    }
+    else if (od->type == REG)
+    {
+        // default register 1
+        return reg_addr(od->reg1, cr);
+    }
+    else if (od->type == EMPTY)
+    {
+        return 0;
+    }
+    else
+    {
+        // access memory: return the virtual address
+        switch (od->type)
+        {
+#define EA_CASE(type) case type: return ea_##type(od, cr);
+            FOR_EACH_MEM_TYPE(EA_CASE)
+#undef EA_CASE
+            default:
+                return 0;
+        }
+    }
+}
+
+// perfect hash of the 72 register names, generated offline:
+// no two names share a slot, so one probe and one strcmp resolve any name
+#define NUM_REG_HASH_SLOT 256
+#define REG_HASH_MULTIPLIER 0x122f8f9d
+
+typedef struct
+{
+    const char *name;
+    uint64_t id;
+} reg_hash_entry_t;
+
+static const reg_hash_entry_t reg_hash_table[NUM_REG_HASH_SLOT] = {
+    [  1] = {"%r9", REG_ID(9, REG_64)},
+    [  3] = {"%r14w", REG_ID(14, REG_16)},
+    [  9] = {"%r8d", REG_ID(8, REG_32)},
+    [ 10] = {"%ax", REG_ID(0, REG_16)},
+    [ 14] = {"%r11d", REG_ID(11, REG_32)},
+    [ 17] = {"%r12", REG_ID(12, REG_64)},
+    [ 24] = {"%r9b", REG_ID(9, REG_8L)},
+    [ 27] = {"%bh", REG_ID(1, REG_8H)},
+    [ 29] = {"%sp", REG_ID(7, REG_16)},
+    [ 30] = {"%r12b", REG_ID(12, REG_8L)},
+    [ 35] = {"%r13", REG_ID(13, REG_64)},
+    [ 38] = {"%rcx", REG_ID(2, REG_64)},
+    [ 48] = {"%al", REG_ID(0, REG_8L)},
+    [ 49] = {"%spl", REG_ID(7, REG_8L)},
+    [ 52] = {"%r10w", REG_ID(10, REG_16)},
+    [ 54] = {"%r14", REG_ID(14, REG_64)},
+    [ 55] = {"%r15w", REG_ID(15, REG_16)},
+    [ 61] = {"%r9d", REG_ID(9, REG_32)},
+    [ 62] = {"%bx", REG_ID(1, REG_16)},
+    [ 66] = {"%r12d", REG_ID(12, REG_32)},
+    [ 68] = {"%eax", REG_ID(0, REG_32)},
+    [ 72] = {"%r15", REG_ID(15, REG_64)},
+    [ 73] = {"%rdi", REG_ID(5, REG_64)},
+    [ 79] = {"%ch", REG_ID(2, REG_8H)},
+    [ 81] = {"%r13b", REG_ID(13, REG_8L)},
+    [ 82] = {"%rsi", REG_ID(4, REG_64)},
+    [ 86] = {"%esp", REG_ID(7, REG_32)},
+    [ 90] = {"%rdx", REG_ID(3, REG_64)},
+    [ 92] = {"%bph", REG_ID(6, REG_8H)},
+    [ 97] = {"%rbp", REG_ID(6, REG_64)},
+    [ 98] = {"%r8w", REG_ID(8, REG_16)},
+    [100] = {"%bl", REG_ID(1, REG_8L)},
+    [104] = {"%r11w", REG_ID(11, REG_16)},
+    [114] = {"%cx", REG_ID(2, REG_16)},
+    [118] = {"%r13d", REG_ID(13, REG_32)},
+    [119] = {"%ebx", REG_ID(1, REG_32)},
+    [122] = {"%dih", REG_ID(5, REG_8H)},
+    [126] = {"%sih", REG_ID(4, REG_8H)},
+    [131] = {"%dh", REG_ID(3, REG_8H)},
+    [133] = {"%r14b", REG_ID(14, REG_8L)},
+    [149] = {"%di", REG_ID(5, REG_16)},
+    [150] = {"%r9w", REG_ID(9, REG_16)},
+    [152] = {"%cl", REG_ID(2, REG_8L)},
+    [155] = {"%r12w", REG_ID(12, REG_16)},
+    [157] = {"%si", REG_ID(4, REG_16)},
+    [164] = {"%bpl", REG_ID(6, REG_8L)},
+    [166] = {"%dx", REG_ID(3, REG_16)},
+    [169] = {"%r14d", REG_ID(14, REG_32)},
+    [171] = {"%ecx", REG_ID(2, REG_32)},
+    [173] = {"%bp", REG_ID(6, REG_16)},
+    [182] = {"%r10b", REG_ID(10, REG_8L)},
+    [185] = {"%r15b", REG_ID(15, REG_8L)},
+    [191] = {"%rax", REG_ID(0, REG_64)},
+    [195] = {"%dil", REG_ID(5, REG_8L)},
+    [199] = {"%sil", REG_ID(4, REG_8L)},
+    [203] = {"%dl", REG_ID(3, REG_8L)},
+    [206] = {"%edi", REG_ID(5, REG_32)},
+    [207] = {"%r13w", REG_ID(13, REG_16)},
+    [209] = {"%rsp", REG_ID(7, REG_64)},
+    [215] = {"%esi", REG_ID(4, REG_32)},
+    [218] = {"%r10d", REG_ID(10, REG_32)},
+    [221] = {"%r15d", REG_ID(15, REG_32)},
+    [223] = {"%edx", REG_ID(3, REG_32)},
+    [229] = {"%r8b", REG_ID(8, REG_8L)},
+    [230] = {"%ebp", REG_ID(6, REG_32)},
+    [231] = {"%ah", REG_ID(0, REG_8H)},
+    [233] = {"%sph", REG_ID(7, REG_8H)},
+    [234] = {"%r11b", REG_ID(11, REG_8L)},
+    [237] = {"%r10", REG_ID(10, REG_64)},
+    [238] = {"%r8", REG_ID(8, REG_64)},
+    [243] = {"%rbx", REG_ID(1, REG_64)},
+    [255] = {"%r11", REG_ID(11, REG_64)},
+};
+
+static inline uint64_t reg_name_hash(const char *str)
+{
+    uint32_t h = 0;
+    for (int i = 0; str[i] != '\0'; ++ i)
+    {
+        h = h * 31 + (uint8_t)str[i];
+    }
+    // multiplicative hashing: the top 8 bits
+    return (uint32_t)(h * REG_HASH_MULTIPLIER) >> 24;
+}
+
+// return 0 if str is not a register name
+static int reflect_register(const char *str, uint64_t *id)
+{
+    const reg_hash_entry_t *entry = &reg_hash_table[reg_name_hash(str)];
+
+    if (entry->name != NULL && strcmp(str, entry->name) == 0)
+    {
+        *id = entry->id;
+        return 1;
+    }
+
+    debug_printf(DEBUG_PARSEINST, "parse register %s error\n", str);
+    return 0;
+}
+
+
+// perfect hash of the 101 mnemonics with their b/w/l/q suffix variants and
+// the aliases of the conditional jumps, generated offline like the registers
+// width 0: no suffix, the operand size is given by the register operands
+#define NUM_MNEMONIC_HASH_SLOT 512
+#define MNEMONIC_HASH_MULTIPLIER 0x201b890d
+
+typedef struct
+{
+    const char *name;
+    op_t op;
+    uint64_t width;
+} mnemonic_hash_entry_t;
+
+static const mnemonic_hash_entry_t mnemonic_hash_table[NUM_MNEMONIC_HASH_SLOT] = {
+    [  0] = {"xaddl", INST_XADD, 4},
+    [  3] = {"mov", INST_MOV, 0},
+    [ 12] = {"jnb", INST_JAE, 0},
+    [ 17] = {"jnz", INST_JNE, 0},
+    [ 19] = {"leaq", INST_LEA, 8},
+    [ 25] = {"jg", INST_JG, 0},
+    [ 32] = {"cmpq", INST_CMP, 8},
+    [ 41] = {"cmpxchgb", INST_CMPXCHG, 1},
+    [ 51] = {"orq", INST_OR, 8},
+    [ 59] = {"testl", INST_TEST, 4},
+    [ 61] = {"movw", INST_MOV, 2},
+    [ 64] = {"xorq", INST_XOR, 8},
+    [ 66] = {"subq", INST_SUB, 8},
+    [ 76] = {"jnc", INST_JAE, 0},
+    [ 77] = {"andq", INST_AND, 8},
+    [ 92] = {"cmpb", INST_CMP, 1},
+    [ 93] = {"nopw", INST_NOP, 2},
+    [ 94] = {"jge", INST_JGE, 0},
+    [ 97] = {"cmp", INST_CMP, 0},
+    [ 98] = {"xchgq", INST_XCHG, 8},
+    [104] = {"imulq", INST_IMUL, 8},
+    [109] = {"popq", INST_POP, 8},
+    [112] = {"orb", INST_OR, 1},
+    [116] = {"imul", INST_IMUL, 0},
+    [121] = {"addl", INST_ADD, 4},
+    [125] = {"xorb", INST_XOR, 1},
+    [127] = {"subb", INST_SUB, 1},
+    [128] = {"cmpxchg", INST_CMPXCHG, 0},
+    [134] = {"retq", INST_RET, 8},
+    [138] = {"andb", INST_AND, 1},
+    [141] = {"jnle", INST_JG, 0},
+    [142] = {"jnl", INST_JGE, 0},
+    [151] = {"ja", INST_JA, 0},
+    [158] = {"xchgb", INST_XCHG, 1},
+    [160] = {"leave", INST_LEAVE, 0},
+    [164] = {"xor", INST_XOR, 0},
+    [171] = {"cmpxchgl", INST_CMPXCHG, 4},
+    [187] = {"movq", INST_MOV, 8},
+    [195] = {"xaddw", INST_XADD, 2},
+    [203] = {"jnbe", INST_JA, 0},
+    [204] = {"jne", INST_JNE, 0},
+    [210] = {"leal", INST_LEA, 4},
+    [215] = {"jb", INST_JB, 0},
+    [221] = {"jz", INST_JE, 0},
+    [222] = {"cmpl", INST_CMP, 4},
+    [229] = {"hlt", INST_HLT, 0},
+    [242] = {"orl", INST_OR, 4},
+    [248] = {"movb", INST_MOV, 1},
+    [254] = {"testw", INST_TEST, 2},
+    [255] = {"xorl", INST_XOR, 4},
+    [257] = {"subl", INST_SUB, 4},
+    [260] = {"jnae", INST_JB, 0},
+    [263] = {"and", INST_AND, 0},
+    [265] = {"ret", INST_RET, 0},
+    [268] = {"andl", INST_AND, 4},
+    [273] = {"test", INST_TEST, 0},
+    [275] = {"call", INST_CALL, 0},
+    [280] = {"jc", INST_JB, 0},
+    [289] = {"xchgl", INST_XCHG, 4},
+    [295] = {"imull", INST_IMUL, 4},
+    [315] = {"addw", INST_ADD, 2},
+    [319] = {"jle", INST_JLE, 0},
+    [321] = {"xaddq", INST_XADD, 8},
+    [325] = {"add", INST_ADD, 0},
+    [330] = {"xchg", INST_XCHG, 0},
+    [333] = {"jng", INST_JLE, 0},
+    [337] = {"xadd", INST_XADD, 0},
+    [341] = {"mfence", INST_MFENCE, 0},
+    [346] = {"jl", INST_JL, 0},
+    [365] = {"cmpxchgw", INST_CMPXCHG, 2},
+    [378] = {"movl", INST_MOV, 4},
+    [380] = {"jbe", INST_JBE, 0},
+    [381] = {"testq", INST_TEST, 8},
+    [382] = {"xaddb", INST_XADD, 1},
+    [392] = {"pushq", INST_PUSH, 8},
+    [400] = {"nop", INST_NOP, 0},
+    [408] = {"je", INST_JE, 0},
+    [411] = {"nopl", INST_NOP, 4},
+    [412] = {"jmpq", INST_JMP, 8},
+    [417] = {"cmpw", INST_CMP, 2},
+    [428] = {"jnge", INST_JL, 0},
+    [430] = {"pop", INST_POP, 0},
+    [436] = {"orw", INST_OR, 2},
+    [437] = {"callq", INST_CALL, 8},
+    [438] = {"jae", INST_JAE, 0},
+    [441] = {"testb", INST_TEST, 1},
+    [442] = {"addq", INST_ADD, 8},
+    [444] = {"or", INST_OR, 0},
+    [447] = {"leaveq", INST_LEAVE, 8},
+    [449] = {"xorw", INST_XOR, 2},
+    [452] = {"subw", INST_SUB, 2},
+    [456] = {"jmp", INST_JMP, 0},
+    [459] = {"jna", INST_JBE, 0},
+    [462] = {"andw", INST_AND, 2},
+    [472] = {"push", INST_PUSH, 0},
+    [483] = {"xchgw", INST_XCHG, 2},
+    [489] = {"imulw", INST_IMUL, 2},
+    [492] = {"cmpxchgq", INST_CMPXCHG, 8},
+    [493] = {"lea", INST_LEA, 0},
+    [502] = {"addb", INST_ADD, 1},
+    [511] = {"sub", INST_SUB, 0},
+};
+
+static inline uint64_t mnemonic_hash(const char *str)
+{
+    uint32_t h = 0;
+    for (int i = 0; str[i] != '\0'; ++ i)
+    {
+        h = h * 31 + (uint8_t)str[i];
+    }
+    // multiplicative hashing: the top 9 bits
+    return (uint32_t)(h * MNEMONIC_HASH_MULTIPLIER) >> 23;
+}
+
+// set the operator and operand size of the instruction
+// return 0 if the mnemonic is unknown
+static int reflect_mnemonic(const char *str, inst_t *inst)
+{
+    const mnemonic_hash_entry_t *entry = &mnemonic_hash_table[mnemonic_hash(str)];
+
+    if (entry->name != NULL && strcmp(str, entry->name) == 0)
+    {
+        inst->op = entry->op;
+        inst->width = entry->width;
+        return 1;
+    }
+    return 0;
+}
+
+// the lock prefix is only for the read-modify-write of memory
+static inline int lock_allowed(const inst_t *inst)
+{
+    op_t op = inst->op;
+    return inst->lock == 0 || (inst->dst.type >= MEM_IMM &&
+        (op == INST_ADD || op == INST_SUB || op == INST_AND || op == INST_OR ||
+        op == INST_XOR || op == INST_XCHG || op == INST_CMPXCHG || op == INST_XADD));
+}
+
+static inline uint64_t reg_width_bytes(uint64_t id)
+{
+    switch (REG_WIDTH(id))
+    {
+        case REG_64:
+            return 8;
+        case REG_32:
+            return 4;
+        case REG_16:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+/*======================================*/
+/*      tokenizer                       */
+/*======================================*/
+
+// the instruction strings live in MAX_INSTRUCTION_CHAR byte slots
+// so one slot is classified at once into bit masks of the separators:
+// bit i of each mask is set if byte i of the slot is such a separator
+typedef struct TOKEN_MASK_STRUCT
+{
+    uint64_t space;
+    uint64_t comma;
+    uint64_t lparen;
+    uint64_t rparen;
+    uint64_t end;       // the terminating '\0' and all the bytes after it
+} token_mask_t;
+
+// the bits from i on
+static inline uint64_t mask_from(int i)
+{
+    return i >= 64 ? 0 : ~0ULL << i;
+}
+
+// index of the lowest set bit, 64 if none
+static inline int first_bit(uint64_t mask)
+{
+    return mask == 0 ? 64 : __builtin_ctzll(mask);
+}
+
+static inline void finish_token_mask(uint64_t nul, token_mask_t *m)
+{
+    m->end = nul == 0 ? 0 : mask_from(first_bit(nul));
+    m->space &= ~m->end;
+    m->comma &= ~m->end;
+    m->lparen &= ~m->end;
+    m->rparen &= ~m->end;
+}
+
+static void scan_slot_scalar(const char *slot, token_mask_t *m)
+{
+    uint64_t nul = 0;
+    m->space = 0;
+    m->comma = 0;
+    m->lparen = 0;
+    m->rparen = 0;
+
+    for (int i = 0; i < MAX_INSTRUCTION_CHAR; ++ i)
+    {
+        uint64_t bit = 1ULL << i;
+        switch (slot[i])
+        {
+            case ' ':
+                m->space |= bit;
+                break;
+            case ',':
+                m->comma |= bit;
+                break;
+            case '(':
+                m->lparen |= bit;
+                break;
+            case ')':
+                m->rparen |= bit;
+                break;
+            case '\0':
+                nul |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+    finish_token_mask(nul, m);
+}
+
+#if ENABLE_SIMD_TOKENIZER == 1
+// 16 bytes per compare, 4 loads per slot
+#define SIMD_CLASSIFY(vec, ch, shift) \
+    ((uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8((vec), _mm_set1_epi8(ch))) << (shift))
+
+static void scan_slot_simd(const char *slot, token_mask_t *m)
+{
+    uint64_t nul = 0;
+    m->space = 0;
+    m->comma = 0;
+    m->lparen = 0;
+    m->rparen = 0;
+
+    for (int i = 0; i < MAX_INSTRUCTION_CHAR; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(slot + i));
+        m->space    |= SIMD_CLASSIFY(v, ' ', i);
+        m->comma    |= SIMD_CLASSIFY(v, ',', i);
+        m->lparen   |= SIMD_CLASSIFY(v, '(', i);
+        m->rparen   |= SIMD_CLASSIFY(v, ')', i);
+        nul         |= SIMD_CLASSIFY(v, '\0', i);
+    }
+    finish_token_mask(nul, m);
+}
+
+#undef SIMD_CLASSIFY
+
+#define scan_slot scan_slot_simd
+#else
+#define scan_slot scan_slot_scalar
+#endif
+
+// copy slot[start, end) as a string
+static inline void copy_token(char *dst, const char *slot, int start, int end)
+{
+    memcpy(dst, slot + start, end - start);
+    dst[end - start] = '\0';
+}
+
+// slot: MAX_INSTRUCTION_CHAR bytes, the instruction ends at the first '\0' or the slot end
+// return 1 if the instruction is well formed, 0 otherwise
+static int parse_instruction(const char *slot, inst_t *inst)
+{
+    token_mask_t m;
+    scan_slot(slot, &m);
+
+    uint64_t stop = m.space | m.end;
+    uint64_t text = ~stop;
+
+    // operator: the first word
+    int op_start = first_bit(text);
+    int op_end = first_bit(stop & mask_from(op_start));
+
+    // the lock prefix is a word before the operator
+    inst->lock = 0;
+    if (op_end - op_start == 4 && memcmp(slot + op_start, "lock", 4) == 0)
+    {
+        inst->lock = 1;
+        op_start = first_bit(text & mask_from(op_end));
+        op_end = first_bit(stop & mask_from(op_start));
+    }
+
+    // src: up to the comma outside the parentheses, or the end
+    int src_start = first_bit(text & mask_from(op_end));
+    int src_end = first_bit(m.end);
+    uint64_t commas = m.comma & mask_from(src_start);
+    while (commas != 0)
+    {
+        int c = first_bit(commas);
+        int count_parentheses = __builtin_popcountll(
+            (m.lparen | m.rparen) & mask_from(src_start) & ~mask_from(c));
+        if (count_parentheses == 0 || count_parentheses == 2)
+        {
+            src_end = c;
+            break;
+        }
+        commas &= commas - 1;
+    }
+
+    // dst: the word after the comma
+    int dst_start = src_end;
+    int dst_end = src_end;
+    if (src_end < 64 && ((m.comma >> src_end) & 1) == 1)
+    {
+        dst_start = first_bit((text & ~m.comma) & mask_from(src_end + 1));
+        dst_end = first_bit(stop & mask_from(dst_start));
+    }
+
+    char op_str[MAX_INSTRUCTION_CHAR + 1];
+    copy_token(op_str, slot, op_start, op_end);
+
+    // the control register of the page tables is left out of the operands
+    int src_cr3 = src_end - src_start == 4 && memcmp(slot + src_start, "%cr3", 4) == 0;
+    int dst_cr3 = dst_end - dst_start == 4 && memcmp(slot + dst_start, "%cr3", 4) == 0;
+
+    //op_str, src_str, dst_str
+    if (parse_operand(slot, &m, src_start, src_cr3 == 1 ? src_start : src_end, &(inst->src)) == 0 ||
+        parse_operand(slot, &m, dst_start, dst_cr3 == 1 ? dst_start : dst_end, &(inst->dst)) == 0)
+    {
+        return 0;
+    }
+
+    if (reflect_mnemonic(op_str, inst) == 0)
+    {
+        debug_printf(DEBUG_PARSEINST, "unknown operator [%s]\n", op_str);
+        return 0;
+    }
+
+    if (lock_allowed(inst) == 0)
+    {
+        debug_printf(DEBUG_PARSEINST, "lock prefix on [%s]\n", op_str);
+        return 0;
+    }
+
+    if (src_cr3 == 1 || dst_cr3 == 1)
+    {
+        // mov %reg,%cr3 or mov %cr3,%reg
+        od_t *od = src_cr3 == 1 ? &(inst->dst) : &(inst->src);
+        if (inst->op != INST_MOV || src_cr3 == dst_cr3 || od->type != REG ||
+            REG_WIDTH(od->reg1) != REG_64)
+        {
+            debug_printf(DEBUG_PARSEINST, "%%cr3 operand of [%s]\n", op_str);
+            return 0;
+        }
+        inst->op = INST_MOV_CR3;
+    }
+
+    inst->length = sizeof(char) * MAX_INSTRUCTION_CHAR;
+
+    // without suffix, the size follows the register operand
+    if (inst->width == 0)
+    {
+        if (inst->dst.type == REG)
+        {
+            inst->width = reg_width_bytes(inst->dst.reg1);
+        }
+        else if (inst->src.type == REG)
+        {
+            inst->width = reg_width_bytes(inst->src.reg1);
+        }
+        else
+        {
+            inst->width = 8;
+        }
+    }
+
+    // lea has no byte or word form here, and the byte imul is one-operand only
+    if ((inst->op == INST_LEA && inst->width < 4) ||
+        (inst->op == INST_IMUL && inst->width == 1))
+    {
+        debug_printf(DEBUG_PARSEINST, "operand size of [%s]\n", op_str);
+        return 0;
+    }
+
+    debug_printf(DEBUG_PARSEINST, "[%s (%d)] [%.*s (%d)] [%.*s (%d)]\n" ,
+    op_str, inst->op, src_end - src_start, slot + src_start, inst->src.type,
+    dst_end - dst_start, slot + dst_start, inst->dst.type);
+
+    return 1;
+}
+
+// parse the operand slot[start, end) by the separator masks of the slot
+// return 0 if the operand is malformed
+static int parse_operand(const char *slot, const token_mask_t *m, int start, int end,
+    od_t *od)
+{
+   // od: pointer to the address to store the parsed operand
+   od->type = EMPTY;
+   od->imm = 0;
+   od->scal = 0;
+   od->reg1  = 0;
+   od->reg2  = 0;
+
+   if (start >= end)
+   {
+        return 1;
+   }
+
+   char str[MAX_INSTRUCTION_CHAR + 1];
+
+   if (slot[start] == '$')
+   {
+      od->type = IMM;
+      copy_token(str, slot, start + 1, end);
+      //imm
+      return string2uint_checked(str, 0, -1, &(od->imm)) == CONVERT_OK;
+   }
+   else if (slot[start] == '%')
+   {
+      //reg
+      od->type = REG;
+      copy_token(str, slot, start, end);
+      return reflect_register(str, &(od->reg1));
+   }
+
+   //memory: imm(reg1,reg2,scal)
+   uint64_t range = mask_from(start) & ~mask_from(end);
+   int lparen = first_bit(m->lparen & range);
+   int rparen = first_bit(m->rparen & range);
+
+   // imm: everything before '('
+   int imm_end = lparen < end ? lparen : end;
+   if (imm_end > start)
+   {
+       copy_token(str, slot, start, imm_end);
+       if (string2uint_checked(str, 0, -1, &(od->imm)) != CONVERT_OK)
+       {
+           return 0;
+       }
+       if (lparen >= end)
+       {
+          od->type = MEM_IMM;
+          return 1;
+       }
+   }
+
+   // the commas between the parentheses split reg1, reg2 and scal
+   uint64_t inside = mask_from(lparen + 1) & ~mask_from(rparen < end ? rparen : end);
+   uint64_t commas = m->comma & inside;
+   int cb = __builtin_popcountll(commas);
+   int c1 = first_bit(commas);
+   int c2 = first_bit(commas & (commas - 1));
+   int inner_end = rparen < end ? rparen : end;
+
+   int reg1_end = cb >= 1 ? c1 : inner_end;
+   int reg1_len = reg1_end - (lparen + 1);
+   if (reg1_len > 0)
+   {
+       copy_token(str, slot, lparen + 1, reg1_end);
+       if (reflect_register(str, &(od->reg1)) == 0)
+       {
+           return 0;
+       }
+   }
+
+   if (cb >= 1)
+   {
+       int reg2_end = cb >= 2 ? c2 : inner_end;
+       if (reg2_end > c1 + 1)
+       {
+           copy_token(str, slot, c1 + 1, reg2_end);
+           if (reflect_register(str, &(od->reg2)) == 0)
+           {
+               return 0;
+           }
+       }
+   }
+
+   if (cb >= 2 && inner_end > c2 + 1)
+   {
+      copy_token(str, slot, c2 + 1, inner_end);
+      if (string2uint_checked(str, 0, -1, &(od->scal)) != CONVERT_OK ||
+          (od->scal != 1 && od->scal != 2 && od->scal != 4 && od->scal != 8))
+      {
+          debug_printf(DEBUG_PARSEINST, "%s is not a legal scaler\n", str);
+          return 0;
+      }
+   }
+
+   int imm_len = imm_end - start;
+   if (cb == 0)
+   {
+        od->type = imm_len > 0 ? MEM_IMM_REG1 : MEM_REG1;
+   }
+   else if (cb == 1)
+   {
+        od->type = imm_len > 0 ? MEM_IMM_REG1_REG2 : MEM_REG1_REG2;
+   }
+   else if (reg1_len > 0)
+   {
+        od->type = imm_len > 0 ? MEM_IMM_REG1_REG2_SCAL : MEM_REG1_REG2_SCAL;
+   }
+   else
+   {
+        od->type = imm_len > 0 ? MEM_IMM_REG2_SCAL : MEM_REG2_SCAL;
+   }
+   return 1;
+}
+
+/*======================================*/
+/*      decode x86-64 machine code      */
+/*======================================*/
+
+// the encodings of the op_t subset as emitted by gcc and as:
+// prefixes 0x66 (16-bit operand), segment overrides ignored in 64-bit mode,
+// 0xf3 on ret and nop only, and REX, then the opcode, ModRM, SIB,
+// displacement and immediate. the instructions fill the same inst_t as
+// the objdump text of them does, width included: the 8-byte ones take the
+// specialized handlers, the 1, 2 and 4-byte ones the general handlers
+
+// register numbers in the encoding order: rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi
+static const uint8_t x86_reg_num[8] = {0, 2, 3, 1, 7, 6, 4, 5};
+
+#define X86_NO_OP ((op_t)NUM_INSTRTYPE)
+
+// ALU opcodes 0x00 - 0x3f by bits [5:3], adc and sbb are not in the subset
+static const op_t x86_alu_op[8] = {
+    INST_ADD, INST_OR, X86_NO_OP, X86_NO_OP, INST_AND, INST_SUB, INST_XOR, INST_CMP,
+};
+
+// conditional jumps 0x7x and 0x0f 0x8x by the condition code
+static const op_t x86_jcc_op[16] = {
+    X86_NO_OP, X86_NO_OP, INST_JB, INST_JAE, INST_JE, INST_JNE, INST_JBE, INST_JA,
+    X86_NO_OP, X86_NO_OP, X86_NO_OP, X86_NO_OP, INST_JL, INST_JGE, INST_JLE, INST_JG,
+};
+
+// REX bits
+#define REX_W 0x8
+#define REX_R 0x4
+#define REX_X 0x2
+#define REX_B 0x1
+
+// REG_ID of the encoded register n (REX extension included) of size bytes
+static uint64_t x86_reg(uint64_t n, uint64_t size, uint8_t rex)
+{
+    uint64_t num = n < 8 ? x86_reg_num[n] : n;
+    switch (size)
+    {
+        case 8:
+            return REG_ID(num, REG_64);
+        case 4:
+            return REG_ID(num, REG_32);
+        case 2:
+            return REG_ID(num, REG_16);
+        default:
+            // without REX, 4 - 7 are ah, ch, dh, bh instead of spl, bpl, sil, dil
+            if (rex == 0 && 4 <= n && n < 8)
+            {
+                return REG_ID(x86_reg_num[n - 4], REG_8H);
+            }
+            return REG_ID(num, REG_8L);
+    }
+}
+
+// read the little-endian field of n bytes at *pos
+// return 0 if it is beyond the longest instruction
+static int x86_fetch(const uint8_t *code, uint64_t *pos, uint64_t n, uint64_t *value)
+{
+    if (*pos + n > MAX_X86_INST_LEN)
+    {
+        return 0;
+    }
+    *value = 0;
+    for (uint64_t i = 0; i < n; ++ i)
+    {
+        *value |= (uint64_t)code[*pos + i] << (8 * i);
+    }
+    *pos += n;
+    return 1;
+}
+
+// the immediate of n bytes sign-extended to the operand size, as objdump prints it
+static inline uint64_t x86_imm(uint64_t value, uint64_t n, uint64_t size)
+{
+    uint64_t sv = (uint64_t)((int64_t)(value << (64 - 8 * n)) >> (64 - 8 * n));
+    return size == 8 ? sv : sv & ((1ULL << (8 * size)) - 1);
+}
+
+// decode ModRM, SIB and the displacement at *pos into the r/m operand
+// *reg gets the reg field; a rip-relative od gets its displacement in imm
+// as the next rip is known only at the end of the instruction
+static int x86_modrm(const uint8_t *code, uint64_t *pos, uint8_t rex, uint64_t size,
+    od_t *od, uint64_t *reg, int *rip_relative)
+{
+    uint64_t modrm;
+    if (x86_fetch(code, pos, 1, &modrm) == 0)
+    {
+        return 0;
+    }
+    uint64_t mod = modrm >> 6;
+    uint64_t rm = (modrm & 0x7) | ((rex & REX_B) << 3);
+    *reg = ((modrm >> 3) & 0x7) | ((rex & REX_R) << 1);
+
+    od->type = EMPTY;
+    od->imm = 0;
+    od->scal = 0;
+    od->reg1 = 0;
+    od->reg2 = 0;
+    *rip_relative = 0;
+
+    if (mod == 3)
+    {
+        od->type = REG;
+        od->reg1 = x86_reg(rm, size, rex);
+        return 1;
+    }
+
+    int has_base = 1;
+    int has_index = 0;
+    uint64_t disp_size = mod == 1 ? 1 : (mod == 2 ? 4 : 0);
+
+    if ((rm & 0x7) == 4)
+    {
+        // SIB: scale, index and base
+        uint64_t sib;
+        if (x86_fetch(code, pos, 1, &sib) == 0)
+        {
+            return 0;
+        }
+        uint64_t index = ((sib >> 3) & 0x7) | ((rex & REX_X) << 2);
+        uint64_t base = (sib & 0x7) | ((rex & REX_B) << 3);
+
+        // index rsp means no index
+        if (index != 4)
+        {
+            has_index = 1;
+            od->reg2 = x86_reg(index, 8, rex);
+            od->scal = 1 << (sib >> 6);
+        }
+        if ((base & 0x7) == 5 && mod == 0)
+        {
+            has_base = 0;
+            disp_size = 4;
+        }
+        else
+        {
+            od->reg1 = x86_reg(base, 8, rex);
+        }
+    }
+    else if ((rm & 0x7) == 5 && mod == 0)
+    {
+        *rip_relative = 1;
+        has_base = 0;
+        disp_size = 4;
+    }
+    else
+    {
+        od->reg1 = x86_reg(rm, 8, rex);
+    }
+
+    uint64_t disp = 0;
+    if (disp_size > 0)
+    {
+        if (x86_fetch(code, pos, disp_size, &disp) == 0)
+        {
+            return 0;
+        }
+        od->imm = x86_imm(disp, disp_size, 8);
+    }
+
+    // a displacement field is printed even if it is 0: 0x0(%rbp)
+    int has_imm = disp_size > 0;
+    if (has_base == 0 && has_index == 0)
+    {
+        od->type = MEM_IMM;
+    }
+    else if (has_index == 0)
+    {
+        od->type = has_imm ? MEM_IMM_REG1 : MEM_REG1;
+    }
+    else if (has_base == 1)
+    {
+        od->type = has_imm ? MEM_IMM_REG1_REG2_SCAL : MEM_REG1_REG2_SCAL;
+    }
+    else
+    {
+        od->type = has_imm ? MEM_IMM_REG2_SCAL : MEM_REG2_SCAL;
+    }
+    return 1;
+}
+
+static inline void set_reg_od(od_t *od, uint64_t id)
+{
+    od->type = REG;
+    od->imm = 0;
+    od->scal = 0;
+    od->reg1 = id;
+    od->reg2 = 0;
+}
+
+static inline void set_imm_od(od_t *od, od_type_t type, uint64_t imm)
+{
+    od->type = type;
+    od->imm = imm;
+    od->scal = 0;
+    od->reg1 = 0;
+    od->reg2 = 0;
+}
+
+int decode_x86_inst(const uint8_t *code, uint64_t vaddr, inst_t *inst)
+{
+    uint64_t pos = 0;
+    int prefix_16 = 0;
+    int prefix_rep = 0;
+    int prefix_lock = 0;
+    uint8_t rex = 0;
+
+    for (; pos < MAX_X86_INST_LEN; ++ pos)
+    {
+        uint8_t b = code[pos];
+        if (b == 0x66)
+        {
+            prefix_16 = 1;
+        }
+        else if (b == 0xf0)
+        {
+            prefix_lock = 1;
+        }
+        else if (b == 0xf3)
+        {
+            prefix_rep = 1;
+        }
+        else if (b != 0x26 && b != 0x2e && b != 0x36 && b != 0x3e)
+        {
+            break;
+        }
+    }
+    if (pos < MAX_X86_INST_LEN && (code[pos] & 0xf0) == 0x40)
+    {
+        rex = code[pos];
+        pos ++;
+    }
+
+    uint64_t opcode;
+    if (x86_fetch(code, &pos, 1, &opcode) == 0)
+    {
+        return 0;
+    }
+    if (opcode == 0x0f)
+    {
+        if (x86_fetch(code, &pos, 1, &opcode) == 0)
+        {
+            return 0;
+        }
+        opcode |= 0x0f00;
+    }
+
+    // the operand size of the full-size forms, the byte forms are 1
+    uint64_t size = (rex & REX_W) != 0 ? 8 : (prefix_16 == 1 ? 2 : 4);
+    // immediates of the full-size forms are up to 32 bits
+    uint64_t imm_size = size == 2 ? 2 : 4;
+
+    inst->op = X86_NO_OP;
+    inst->width = 8;
+    inst->lock = prefix_lock;
+    set_imm_od(&(inst->src), EMPTY, 0);
+    set_imm_od(&(inst->dst), EMPTY, 0);
+
+    od_t rm;
+    uint64_t reg = 0;
+    uint64_t imm = 0;
+    int rip_relative = 0;
+
+    if (opcode < 0x40 && (opcode & 0x7) < 6)
+    {
+        // ALU: r/m8,r8 r/m,r r8,r/m8 r,r/m al,imm8 eax,imm32
+        inst->op = x86_alu_op[opcode >> 3];
+        uint64_t form = opcode & 0x7;
+        inst->width = (form & 0x1) == 0 ? 1 : size;
+
+        if (form < 4)
+        {
+            if (x86_modrm(code, &pos, rex, inst->width, &rm, &reg, &rip_relative) == 0)
+            {
+                return 0;
+            }
+            od_t *rm_od = form < 2 ? &(inst->dst) : &(inst->src);
+            od_t *reg_od = form < 2 ? &(inst->src) : &(inst->dst);
+            *rm_od = rm;
+            set_reg_od(reg_od, x86_reg(reg, inst->width, rex));
+        }
+        else
+        {
+            uint64_t n = form == 4 ? 1 : imm_size;
+            if (x86_fetch(code, &pos, n, &imm) == 0)
+            {
+                return 0;
+            }
+            set_imm_od(&(inst->src), IMM, x86_imm(imm, n, inst->width));
+            set_reg_od(&(inst->dst), x86_reg(0, inst->width, rex));
+        }
+    }
+    else if (opcode >= 0x50 && opcode < 0x60 && prefix_16 == 0)
+    {
+        // push r64, pop r64
+        inst->op = opcode < 0x58 ? INST_PUSH : INST_POP;
+        set_reg_od(&(inst->src), x86_reg((opcode & 0x7) | ((rex & REX_B) << 3), 8, rex));
+    }
+    else if ((opcode >= 0x70 && opcode < 0x80) || (opcode >= 0x0f80 && opcode < 0x0f90) ||
+        opcode == 0xe8 || opcode == 0xe9 || opcode == 0xeb)
+    {
+        // relative branches: the target is resolved to the absolute address
+        uint64_t n = (opcode < 0x80 || opcode == 0xeb) ? 1 : 4;
+        if (opcode == 0xe8)
+        {
+            inst->op = INST_CALL;
+        }
+        else if (opcode == 0xe9 || opcode == 0xeb)
+        {
+            inst->op = INST_JMP;
+        }
+        else
+        {
+            inst->op = x86_jcc_op[opcode & 0xf];
+        }
+        if (x86_fetch(code, &pos, n, &imm) == 0)
+        {
+            return 0;
+        }
+        set_imm_od(&(inst->src), MEM_IMM, vaddr + pos + x86_imm(imm, n, 8));
+    }
+    else if (opcode == 0x80 || opcode == 0x81 || opcode == 0x83)
+    {
+        // ALU r/m,imm: the operator in the reg field
+        inst->width = opcode == 0x80 ? 1 : size;
+        if (x86_modrm(code, &pos, rex, inst->width, &rm, &reg, &rip_relative) == 0)
+        {
+            return 0;
+        }
+        uint64_t n = opcode == 0x81 ? imm_size : 1;
+        if (x86_fetch(code, &pos, n, &imm) == 0)
+        {
+            return 0;
+        }
+        inst->op = x86_alu_op[reg & 0x7];
+        set_imm_od(&(inst->src), IMM, x86_imm(imm, n, inst->width));
+        inst->dst = rm;
+    }
+    else if (opcode == 0x84 || opcode == 0x85 || (opcode >= 0x88 && opcode <= 0x8b))
+    {
+        // test r/m,r and mov r/m,r / r,r/m
+        inst->op = opcode <= 0x85 ? INST_TEST : INST_MOV;
+        inst->width = (opcode & 0x1) == 0 ? 1 : size;
+        if (x86_modrm(code, &pos, rex, inst->width, &rm, &reg, &rip_relative) == 0)
+        {
+            return 0;
+        }
+        od_t *rm_od = opcode < 0x8a ? &(inst->dst) : &(inst->src);
+        od_t *reg_od = opcode < 0x8a ? &(inst->src) : &(inst->dst);
+        *rm_od = rm;
+        set_reg_od(reg_od, x86_reg(reg, inst->width, rex));
+    }
+    else if (opcode == 0x8d || opcode == 0x0faf || opcode == 0x69 || opcode == 0x6b)
+    {
+        // lea r,m and imul r,r/m / imul r,r/m,imm
+        inst->op = opcode == 0x8d ? INST_LEA : INST_IMUL;
+        inst->width = size;
+        if (x86_modrm(code, &pos, rex, size, &rm, &reg, &rip_relative) == 0)
+        {
+            return 0;
+        }
+        uint64_t dst = x86_reg(reg, size, rex);
+        inst->src = rm;
+        set_reg_od(&(inst->dst), dst);
+
+        if (opcode == 0x8d && rm.type == REG)
+        {
+            return 0;
+        }
+        if (opcode == 0x69 || opcode == 0x6b)
+        {
+            // two operands only: imul $imm,%reg,%reg
+            uint64_t n = opcode == 0x69 ? imm_size : 1;
+            if (rm.type != REG || rm.reg1 != dst || x86_fetch(code, &pos, n, &imm) == 0)
+            {
+                return 0;
+            }
+            set_imm_od(&(inst->src), IMM, x86_imm(imm, n, size));
+        }
+    }
+    else if (opcode == 0x86 || opcode == 0x87 || opcode == 0x0fb0 || opcode == 0x0fb1 ||
+        opcode == 0x0fc0 || opcode == 0x0fc1)
+    {
+        // xchg, cmpxchg and xadd r/m,r
+        inst->op = opcode <= 0x87 ? INST_XCHG : (opcode <= 0x0fb1 ? INST_CMPXCHG : INST_XADD);
+        inst->width = (opcode & 0x1) == 0 ? 1 : size;
+        if (x86_modrm(code, &pos, rex, inst->width, &rm, &reg, &rip_relative) == 0)
+        {
+            return 0;
+        }
+        inst->dst = rm;
+        set_reg_od(&(inst->src), x86_reg(reg, inst->width, rex));
+    }
+    else if (opcode == 0x90 && (rex & REX_B) == 0)
+    {
+        // xchg %eax,%eax
+        inst->op = INST_NOP;
+        inst->width = prefix_16 == 1 ? 2 : 8;
+    }
+    else if (opcode >= 0x90 && opcode < 0x98)
+    {
+        // xchg eax,r
+        inst->op = INST_XCHG;
+        inst->width = size;
+        set_reg_od(&(inst->src), x86_reg(0, size, rex));
+        set_reg_od(&(inst->dst), x86_reg((opcode & 0x7) | ((rex & REX_B) << 3), size, rex));
+    }
+    else if (opcode == 0xa8 || opcode == 0xa9)
+    {
+        // test al,imm8 / eax,imm32
+        inst->op = INST_TEST;
+        inst->width = opcode == 0xa8 ? 1 : size;
+        uint64_t n = opcode == 0xa8 ? 1 : imm_size;
+        if (x86_fetch(code, &pos, n, &imm) == 0)
+        {
+            return 0;
+        }
+        set_imm_od(&(inst->src), IMM, x86_imm(imm, n, inst->width));
+        set_reg_od(&(inst->dst), x86_reg(0, inst->width, rex));
+    }
+    else if (opcode >= 0xb0 && opcode < 0xc0)
+    {
+        // mov r8,imm8 / r,imm32 / r64,imm64
+        inst->op = INST_MOV;
+        inst->width = opcode < 0xb8 ? 1 : size;
+        uint64_t n = inst->width == 8 ? 8 : inst->width;
+        if (x86_fetch(code, &pos, n, &imm) == 0)
+        {
+            return 0;
+        }
+        set_imm_od(&(inst->src), IMM, imm);
+        set_reg_od(&(inst->dst), x86_reg((opcode & 0x7) | ((rex & REX_B) << 3), inst->width, rex));
+    }
+    else if (opcode == 0xc6 || opcode == 0xc7 || opcode == 0xf6 || opcode == 0xf7)
+    {
+        // mov r/m,imm (/0) and test r/m,imm (/0)
+        inst->op = opcode <= 0xc7 ? INST_MOV : INST_TEST;
+        inst->width = (opcode & 0x1) == 0 ? 1 : size;
+        if (x86_modrm(code, &pos, rex, inst->width, &rm, &reg, &rip_relative) == 0 ||
+            (reg & 0x7) != 0)
+        {
+            return 0;
+        }
+        uint64_t n = inst->width == 1 ? 1 : imm_size;
+        if (x86_fetch(code, &pos, n, &imm) == 0)
+        {
+            return 0;
+        }
+        set_imm_od(&(inst->src), IMM, x86_imm(imm, n, inst->width));
+        inst->dst = rm;
+    }
+    else if ((opcode == 0x0f20 || opcode == 0x0f22) && pos < MAX_X86_INST_LEN &&
+        (code[pos] & 0xf8) == 0xd8)
+    {
+        // mov cr3,r64 / mov r64,cr3: ModRM of mod 3 and reg 3
+        inst->op = INST_MOV_CR3;
+        od_t *od = opcode == 0x0f22 ? &(inst->src) : &(inst->dst);
+        set_reg_od(od, x86_reg((code[pos] & 0x7) | ((rex & REX_B) << 3), 8, rex));
+        pos ++;
+    }
+    else if (opcode == 0x0fae && pos < MAX_X86_INST_LEN && code[pos] == 0xf0)
+    {
+        inst->op = INST_MFENCE;
+        pos ++;
+    }
+    else if (opcode == 0x0f1f)
+    {
+        // nopl / nopw r/m
+        inst->op = INST_NOP;
+        inst->width = size;
+        if (x86_modrm(code, &pos, rex, size, &rm, &reg, &rip_relative) == 0)
+        {
+            return 0;
+        }
+        inst->src = rm;
+    }
+    else if (opcode == 0xc3)
+    {
+        inst->op = INST_RET;
+    }
+    else if (opcode == 0xc9)
+    {
+        inst->op = INST_LEAVE;
+    }
+    else if (opcode == 0xf4)
+    {
+        inst->op = INST_HLT;
+    }
+
+    if (inst->op == X86_NO_OP ||
+        (prefix_rep == 1 && inst->op != INST_RET && inst->op != INST_NOP))
+    {
+        return 0;
+    }
+
+    if (lock_allowed(inst) == 0)
+    {
+        return 0;
+    }
+
+    inst->length = pos;
+
+    // the rip-relative operand: relative to the next instruction
+    if (rip_relative == 1)
+    {
+        od_t *od = inst->src.type == MEM_IMM ? &(inst->src) : &(inst->dst);
+        od->imm = vaddr + pos + od->imm;
+    }
+
+    return 1;
+}
+
+/*======================================*/
+/*      instruction handlers            */
+/*======================================*/
+
+// insturction (sub)set
+// In this simulator, the instructions have been decoded and fetched
+// so there will be no page fault during fetching
+// otherwise the instructions must handle the page fault (swap in from disk) first
+// and then re-fetch the instruction and do decoding
+// and finally re-run the instruction
+
+static void mov_handler             (inst_t *inst, core_t *cr);
+static void push_handler            (inst_t *inst, core_t *cr);
+static void pop_handler             (inst_t *inst, core_t *cr);
+static void leave_handler           (inst_t *inst, core_t *cr);
+static void call_handler            (inst_t *inst, core_t *cr);
+static void ret_handler             (inst_t *inst, core_t *cr);
+static void add_handler             (inst_t *inst, core_t *cr);
+static void sub_handler             (inst_t *inst, core_t *cr);
+static void cmp_handler             (inst_t *inst, core_t *cr);
+static void jne_handler             (inst_t *inst, core_t *cr);
+static void jmp_handler             (inst_t *inst, core_t *cr);
+static void hlt_handler             (inst_t *inst, core_t *cr);
+static void lea_handler             (inst_t *inst, core_t *cr);
+static void and_handler             (inst_t *inst, core_t *cr);
+static void or_handler              (inst_t *inst, core_t *cr);
+static void xor_handler             (inst_t *inst, core_t *cr);
+static void test_handler            (inst_t *inst, core_t *cr);
+static void imul_handler            (inst_t *inst, core_t *cr);
+static void je_handler              (inst_t *inst, core_t *cr);
+static void jb_handler              (inst_t *inst, core_t *cr);
+static void jae_handler             (inst_t *inst, core_t *cr);
+static void jbe_handler             (inst_t *inst, core_t *cr);
+static void ja_handler              (inst_t *inst, core_t *cr);
+static void jl_handler              (inst_t *inst, core_t *cr);
+static void jge_handler             (inst_t *inst, core_t *cr);
+static void jle_handler             (inst_t *inst, core_t *cr);
+static void jg_handler              (inst_t *inst, core_t *cr);
+static void nop_handler             (inst_t *inst, core_t *cr);
+static void xchg_handler            (inst_t *inst, core_t *cr);
+static void cmpxchg_handler         (inst_t *inst, core_t *cr);
+static void xadd_handler            (inst_t *inst, core_t *cr);
+static void mfence_handler          (inst_t *inst, core_t *cr);
+static void mov_cr3_handler         (inst_t *inst, core_t *cr);
+
+typedef void (*handler_t)(inst_t *, core_t *);
+
+static handler_t select_handler(const inst_t *inst);
+
+static handler_t handler_table[NUM_INSTRTYPE] = {
+    &mov_handler,               // 0
+    &push_handler,              // 1
+    &pop_handler,               // 2
+    &leave_handler,             // 3
+    &call_handler,              // 4
+    &ret_handler,               // 5
+    &add_handler,               // 6
+    &sub_handler,               // 7
+    &cmp_handler,               // 8
+    &jne_handler,               // 9
+    &jmp_handler,               // 10
+    &hlt_handler,               // 11
+    &lea_handler,               // 12
+    &and_handler,               // 13
+    &or_handler,                // 14
+    &xor_handler,               // 15
+    &test_handler,              // 16
+    &imul_handler,              // 17
+    &je_handler,                // 18
+    &jb_handler,                // 19
+    &jae_handler,               // 20
+    &jbe_handler,               // 21
+    &ja_handler,                // 22
+    &jl_handler,                // 23
+    &jge_handler,               // 24
+    &jle_handler,               // 25
+    &jg_handler,                // 26
+    &nop_handler,               // 27
+    &xchg_handler,              // 28
+    &cmpxchg_handler,           // 29
+    &xadd_handler,              // 30
+    &mfence_handler,            // 31
+    &mov_cr3_handler,           // 32
+};
+
+/*======================================*/
+/*      decoded instruction cache       */
+/*======================================*/
+
+// decoding the instruction costs far more than executing it
+// so the decoded instruction and its handler are cached by physical address
+// the physical addresses are hashed, so the sizes do not follow the memory
+#define NUM_INST_CACHE_ENTRY 1024
+
+// the physical memory is watched for code writes by lines of MAX_INSTRUCTION_CHAR bytes:
+// an assembly slot fills one line, x86-64 instructions start anywhere in it
+#define CODE_LINE_SIZE MAX_INSTRUCTION_CHAR
+
+// the watched lines of a core are kept in sets tagged by the full line number,
+// so the lines far apart never hit each other. once half full, the core drops all its code
+#define NUM_CODE_LINE_BITS 10
+#define NUM_CODE_LINE (1 << NUM_CODE_LINE_BITS)
+#define MAX_CODE_LINE (NUM_CODE_LINE / 2)
+
+typedef struct
+{
+    uint64_t tags[NUM_CODE_LINE];   // line + 1 by open addressing, 0 if empty
+    uint64_t num_line;
+} code_line_set_t;
+
+typedef struct
+{
+    int valid;
+    fetch_mode_t fetch_mode;
+    uint64_t paddr;     // tag: physical address of the instruction
+    uint64_t vaddr;     // tag of x86-64 code: its branch targets are rip-relative
+    uint64_t next_paddr;    // the rest of an x86-64 instruction spanning two pages
+    inst_t inst;
+    handler_t handler;
+} inst_cache_entry_t;
+
+typedef struct INST_CACHE_STRUCT
+{
+    inst_cache_entry_t entries[NUM_INST_CACHE_ENTRY];
+
+    // lines where some cached instruction starts
+    // read by the other cores writing code
+    code_line_set_t decoded;
+
+    // lines overlapped by some instruction of a translated basic block
+    code_line_set_t translated;
+} inst_cache_t;
+
+static void block_cache_flush(core_t *cr);
+
+static int unpack_inst_record(const uint8_t *slot, inst_t *inst);
+
+static inline inst_cache_entry_t *inst_cache_entry(inst_cache_t *cache, uint64_t paddr)
+{
+    // both the slots and the byte addresses spread over all the entries
+    return &(cache->entries[(paddr + paddr / MAX_INSTRUCTION_CHAR) % NUM_INST_CACHE_ENTRY]);
+}
+
+// the first slot probed for the line, also its bit of the cores in machine_t
+static inline uint64_t code_line_slot(uint64_t line)
+{
+    // fibonacci hashing: the consecutive lines of code spread over the set
+    return (line * 0x9e3779b97f4a7c15ULL) >> (64 - NUM_CODE_LINE_BITS);
+}
+
+// the set may be read by the other cores while its core adds lines
+static int code_line_find(code_line_set_t *set, uint64_t line)
+{
+    uint64_t slot = code_line_slot(line);
+    for (uint64_t i = 0; i < NUM_CODE_LINE; ++ i)
+    {
+        uint64_t tag = __atomic_load_n(&(set->tags[(slot + i) % NUM_CODE_LINE]), __ATOMIC_SEQ_CST);
+        if (tag == line + 1)
+        {
+            return 1;
+        }
+        if (tag == 0)
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// return 1 if the line is new to the set
+// the callers reserve the room before, see reserve_code_lines
+static int code_line_add(code_line_set_t *set, uint64_t line)
+{
+    uint64_t slot = code_line_slot(line);
+    for (uint64_t i = 0; i < NUM_CODE_LINE; ++ i)
+    {
+        uint64_t *tag = &(set->tags[(slot + i) % NUM_CODE_LINE]);
+        if (*tag == line + 1)
+        {
+            return 0;
+        }
+        if (*tag == 0)
+        {
+            __atomic_store_n(tag, line + 1, __ATOMIC_SEQ_CST);
+            set->num_line ++;
+            return 1;
+        }
+    }
+    printf("code line set overflow\n");
+    exit(0);
+}
+
+static void code_line_clear(code_line_set_t *set)
+{
+    for (uint64_t i = 0; i < NUM_CODE_LINE; ++ i)
+    {
+        __atomic_store_n(&(set->tags[i]), 0, __ATOMIC_SEQ_CST);
+    }
+    set->num_line = 0;
+}
+
+// watch the code line for writes of this core and the others
+static inline void watch_code_line(uint64_t line, core_t *cr)
+{
+    // before the fetch: the writes after it must reach this core
+    if (code_line_add(&(cr->inst_cache->decoded), line) == 1)
+    {
+        __atomic_fetch_or(&(cr->machine->code_cores[code_line_slot(line)]),
+            1ULL << cr->id, __ATOMIC_SEQ_CST);
+    }
+}
+
+// drop all the decoded code of the core and stop watching its lines
+static void drop_code(core_t *cr)
+{
+    machine_t *m = cr->machine;
+    code_line_set_t *decoded = &(cr->inst_cache->decoded);
+    for (uint64_t i = 0; i < NUM_CODE_LINE; ++ i)
+    {
+        if (decoded->tags[i] != 0)
+        {
+            __atomic_fetch_and(&(m->code_cores[code_line_slot(decoded->tags[i] - 1)]),
+                ~(1ULL << cr->id), __ATOMIC_SEQ_CST);
+        }
+    }
+    code_line_clear(decoded);
+    memset(cr->inst_cache->entries, 0, sizeof(cr->inst_cache->entries));
+    block_cache_flush(cr);
+}
+
+// make room for num more lines in both sets of the core
+// a basic block reserves all its lines at once: none is dropped while it is translated
+static inline void reserve_code_lines(uint64_t num, core_t *cr)
+{
+    if (cr->inst_cache->decoded.num_line + num > MAX_CODE_LINE ||
+        cr->inst_cache->translated.num_line + num > MAX_CODE_LINE)
+    {
+        drop_code(cr);
+    }
+}
+
+// get the decoded instruction at vaddr (paddr), fetch and decode it on miss
+// the handler is NULL if the instruction cannot be decoded
+static inst_cache_entry_t *decode_inst(uint64_t vaddr, uint64_t paddr, core_t *cr)
+{
+    inst_cache_t *cache = cr->inst_cache;
+    inst_cache_entry_t *entry = inst_cache_entry(cache, paddr);
+
+    if (entry->valid == 0 || entry->paddr != paddr || entry->fetch_mode != cr->fetch_mode ||
+        (cr->fetch_mode == FETCH_X86 && entry->vaddr != vaddr))
+    {
+        // the line of the instruction and the one on the next page
+        reserve_code_lines(2, cr);
+        watch_code_line(paddr / CODE_LINE_SIZE, cr);
+
+        int decoded;
+        int spans = 0;
+        if (cr->fetch_mode == FETCH_X86)
+        {
+            // FETCH: the longest instruction, DECODE: the machine code
+            uint8_t code[MAX_X86_INST_LEN];
+            uint64_t first = PAGE_SIZE - vaddr % PAGE_SIZE;
+            if (first >= MAX_X86_INST_LEN)
+            {
+                readcode_dram(paddr, code, MAX_X86_INST_LEN, cr);
+                decoded = decode_x86_inst(code, vaddr, &(entry->inst));
+            }
+            else
+            {
+                // decode the bytes on this page first:
+                // the next page is touched, and may fault, only if the instruction needs it
+                readcode_dram(paddr, code, first, cr);
+                memset(code + first, 0, MAX_X86_INST_LEN - first);
+                decoded = decode_x86_inst(code, vaddr, &(entry->inst));
+
+                if (decoded == 0 || entry->inst.length > first)
+                {
+                    if (translate_va(vaddr + first, PF_FETCH, cr, &(entry->next_paddr)) == 0)
+                    {
+                        entry->valid = 0;
+                        raise_page_fault(cr);
+                    }
+                    watch_code_line(entry->next_paddr / CODE_LINE_SIZE, cr);
+                    readcode_dram(entry->next_paddr, code + first, MAX_X86_INST_LEN - first, cr);
+                    decoded = decode_x86_inst(code, vaddr, &(entry->inst));
+                    spans = 1;
+                }
+            }
+        }
+        else
+        {
+            // FETCH: get the instruction slot by program counter
+            char inst_str[MAX_INSTRUCTION_CHAR + 10];
+            readinst_dram(paddr, inst_str, cr);
+
+            // DECODE: unpack the pre-decoded record, or parse the assembly string
+            decoded = (uint8_t)inst_str[0] == INST_RECORD_MAGIC ?
+                unpack_inst_record((const uint8_t *)inst_str, &(entry->inst)) :
+                parse_instruction(inst_str, &(entry->inst));
+        }
+
+        if (decoded == 1)
+        {
+            entry->handler = select_handler(&(entry->inst));
+        }
+        else
+        {
+            // invalidated by the writes to any byte it may span
+            entry->inst.length = MAX_INSTRUCTION_CHAR;
+            entry->handler = NULL;
+        }
+        entry->fetch_mode = cr->fetch_mode;
+        entry->paddr = paddr;
+        entry->vaddr = vaddr;
+        // the writes are matched to the entries by contiguous physical ranges:
+        // the instructions read from two pages are used once and decoded again next time
+        entry->valid = spans == 1 ? 0 : 1;
+    }
+
+    return entry;
+}
+
+// drop the decoded instructions overlapping physical memory [paddr, paddr + len)
+// called by the dram writers so that the cache never holds stale code
+// the other cores having decoded the lines drop all their code before their next block
+void inst_cache_invalidate(uint64_t paddr, uint64_t len, core_t *cr)
+{
+    inst_cache_t *cache = cr->inst_cache;
+    machine_t *m = cr->machine;
+
+    // an instruction starting up to MAX_INSTRUCTION_CHAR - 1 bytes
+    // before paddr still overlaps the written range
+    uint64_t first = paddr < MAX_INSTRUCTION_CHAR ? 0 :
+        (paddr - (MAX_INSTRUCTION_CHAR - 1)) / CODE_LINE_SIZE;
+    uint64_t last = (paddr + len - 1) / CODE_LINE_SIZE;
+
+    for (uint64_t i = first; i <= last; ++ i)
+    {
+        // the bits of the cores may be shared by other lines: the sets tell
+        uint64_t cores = __atomic_load_n(&(m->code_cores[code_line_slot(i)]), __ATOMIC_SEQ_CST);
+
+        if ((cores & (1ULL << cr->id)) != 0 && code_line_find(&(cache->decoded), i) == 1)
+        {
+            // any byte of the line may start an instruction
+            for (uint64_t start = i * CODE_LINE_SIZE; start < (i + 1) * CODE_LINE_SIZE; ++ start)
+            {
+                inst_cache_entry_t *entry = inst_cache_entry(cache, start);
+
+                if (entry->valid == 1 && entry->paddr == start &&
+                    start < paddr + len && paddr < start + entry->inst.length)
+                {
+                    entry->valid = 0;
+                }
+            }
+        }
+
+        // self-modifying code: blocks are rare to be written
+        // so simply drop all of them
+        if (i >= paddr / CODE_LINE_SIZE && cache->translated.num_line > 0 &&
+            code_line_find(&(cache->translated), i) == 1)
+        {
+            block_cache_flush(cr);
+        }
+
+        uint64_t others = cores & ~(1ULL << cr->id);
+        while (others != 0)
+        {
+            int id = __builtin_ctzll(others);
+            if (code_line_find(&(m->cores[id].inst_cache->decoded), i) == 1)
+            {
+                __atomic_store_n(&(m->cores[id].flush_pending), 1, __ATOMIC_RELEASE);
+            }
+            others &= others - 1;
+        }
+    }
+}
+
+// drop all the decoded code of the core if the other cores have written it
+// return 1 if it is dropped
+static inline int sync_code(core_t *cr)
+{
+    if (__atomic_load_n(&(cr->flush_pending), __ATOMIC_ACQUIRE) == 0)
+    {
+        return 0;
+    }
+    __atomic_store_n(&(cr->flush_pending), 0, __ATOMIC_RELAXED);
+
+    drop_code(cr);
+    return 1;
+}
+
+/*======================================*/
+/*      basic block translation         */
+/*======================================*/
+
+// a basic block is the straight-line run of instructions
+// ending at the first control transfer (jmp, jne, callq, retq) or hlt
+// its instructions are translated to records with pre-bound handlers
+// and executed in one tight loop without fetch or decode
+#define MAX_BLOCK_INST 16
+#define NUM_BLOCK_CACHE_ENTRY 256
+#define NUM_BLOCK_EXIT 2
+
+// the operators of the records: op_t and the fused super-instructions
+typedef enum
+{
+    FUSED_CMP_JNE = NUM_INSTRTYPE,  // cmpq $imm,mem; jne
+    FUSED_PROLOGUE,                 // push %rbp; mov %rsp,%rbp
+    FUSED_POP_RET,                  // pop %rbp; retq
+    FUSED_LEAVE_RET,                // leaveq; retq
+    RECORD_EXIT,                    // terminates the records
+} record_op_t;
+
+// a record executes one instruction, or two fused into a super-instruction
+typedef struct
+{
+    handler_t handler;
+#if ENABLE_THREADED_DISPATCH == 1
+    const void *label;  // where the threaded code executes this record
+#endif
+    inst_t *inst;       // the first instruction in block insts
+    uint64_t num_inst;  // 2 if fused
+} block_record_t;
+
+typedef struct BLOCK_STRUCT
+{
+    int valid;
+    uint64_t vaddr;     // rip of the first instruction
+    uint64_t paddr;     // tag
+    fetch_mode_t fetch_mode;
+    uint64_t num_inst;
+    inst_t insts[MAX_BLOCK_INST];
+
+    uint64_t num_record;
+    // one more record to terminate the threaded code
+    block_record_t records[MAX_BLOCK_INST + 1];
+
+    // chaining: the successor blocks found at the exits
+    // e.g. the taken and the fall-through rip of jne
+    uint64_t exit_rip[NUM_BLOCK_EXIT];
+    struct BLOCK_STRUCT *exit_block[NUM_BLOCK_EXIT];
+
+#if ENABLE_JIT == 1
+    // host code compiled once the block is hot, NULL before that
+    uint64_t exec_count;
+    void (*jit_code)(core_t *);
+#endif
+} block_t;
+
+typedef struct BLOCK_CACHE_STRUCT
+{
+    block_t blocks[NUM_BLOCK_CACHE_ENTRY];
+} block_cache_t;
+
+#if ENABLE_JIT == 1
+static void jit_compile(block_t *block, core_t *cr);
+static void jit_flush(core_t *cr);
+#endif
+
+static handler_t fuse_handler(inst_t *first, inst_t *second, record_op_t *op);
+
+static void block_cache_flush(core_t *cr)
+{
+    for (int i = 0; i < NUM_BLOCK_CACHE_ENTRY; ++ i)
+    {
+        cr->block_cache->blocks[i].valid = 0;
+    }
+    code_line_clear(&(cr->inst_cache->translated));
+#if ENABLE_JIT == 1
+    jit_flush(cr);
+#endif
+}
+
+#if ENABLE_THREADED_DISPATCH == 1
+// direct threaded code: each record holds the address of the label executing
+// its operator, and each label dispatches the next record by itself
+// so every operator owns an indirect branch predicted separately
+static const void **threaded_labels = NULL;     // indexed by record_op_t
+
+// run the records until the terminating one
+// called with rec NULL to export the label addresses for translation
+static void run_threaded(block_record_t *rec, core_t *cr)
+{
+    static const void *labels[RECORD_EXIT + 1] = {
+        [INST_MOV]          = &&do_mov,
+        [INST_PUSH]         = &&do_push,
+        [INST_POP]          = &&do_pop,
+        [INST_LEAVE]        = &&do_leave,
+        [INST_CALL]         = &&do_call,
+        [INST_RET]          = &&do_ret,
+        [INST_ADD]          = &&do_add,
+        [INST_SUB]          = &&do_sub,
+        [INST_CMP]          = &&do_cmp,
+        [INST_JNE]          = &&do_jne,
+        [INST_JMP]          = &&do_jmp,
+        [INST_HLT]          = &&do_hlt,
+        [INST_LEA]          = &&do_lea,
+        [INST_AND]          = &&do_and,
+        [INST_OR]           = &&do_or,
+        [INST_XOR]          = &&do_xor,
+        [INST_TEST]         = &&do_test,
+        [INST_IMUL]         = &&do_imul,
+        [INST_JE]           = &&do_je,
+        [INST_JB]           = &&do_jb,
+        [INST_JAE]          = &&do_jae,
+        [INST_JBE]          = &&do_jbe,
+        [INST_JA]           = &&do_ja,
+        [INST_JL]           = &&do_jl,
+        [INST_JGE]          = &&do_jge,
+        [INST_JLE]          = &&do_jle,
+        [INST_JG]           = &&do_jg,
+        [INST_NOP]          = &&do_nop,
+        [INST_XCHG]         = &&do_xchg,
+        [INST_CMPXCHG]      = &&do_cmpxchg,
+        [INST_XADD]         = &&do_xadd,
+        [INST_MFENCE]       = &&do_mfence,
+        [INST_MOV_CR3]      = &&do_mov_cr3,
+        [FUSED_CMP_JNE]     = &&do_cmp_jne,
+        [FUSED_PROLOGUE]    = &&do_prologue,
+        [FUSED_POP_RET]     = &&do_pop_ret,
+        [FUSED_LEAVE_RET]   = &&do_leave_ret,
+        [RECORD_EXIT]       = &&do_exit,
+    };
+
+    if (rec == NULL)
+    {
+        threaded_labels = labels;
+        return;
+    }
+
+    // the handler bound is specialized to the operand types
+    // so each label calls the variants of its own operator only
+#define THREADED_CASE(name)                                 \
+    do_##name:                                              \
+        rec->handler(rec->inst, cr);                        \
+        rec ++;                                             \
+        goto *(rec->label);
+
+    goto *(rec->label);
+
+    THREADED_CASE(mov)
+    THREADED_CASE(push)
+    THREADED_CASE(pop)
+    THREADED_CASE(leave)
+    THREADED_CASE(call)
+    THREADED_CASE(ret)
+    THREADED_CASE(add)
+    THREADED_CASE(sub)
+    THREADED_CASE(cmp)
+    THREADED_CASE(jne)
+    THREADED_CASE(jmp)
+    THREADED_CASE(hlt)
+    THREADED_CASE(lea)
+    THREADED_CASE(and)
+    THREADED_CASE(or)
+    THREADED_CASE(xor)
+    THREADED_CASE(test)
+    THREADED_CASE(imul)
+    THREADED_CASE(je)
+    THREADED_CASE(jb)
+    THREADED_CASE(jae)
+    THREADED_CASE(jbe)
+    THREADED_CASE(ja)
+    THREADED_CASE(jl)
+    THREADED_CASE(jge)
+    THREADED_CASE(jle)
+    THREADED_CASE(jg)
+    THREADED_CASE(nop)
+    THREADED_CASE(xchg)
+    THREADED_CASE(cmpxchg)
+    THREADED_CASE(xadd)
+    THREADED_CASE(mfence)
+    THREADED_CASE(mov_cr3)
+    THREADED_CASE(cmp_jne)
+    THREADED_CASE(prologue)
+    THREADED_CASE(pop_ret)
+    THREADED_CASE(leave_ret)
+
+#undef THREADED_CASE
+
+do_exit:
+    return;
+}
+#endif
+
+static inline int is_block_end(op_t op)
+{
+    // the translation of the instructions after mov to cr3 may change
+    return op == INST_JMP || op == INST_CALL || op == INST_RET || op == INST_HLT ||
+        op == INST_JNE || (op >= INST_JE && op <= INST_JG) || op == INST_MOV_CR3;
+}
+
+static void add_record(block_t *block, handler_t handler, record_op_t op,
+    inst_t *inst, uint64_t num_inst)
+{
+    block_record_t *rec = &(block->records[block->num_record]);
+    rec->handler = handler;
+#if ENABLE_THREADED_DISPATCH == 1
+    rec->label = threaded_labels[op];
+#endif
+    rec->inst = inst;
+    rec->num_inst = num_inst;
+    block->num_record ++;
+}
+
+static void translate_block(block_t *block, uint64_t vaddr, uint64_t paddr, core_t *cr)
+{
+    // valid once complete: the fetch may fault
+    block->valid = 0;
+    block->vaddr = vaddr;
+    block->paddr = paddr;
+    block->fetch_mode = cr->fetch_mode;
+    block->num_inst = 0;
+    block->num_record = 0;
+#if ENABLE_JIT == 1
+    block->exec_count = 0;
+    block->jit_code = NULL;
+#endif
+
+    for (int i = 0; i < NUM_BLOCK_EXIT; ++ i)
+    {
+        block->exit_rip[i] = 0;
+        block->exit_block[i] = NULL;
+    }
+
+    // an instruction overlaps two lines at most, on one page or two
+    reserve_code_lines(2 * MAX_BLOCK_INST, cr);
+
+    handler_t handlers[MAX_BLOCK_INST];
+    while (block->num_inst < MAX_BLOCK_INST)
+    {
+        inst_cache_entry_t *entry = decode_inst(vaddr, paddr, cr);
+        if (entry->handler == NULL)
+        {
+            // stop before the undecodable instruction
+            break;
+        }
+
+        handlers[block->num_inst] = entry->handler;
+        block->insts[block->num_inst] = entry->inst;
+        block->num_inst ++;
+        uint64_t first = PAGE_SIZE - vaddr % PAGE_SIZE;
+        uint64_t length = entry->inst.length < first ? entry->inst.length : first;
+        for (uint64_t line = paddr / CODE_LINE_SIZE;
+            line <= (paddr + length - 1) / CODE_LINE_SIZE; ++ line)
+        {
+            code_line_add(&(cr->inst_cache->translated), line);
+        }
+        if (cr->fetch_mode == FETCH_X86 && entry->inst.length > first)
+        {
+            // the rest on the next page is a few bytes at the start of one line
+            code_line_add(&(cr->inst_cache->translated), entry->next_paddr / CODE_LINE_SIZE);
+        }
+
+        if (is_block_end(entry->inst.op))
+        {
+            break;
+        }
+
+        // the next page may be mapped anywhere, or not at all:
+        // the blocks end at the page, the instructions spanning two pages start a block
+        uint64_t next = vaddr + entry->inst.length;
+        if (next / PAGE_SIZE != block->vaddr / PAGE_SIZE ||
+            (cr->fetch_mode == FETCH_X86 && PAGE_SIZE - next % PAGE_SIZE < MAX_X86_INST_LEN))
+        {
+            break;
+        }
+        paddr = paddr + (next - vaddr);
+        vaddr = next;
+    }
+
+    // peephole pass: fuse the idioms of compiled code into super-instructions
+    uint64_t i = 0;
+    while (i < block->num_inst)
+    {
+        record_op_t op;
+        handler_t fused = NULL;
+
+        if (i + 1 < block->num_inst)
+        {
+            fused = fuse_handler(&(block->insts[i]), &(block->insts[i + 1]), &op);
+        }
+
+        if (fused != NULL)
+        {
+            add_record(block, fused, op, &(block->insts[i]), 2);
+            i += 2;
+        }
+        else
+        {
+            add_record(block, handlers[i], (record_op_t)block->insts[i].op, &(block->insts[i]), 1);
+            i += 1;
+        }
+    }
+
+#if ENABLE_THREADED_DISPATCH == 1
+    block->records[block->num_record].label = threaded_labels[RECORD_EXIT];
+#endif
+    block->valid = 1;
+}
+
+// find the block starting at the current rip, translate it on miss
+static block_t *lookup_block(core_t *cr)
+{
+    uint64_t paddr = va2pa_fetch(cr->rip, cr);
+    block_t *block = &(cr->block_cache->blocks[
+        (paddr + paddr / MAX_INSTRUCTION_CHAR) % NUM_BLOCK_CACHE_ENTRY]);
+
+    if (block->valid == 0 || block->paddr != paddr || block->vaddr != cr->rip ||
+        block->fetch_mode != cr->fetch_mode)
+    {
+        translate_block(block, cr->rip, paddr, cr);
+    }
+
+    return block;
+}
+
+// follow the chained exit of the block just executed
+static block_t *next_block(block_t *block, core_t *cr)
+{
+    for (int i = 0; i < NUM_BLOCK_EXIT; ++ i)
+    {
+        block_t *next = block->exit_block[i];
+        if (block->exit_rip[i] == cr->rip && next != NULL &&
+            next->valid == 1 && next->vaddr == cr->rip)
+        {
+            return next;
+        }
+    }
+
+    block_t *next = lookup_block(cr);
+
+    // link the exit: fill the empty slot first, otherwise replace the last one
+    int slot = NUM_BLOCK_EXIT - 1;
+    for (int i = 0; i < NUM_BLOCK_EXIT; ++ i)
+    {
+        if (block->exit_block[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+    }
+    block->exit_rip[slot] = cr->rip;
+    block->exit_block[slot] = next;
+
+    return next;
+}
+
+// run all the records of the block
+static inline void run_block(block_t *block, core_t *cr)
+{
+#if ENABLE_JIT == 1
+    if (block->jit_code != NULL)
+    {
+        block->jit_code(cr);
+        return;
+    }
+
+    block->exec_count ++;
+    if (block->exec_count == JIT_HOT_THRESHOLD)
+    {
+        jit_compile(block, cr);
+    }
+#endif
+
+#if ENABLE_THREADED_DISPATCH == 1
+    run_threaded(block->records, cr);
+#else
+    block_record_t *rec = block->records;
+    for (uint64_t i = 0; i < block->num_record; ++ i)
+    {
+        rec[i].handler(rec[i].inst, cr);
+    }
+#endif
+}
+
+// run the first num_inst instructions of the block
+static void run_block_prefix(block_t *block, uint64_t num_inst, core_t *cr)
+{
+    block_record_t *rec = block->records;
+    while (num_inst > 0)
+    {
+        if (rec->num_inst <= num_inst)
+        {
+            rec->handler(rec->inst, cr);
+            num_inst -= rec->num_inst;
+        }
+        else
+        {
+            // only the first instruction of the fused record
+            select_handler(rec->inst)(rec->inst, cr);
+            num_inst -= 1;
+        }
+        rec ++;
+    }
+}
+
+/*======================================*/
+/*      breakpoints                     */
+/*======================================*/
+
+// add a breakpoint of the core, return 0 if there is no room
+int set_breakpoint(core_t *cr, uint64_t vaddr)
+{
+    if (cr->num_breakpoints >= MAX_NUM_BREAKPOINT)
+    {
+        return 0;
+    }
+    cr->breakpoints[cr->num_breakpoints] = vaddr;
+    cr->num_breakpoints ++;
+    return 1;
+}
+
+void clear_breakpoint(core_t *cr, uint64_t vaddr)
+{
+    for (uint64_t i = 0; i < cr->num_breakpoints; ++ i)
+    {
+        if (cr->breakpoints[i] == vaddr)
+        {
+            cr->num_breakpoints --;
+            cr->breakpoints[i] = cr->breakpoints[cr->num_breakpoints];
+            return;
+        }
+    }
+}
+
+/*======================================*/
+/*      page faults                     */
+/*======================================*/
+
+// a run catches the page faults of its instructions here
+// the faulting instruction has changed nothing the restart depends on
+typedef struct
+{
+    jmp_buf env;
+    uint64_t num_inst;  // instructions of the run before the block
+    block_t *block;     // the block running, NULL out of the blocks
+    run_exit_t reason;
+} fault_frame_t;
+
+void raise_page_fault(core_t *cr)
+{
+    fault_frame_t *frame = (fault_frame_t *)cr->fault_frame;
+    if (frame == NULL)
+    {
+        printf("page fault at 0x%lx (error code 0x%lx) out of a run\n",
+            cr->fault_vaddr, cr->fault_code);
+        exit(0);
+    }
+    frame->reason = RUN_EXIT_PAGE_FAULT;
+    longjmp(frame->env, 1);
+}
+
+void raise_run_exit(core_t *cr, run_exit_t reason)
+{
+    fault_frame_t *frame = (fault_frame_t *)cr->fault_frame;
+    if (frame == NULL)
+    {
+        // the access is the host's: a bug of the simulator, not of the guest
+        printf("run exit %d at paddr 0x%lx out of a run\n", reason, cr->fault_paddr);
+        exit(1);
+    }
+    frame->reason = reason;
+    longjmp(frame->env, 1);
+}
+
+// the instructions of the block run before the one at rip
+static uint64_t num_inst_before(block_t *block, uint64_t rip)
+{
+    if (block == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t vaddr = block->vaddr;
+    for (uint64_t i = 0; i < block->num_inst; ++ i)
+    {
+        if (vaddr == rip)
+        {
+            return i;
+        }
+        vaddr = vaddr + block->insts[i].length;
+    }
+    return 0;
+}
+
+/*======================================*/
+/*      batch execution                 */
+/*======================================*/
+
+static run_result_t run_blocks(core_t *cr, uint64_t max_num_inst, uint64_t stop_rip,
+    uint64_t stop_mask, fault_frame_t *frame);
+
+// run the core by translated blocks until a stop condition holds
+// the conditions are checked before each instruction but the first one
+// so a run stopped at a breakpoint can be resumed by calling it again
+run_result_t run_until(core_t *cr, uint64_t max_num_inst, uint64_t stop_rip, uint64_t stop_mask)
+{
+    // the stores buffered by the previous run have waited for a whole run:
+    // write them, so the cores spinning on them make progress
+    uint64_t issued = cr->store_buffer.tail;
+
+    // the host may have changed the address space between the runs
+    soft_tlb_sync(cr);
+
+    fault_frame_t frame;
+    frame.num_inst = 0;
+    frame.block = NULL;
+    cr->fault_frame = &frame;
+
+    run_result_t result;
+    if (setjmp(frame.env) == 0)
+    {
+        result = run_blocks(cr, max_num_inst, stop_rip, stop_mask, &frame);
+    }
+    else
+    {
+        result.reason = frame.reason;
+        result.num_inst = frame.num_inst + num_inst_before(frame.block, cr->rip);
+    }
+
+    cr->fault_frame = NULL;
+    drain_store_buffer(cr, issued);
+    return result;
+}
+
+static run_result_t run_blocks(core_t *cr, uint64_t max_num_inst, uint64_t stop_rip,
+    uint64_t stop_mask, fault_frame_t *frame)
+{
+    run_result_t result = { RUN_EXIT_BUDGET, 0 };
+
+    // the stop addresses: stop_rip first, then the breakpoints
+    uint64_t stops[MAX_NUM_BREAKPOINT + 1];
+    uint64_t num_stops = 0;
+    if ((stop_mask & RUN_STOP_RIP) != 0)
+    {
+        stops[num_stops] = stop_rip;
+        num_stops ++;
+    }
+    if ((stop_mask & RUN_STOP_BREAKPOINT) != 0)
+    {
+        for (uint64_t i = 0; i < cr->num_breakpoints; ++ i)
+        {
+            stops[num_stops] = cr->breakpoints[i];
+            num_stops ++;
+        }
+    }
+
+    block_t *block = NULL;
+    while (result.num_inst < max_num_inst)
+    {
+        if (cr->halt == 1)
+        {
+            result.reason = RUN_EXIT_HALT;
+            return result;
+        }
+
+        if (sync_code(cr) == 1)
+        {
+            block = NULL;
+        }
+
+        if (result.num_inst > 0)
+        {
+            for (uint64_t i = 0; i < num_stops; ++ i)
+            {
+                if (stops[i] == cr->rip)
+                {
+                    result.reason = (i == 0 && (stop_mask & RUN_STOP_RIP) != 0) ?
+                        RUN_EXIT_RIP : RUN_EXIT_BREAKPOINT;
+                    return result;
+                }
+            }
+        }
+
+        if (block == NULL)
+        {
+            block = lookup_block(cr);
+        }
+
+        if (block->num_inst == 0)
+        {
+            result.reason = RUN_EXIT_INVALID;
+            return result;
+        }
+
+        // the instructions to run: cut the block at the budget or a stop address
+        uint64_t n = block->num_inst;
+        if (n > max_num_inst - result.num_inst)
+        {
+            n = max_num_inst - result.num_inst;
+        }
+        uint64_t vaddr = block->vaddr;
+        for (uint64_t i = 1; i < n; ++ i)
+        {
+            vaddr = vaddr + block->insts[i - 1].length;
+            for (uint64_t j = 0; j < num_stops; ++ j)
+            {
+                if (stops[j] == vaddr)
+                {
+                    n = i;
+                    break;
+                }
+            }
+        }
+
+        frame->num_inst = result.num_inst;
+        frame->block = block;
+        if (n == block->num_inst)
+        {
+            run_block(block, cr);
+            frame->block = NULL;
+            result.num_inst += n;
+            // the next block may fault in its fetch
+            frame->num_inst = result.num_inst;
+            if (result.num_inst < max_num_inst)
+            {
+                block = next_block(block, cr);
+            }
+        }
+        else
+        {
+            // the prefix of a block is still straight-line code
+            run_block_prefix(block, n, cr);
+            frame->block = NULL;
+            result.num_inst += n;
+            frame->num_inst = result.num_inst;
+            block = NULL;
+        }
+    }
+
+    return result;
+}
+
+// run the cores one after another in one host thread, each for quantum
+// instructions per turn, until all of them halt or max_num_inst in total
+// the interleaving only depends on the quantum, so the runs are reproducible
+// a turn is a call of run_until: switching the cores allocates nothing
+schedule_result_t run_round_robin(core_t *cores, uint64_t num_cores, uint64_t quantum,
+    uint64_t max_num_inst)
+{
+    schedule_result_t result = { RUN_EXIT_BUDGET, 0, 0 };
+    quantum = quantum == 0 ? 1 : quantum;
+
+    while (1)
+    {
+        uint64_t num_running = 0;
+        for (uint64_t i = 0; i < num_cores; ++ i)
+        {
+            core_t *cr = &(cores[i]);
+            if (cr->halt == 1)
+            {
+                continue;
+            }
+
+            if (result.num_inst >= max_num_inst)
+            {
+                result.reason = RUN_EXIT_BUDGET;
+                return result;
+            }
+
+            uint64_t n = quantum;
+            if (n > max_num_inst - result.num_inst)
+            {
+                n = max_num_inst - result.num_inst;
+            }
+
+            run_result_t turn = run_until(cr, n, 0, 0);
+            result.num_inst += turn.num_inst;
+
+            if (turn.reason == RUN_EXIT_INVALID || turn.reason == RUN_EXIT_PAGE_FAULT ||
+                turn.reason == RUN_EXIT_BUS_ERROR || turn.reason == RUN_EXIT_SPLIT_LOCK)
+            {
+                result.reason = turn.reason;
+                result.core = i;
+                return result;
+            }
+
+            if (cr->halt == 0)
+            {
+                num_running ++;
+            }
+        }
+
+        if (num_running == 0)
+        {
+            result.reason = RUN_EXIT_HALT;
+            return result;
+        }
+    }
+}
+
+// reset the condition flags
+// inline to reduce cost
+static inline void reset_cflags(core_t *cr)
+{
+   cr->flags._cpu_flag_value = 0;
+#if ENABLE_LAZY_CFLAGS == 1
+   cr->lazy_cflags.op = CFLAGS_OP_NONE;
+#endif
+}
+
+// the condition flags of val = dst op src
+static inline void compute_cflags(cflags_op_t op, uint64_t src, uint64_t dst, uint64_t val,
+    cpu_flag_t *flags)
+{
+    int val_sign = (val >> 63) & 0x1;
+    int src_sign = (src >> 63) & 0x1;
+    int dst_sign = (dst >> 63) & 0x1;
+
+    flags->ZF = (val == 0);
+    flags->SF = val_sign;
+
+    if (op == CFLAGS_OP_ADD)
+    {
+        // signed and unsigned value follow the same addition
+        flags->CF = (val < src);
+        flags->OF = (src_sign == 0 && dst_sign == 0 && val_sign == 1) ||
+            (src_sign == 1 && dst_sign == 1 && val_sign == 0);
+    }
+    else if (op == CFLAGS_OP_LOGIC)
+    {
+        flags->CF = 0;
+        flags->OF = 0;
+    }
+    else if (op == CFLAGS_OP_MUL)
+    {
+        // set if the signed product is truncated
+        int64_t product;
+        flags->CF = __builtin_mul_overflow((int64_t)dst, (int64_t)src, &product);
+        flags->OF = flags->CF;
+    }
+    else
+    {
+        // unsigned: borrow if the result is larger than the minuend
+        flags->CF = (val > dst);
+        flags->OF = (src_sign == 1 && dst_sign == 0 && val_sign == 1) ||
+            (src_sign == 0 && dst_sign == 1 && val_sign == 0);
+    }
+}
+
+// set the condition flags by the flag-setting operation
+// most of them are overwritten before any instruction reads them
+// so in lazy mode only the operation and its operands are recorded
+static inline void set_cflags(cflags_op_t op, uint64_t src, uint64_t dst, uint64_t val,
+    core_t *cr)
+{
+#if ENABLE_LAZY_CFLAGS == 1
+    cr->lazy_cflags.op = op;
+    cr->lazy_cflags.src = src;
+    cr->lazy_cflags.dst = dst;
+    cr->lazy_cflags.val = val;
+#else
+    compute_cflags(op, src, dst, val, &(cr->flags));
+#endif
+}
+
+// the flags of an operation of width bytes are those of the 8-byte one
+// on the operands moved to the top bytes: the carries and signs come out of bit 63
+static inline void set_cflags_width(cflags_op_t op, uint64_t src, uint64_t dst, uint64_t val,
+    uint64_t width, core_t *cr)
+{
+    uint64_t shift = 64 - 8 * width;
+    if (op == CFLAGS_OP_MUL)
+    {
+        // the signed product overflows 8 bytes exactly when that of width bytes does
+        dst = (uint64_t)((int64_t)(dst << shift) >> shift);
+    }
+    else
+    {
+        dst = dst << shift;
+    }
+    set_cflags(op, src << shift, dst, val << shift, cr);
+}
+
+// the zero flag without materializing the others
+static inline uint16_t read_ZF(core_t *cr)
+{
+#if ENABLE_LAZY_CFLAGS == 1
+    if (cr->lazy_cflags.op != CFLAGS_OP_NONE)
+    {
+        return cr->lazy_cflags.val == 0;
+    }
+#endif
+    return cr->flags.ZF;
+}
+
+// materialize the pending lazy condition flags into cr->flags
+void sync_cflags(core_t *cr)
+{
+#if ENABLE_LAZY_CFLAGS == 1
+    lazy_cflags_t *lazy = &(cr->lazy_cflags);
+    if (lazy->op != CFLAGS_OP_NONE)
+    {
+        compute_cflags(lazy->op, lazy->src, lazy->dst, lazy->val, &(cr->flags));
+        lazy->op = CFLAGS_OP_NONE;
+    }
+#endif
+}
+
+// the loads and stores of 8 bytes: an aligned one stays within its page
+// and hits the soft MMU by one masked compare of vaddr
+static inline soft_tlb_entry_t *soft_tlb_entry(uint64_t vaddr, core_t *cr)
+{
+    return &(cr->soft_tlb->entries[(vaddr / PAGE_SIZE) % NUM_SOFT_TLB_ENTRY]);
+}
+
+static inline int crosses_page(uint64_t vaddr, uint64_t width)
+{
+    return (vaddr & (PAGE_SIZE - 1)) + width > PAGE_SIZE;
+}
+
+// the slow path of the loads and stores: fills the soft MMU entry of the page
+static inline uint64_t translate_data(uint64_t vaddr, uint64_t access, core_t *cr)
+{
+#if ENABLE_SOFT_MMU == 1
+    return soft_tlb_fill(vaddr, access, cr);
+#else
+    return (access & PF_WRITE) != 0 ? va2pa_write(vaddr, cr) : va2pa(vaddr, cr);
+#endif
+}
+
+// the accesses crossing a page boundary: the bytes of each page go to its own frame
+// both pages are translated first, so a fault on the second one leaves the
+// access undone and the instruction restarts cleanly
+static uint64_t load_split(uint64_t vaddr, uint64_t width, core_t *cr)
+{
+    uint64_t first = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+    uint64_t lo = translate_data(vaddr, 0, cr);
+    uint64_t hi = translate_data(vaddr + first, 0, cr);
+
+    uint64_t val = 0;
+    for (uint64_t k = 0; k < width; ++ k)
+    {
+        uint64_t paddr = k < first ? lo + k : hi + k - first;
+        val |= (uint64_t)read8bits_dram(paddr, cr) << (8 * k);
+    }
+    return val;
+}
+
+static void store_split(uint64_t vaddr, uint64_t val, uint64_t width, core_t *cr)
+{
+    uint64_t first = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+    uint64_t lo = translate_data(vaddr, PF_WRITE, cr);
+    uint64_t hi = translate_data(vaddr + first, PF_WRITE, cr);
+
+    for (uint64_t k = 0; k < width; ++ k)
+    {
+        uint64_t paddr = k < first ? lo + k : hi + k - first;
+        write8bits_dram(paddr, (uint8_t)(val >> (8 * k)), cr);
+    }
+}
+
+static inline uint64_t load64(uint64_t vaddr, core_t *cr)
+{
+#if ENABLE_SOFT_MMU == 1
+    soft_tlb_entry_t *e = soft_tlb_entry(vaddr, cr);
+    if ((vaddr & ~(PAGE_SIZE - 8)) == e->read_tag)
+    {
+        // the buffered stores are forwarded by their physical addresses
+        if (cr->store_buffer.head == cr->store_buffer.tail)
+        {
+            return load_pm((const uint8_t *)(uintptr_t)(vaddr + e->host_offset), 8);
+        }
+        return read64bits_dram(vaddr + e->pa_offset, cr);
+    }
+#endif
+    if (crosses_page(vaddr, 8))
+    {
+        return load_split(vaddr, 8, cr);
+    }
+    return read64bits_dram(translate_data(vaddr, 0, cr), cr);
+}
+
+// the physical address of a store of width bytes within its page
+// the locked ones use it alone: they are naturally aligned
+static inline uint64_t store_paddr(uint64_t vaddr, uint64_t width, core_t *cr)
+{
+#if ENABLE_SOFT_MMU == 1
+    soft_tlb_entry_t *e = soft_tlb_entry(vaddr, cr);
+    if ((vaddr & ~(PAGE_SIZE - width)) == e->write_tag)
+    {
+        return vaddr + e->pa_offset;
+    }
+#endif
+    return translate_data(vaddr, PF_WRITE, cr);
+}
+
+// the loads and stores of 1, 2 and 4 bytes: zero-extended to 8
+static inline uint64_t read_dram(uint64_t paddr, uint64_t width, core_t *cr)
+{
+    switch (width)
+    {
+        case 1:
+            return read8bits_dram(paddr, cr);
+        case 2:
+            return read16bits_dram(paddr, cr);
+        case 4:
+            return read32bits_dram(paddr, cr);
+        default:
+            return read64bits_dram(paddr, cr);
+    }
+}
+
+static inline void write_dram(uint64_t paddr, uint64_t val, uint64_t width, core_t *cr)
+{
+    switch (width)
+    {
+        case 1:
+            write8bits_dram(paddr, (uint8_t)val, cr);
+            break;
+        case 2:
+            write16bits_dram(paddr, (uint16_t)val, cr);
+            break;
+        case 4:
+            write32bits_dram(paddr, (uint32_t)val, cr);
+            break;
+        default:
+            write64bits_dram(paddr, val, cr);
+            break;
+    }
+}
+
+static inline uint64_t load(uint64_t vaddr, uint64_t width, core_t *cr)
+{
+    if (width == 8)
+    {
+        return load64(vaddr, cr);
+    }
+#if ENABLE_SOFT_MMU == 1
+    soft_tlb_entry_t *e = soft_tlb_entry(vaddr, cr);
+    if ((vaddr & ~(PAGE_SIZE - width)) == e->read_tag)
+    {
+        return read_dram(vaddr + e->pa_offset, width, cr);
+    }
+#endif
+    if (crosses_page(vaddr, width))
+    {
+        return load_split(vaddr, width, cr);
+    }
+    return read_dram(translate_data(vaddr, 0, cr), width, cr);
+}
+
+// a store of width bytes: its pages are translated before any byte enters the
+// store buffer, so the handlers call it before they change the registers
+static inline void store(uint64_t vaddr, uint64_t val, uint64_t width, core_t *cr)
+{
+#if ENABLE_SOFT_MMU == 1
+    soft_tlb_entry_t *e = soft_tlb_entry(vaddr, cr);
+    if ((vaddr & ~(PAGE_SIZE - width)) == e->write_tag)
+    {
+        write_dram(vaddr + e->pa_offset, val, width, cr);
+        return;
+    }
+#endif
+    if (crosses_page(vaddr, width))
+    {
+        store_split(vaddr, val, width, cr);
+        return;
+    }
+    write_dram(translate_data(vaddr, PF_WRITE, cr), val, width, cr);
+}
+
+// the register at the address given by reg_addr, as its low width bytes (little-endian hosts)
+static inline uint64_t read_reg(uint64_t addr, uint64_t width)
+{
+    switch (width)
+    {
+        case 1:
+            return *(uint8_t *)addr;
+        case 2:
+            return *(uint16_t *)addr;
+        case 4:
+            return *(uint32_t *)addr;
+        default:
+            return *(uint64_t *)addr;
+    }
+}
+
+// as x86-64: the writes of 4 bytes clear the upper half of the register,
+// those of 1 and 2 bytes keep the other bytes
+static inline void write_reg(uint64_t addr, uint64_t val, uint64_t width)
+{
+    switch (width)
+    {
+        case 1:
+            *(uint8_t *)addr = (uint8_t)val;
+            break;
+        case 2:
+            *(uint16_t *)addr = (uint16_t)val;
+            break;
+        case 4:
+            *(uint64_t *)addr = (uint32_t)val;
+            break;
+        default:
+            *(uint64_t *)addr = val;
+            break;
+    }
+}
+
+// the value of the operand at the address given by decode_operand
+// the immediates are kept whole: their bytes beyond width are dropped by the writes
+static inline uint64_t operand_value(od_t *od, uint64_t addr, uint64_t width, core_t *cr)
+{
+    if (od->type == IMM)
+    {
+        return addr;
+    }
+    else if (od->type == REG)
+    {
+        return read_reg(addr, width);
+    }
+    return load(addr, width, cr);
+}
+
+static inline void write_operand(od_t *od, uint64_t addr, uint64_t val, uint64_t width, core_t *cr)
+{
+    if (od->type == REG)
+    {
+        write_reg(addr, val, width);
+    }
+    else
+    {
+        store(addr, val, width, cr);
+    }
+}
+
+// update the rip pointer to the next instruction sequentially
+static inline void next_rip(inst_t *inst, core_t *cr)
+{
+    // the assembly strings are in fixed-length slots
+    // but the x86-64 machine code is variable-length:
+    // the operands' sizes follow the specific encoding rule
+    cr->rip = cr->rip + inst->length;
+}
+
+static void mov_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t src = decode_operand(src_od, cr);
+    uint64_t dst = decode_operand(dst_od, cr);
+
+    // no memory to memory move
+    if (src_od->type < MEM_IMM || dst_od->type < MEM_IMM)
+    {
+        write_operand(dst_od, dst, operand_value(src_od, src, inst->width, cr), inst->width, cr);
+        next_rip(inst, cr);
+        reset_cflags(cr);
+    }
+}
+
+static void push_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t src = decode_operand(src_od, cr);
+
+    if (src_od->type == REG)
+    {
+        // stored first: a page fault leaves rsp as it was
+        store((cr->reg).rsp - 8, *(uint64_t *)src, 8, cr);
+        (cr->reg).rsp = (cr->reg).rsp - 8;
+        next_rip(inst, cr);
+        reset_cflags(cr);
+        return;
+    }
+}
+
+static void pop_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t src = decode_operand(src_od, cr);
+
+    if (src_od->type == REG)
+    {
+        uint64_t old_val = load64((cr->reg).rsp, cr);
+        (cr->reg).rsp = (cr->reg).rsp + 8;
+        *(uint64_t *)src = old_val;
+        next_rip(inst, cr);
+        reset_cflags(cr);
+        return;
+    }
+}
+
+static void leave_handler(inst_t *inst, core_t *cr)
+{
+    // movq %rbp %rsp
+    // popq %rbp
+    // load before touching rsp so a page fault restarts the instruction cleanly
+    uint64_t old_val = load64((cr->reg).rbp, cr);
+    (cr->reg).rsp = (cr->reg).rbp + 8;
+    (cr->reg).rbp = old_val;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+
+static void call_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t src = decode_operand(src_od, cr);
+
+    store((cr->reg).rsp - 8, cr->rip + inst->length, 8, cr);
+    (cr->reg).rsp = (cr->reg).rsp - 8;
+    // jump to target function address
+    // support pc relative addressing
+
+    cr->rip = src;
+    reset_cflags(cr);
+}
+
+static void ret_handler(inst_t *inst, core_t *cr)
+{
+    uint64_t ret_addr = load64((cr->reg).rsp, cr);
+    (cr->reg).rsp = (cr->reg).rsp + 8;
+    // jump to return address
+    cr->rip = ret_addr;
+    reset_cflags(cr);
+}
+
+static void add_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t dst = decode_operand(dst_od, cr);
+    uint64_t sval = operand_value(src_od, decode_operand(src_od, cr), inst->width, cr);
+    uint64_t dval = operand_value(dst_od, dst, inst->width, cr);
+
+    // signed and unsigned value follow the same addition. e.g.
+    // 5 = 0000000000000101, 3 = 0000000000000011, -3 = 1111111111111101, 5 + (-3) = 0000000000000010
+    uint64_t val = dval + sval;
+
+    // set condition flags
+    set_cflags_width(CFLAGS_OP_ADD, sval, dval, val, inst->width, cr);
+
+    write_operand(dst_od, dst, val, inst->width, cr);
+    next_rip(inst, cr);
+}
+
+static void sub_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t dst = decode_operand(dst_od, cr);
+    uint64_t sval = operand_value(src_od, decode_operand(src_od, cr), inst->width, cr);
+    uint64_t dval = operand_value(dst_od, dst, inst->width, cr);
+
+    // dst = dst - src
+    uint64_t val = dval + (~sval + 1);
+
+    // set conditional flag
+    set_cflags_width(CFLAGS_OP_SUB, sval, dval, val, inst->width, cr);
+
+    write_operand(dst_od, dst, val, inst->width, cr);
+    next_rip(inst, cr);
+}
+
+static void cmp_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t sval = operand_value(src_od, decode_operand(src_od, cr), inst->width, cr);
+    uint64_t dval = operand_value(dst_od, decode_operand(dst_od, cr), inst->width, cr);
+
+    // dst - src, only the flags are kept
+    uint64_t val = dval + (~sval + 1);
+
+    set_cflags_width(CFLAGS_OP_SUB, sval, dval, val, inst->width, cr);
+
+    next_rip(inst, cr);
+}
+
+static void jne_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t src = decode_operand(src_od, cr);
+    
+    if (read_ZF(cr) == 0)
+    {
+        cr->rip = src;
+    }
+    else
+    {
+        next_rip(inst, cr);
+    }
+
+    reset_cflags(cr);
+}
+
+static void jmp_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t src = decode_operand(src_od, cr);
+    cr->rip = src;
+    reset_cflags(cr);
+}
+
+static void hlt_handler(inst_t *inst, core_t *cr)
+{
+    // the stores of a halted core are not left behind
+    flush_store_buffer(cr);
+    cr->halt = 1;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+static void lea_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    // the effective address itself, no memory access
+    uint64_t src = decode_operand(src_od, cr);
+    uint64_t dst = decode_operand(dst_od, cr);
+
+    if (src_od->type >= MEM_IMM && dst_od->type == REG)
+    {
+        write_reg(dst, src, inst->width);
+        next_rip(inst, cr);
+        reset_cflags(cr);
+    }
+}
+
+// and, or, xor, test and imul: dst = dst op src, test discards the result
+#define DEFINE_ALU_HANDLER(name, cflags_op, expr, writeback)                   \
+    static void name##_handler(inst_t *inst, core_t *cr)                       \
+    {                                                                          \
+        od_t *src_od = &(inst->src);                                           \
+        od_t *dst_od = &(inst->dst);                                           \
+                                                                               \
+        uint64_t width = inst->width;                                          \
+        uint64_t src = decode_operand(src_od, cr);                             \
+        uint64_t dst = decode_operand(dst_od, cr);                             \
+        uint64_t sval = operand_value(src_od, src, width, cr);                 \
+        uint64_t dval = operand_value(dst_od, dst, width, cr);                 \
+        uint64_t val = (expr);                                                 \
+                                                                               \
+        set_cflags_width(cflags_op, sval, dval, val, width, cr);               \
+        if (writeback)                                                         \
+        {                                                                      \
+            write_operand(dst_od, dst, val, width, cr);                        \
+        }                                                                      \
+        next_rip(inst, cr);                                                    \
+    }
+
+DEFINE_ALU_HANDLER(and,     CFLAGS_OP_LOGIC,    dval & sval,    1)
+DEFINE_ALU_HANDLER(or,      CFLAGS_OP_LOGIC,    dval | sval,    1)
+DEFINE_ALU_HANDLER(xor,     CFLAGS_OP_LOGIC,    dval ^ sval,    1)
+DEFINE_ALU_HANDLER(test,    CFLAGS_OP_LOGIC,    dval & sval,    0)
+DEFINE_ALU_HANDLER(imul,    CFLAGS_OP_MUL,      dval * sval,    1)
+
+#undef DEFINE_ALU_HANDLER
+
+// conditional jumps other than jne, on the materialized flags
+#define DEFINE_JCC_HANDLER(name, cond)                      \
+    static void name##_handler(inst_t *inst, core_t *cr)    \
+    {                                                       \
+        uint64_t src = decode_operand(&(inst->src), cr);    \
+        sync_cflags(cr);                                    \
+        cpu_flag_t *f = &(cr->flags);                       \
+                                                            \
+        if (cond)                                           \
+        {                                                   \
+            cr->rip = src;                                  \
+        }                                                   \
+        else                                                \
+        {                                                   \
+            next_rip(inst, cr);                             \
+        }                                                   \
+        reset_cflags(cr);                                   \
+    }
+
+DEFINE_JCC_HANDLER(je,  f->ZF == 1)
+DEFINE_JCC_HANDLER(jb,  f->CF == 1)
+DEFINE_JCC_HANDLER(jae, f->CF == 0)
+DEFINE_JCC_HANDLER(jbe, f->CF == 1 || f->ZF == 1)
+DEFINE_JCC_HANDLER(ja,  f->CF == 0 && f->ZF == 0)
+DEFINE_JCC_HANDLER(jl,  f->SF != f->OF)
+DEFINE_JCC_HANDLER(jge, f->SF == f->OF)
+DEFINE_JCC_HANDLER(jle, f->ZF == 1 || f->SF != f->OF)
+DEFINE_JCC_HANDLER(jg,  f->ZF == 0 && f->SF == f->OF)
+
+#undef DEFINE_JCC_HANDLER
+
+static void nop_handler(inst_t *inst, core_t *cr)
+{
+    next_rip(inst, cr);
+}
+
+/*======================================*/
+/*      atomic instructions             */
+/*======================================*/
+
+// the memory operands of xchg, cmpxchg and xadd and of the locked instructions
+// are updated by one host atomic on the physical memory, so the cores on the
+// other host threads synchronize without any lock of the simulator
+// the registers are private to the core and need no atomic
+
+// xchg src, dst: with a memory operand it is locked even without the prefix
+static void xchg_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t src = decode_operand(src_od, cr);
+    uint64_t dst = decode_operand(dst_od, cr);
+
+    if (src_od->type == REG && dst_od->type == REG)
+    {
+        uint64_t sval = read_reg(src, inst->width);
+        write_reg(src, read_reg(dst, inst->width), inst->width);
+        write_reg(dst, sval, inst->width);
+    }
+    else
+    {
+        // one of them is the register
+        uint64_t reg = src_od->type == REG ? src : dst;
+        uint64_t mem = src_od->type == REG ? dst : src;
+        write_reg(reg, atomic_rmw_dram(store_paddr(mem, inst->width, cr), ATOMIC_XCHG,
+            read_reg(reg, inst->width), inst->width, cr), inst->width);
+    }
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+// cmpxchg src, dst: dst = src if rax == dst, otherwise rax = dst
+// the flags are set as cmp dst, rax
+static void cmpxchg_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t sval = read_reg(decode_operand(src_od, cr), inst->width);
+    uint64_t dst = decode_operand(dst_od, cr);
+    uint64_t acc = read_reg((uint64_t)&(cr->reg.rax), inst->width);
+
+    uint64_t dval = acc;
+    int equal;
+    if (dst_od->type == REG)
+    {
+        // written back either way: a 4-byte register clears its upper half
+        dval = read_reg(dst, inst->width);
+        equal = dval == acc;
+        write_reg(dst, equal ? sval : dval, inst->width);
+    }
+    else
+    {
+        equal = atomic_cas_dram(store_paddr(dst, inst->width, cr), &dval, sval, inst->width, cr);
+    }
+
+    if (equal == 0)
+    {
+        write_reg((uint64_t)&(cr->reg.rax), dval, inst->width);
+    }
+    set_cflags_width(CFLAGS_OP_SUB, dval, acc, acc - dval, inst->width, cr);
+    next_rip(inst, cr);
+}
+
+// xadd src, dst: src = dst, dst = dst + src
+static void xadd_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+    od_t *dst_od = &(inst->dst);
+
+    uint64_t src = decode_operand(src_od, cr);
+    uint64_t dst = decode_operand(dst_od, cr);
+    uint64_t sval = read_reg(src, inst->width);
+
+    uint64_t dval;
+    if (dst_od->type == REG)
+    {
+        dval = read_reg(dst, inst->width);
+        write_reg(src, dval, inst->width);
+        write_reg(dst, dval + sval, inst->width);
+    }
+    else
+    {
+        dval = atomic_rmw_dram(store_paddr(dst, inst->width, cr), ATOMIC_ADD, sval, inst->width, cr);
+        write_reg(src, dval, inst->width);
+    }
+    set_cflags_width(CFLAGS_OP_ADD, sval, dval, dval + sval, inst->width, cr);
+    next_rip(inst, cr);
+}
+
+// the later loads wait for all the earlier stores
+static void mfence_handler(inst_t *inst, core_t *cr)
+{
+    flush_store_buffer(cr);
+    next_rip(inst, cr);
+}
+
+// switch or read the page tables
+// the writes serialize: the stores before them reach the page walks after them
+static void mov_cr3_handler(inst_t *inst, core_t *cr)
+{
+    if (inst->src.type == REG)
+    {
+        uint64_t value = *(uint64_t *)decode_operand(&(inst->src), cr);
+        flush_store_buffer(cr);
+        cr->pdbr = value & ~CR3_NOFLUSH;
+        if ((value & CR3_NOFLUSH) == 0)
+        {
+            tlb_flush_address_space(cr);
+        }
+        else
+        {
+            soft_tlb_flush(cr);
+        }
+        // the blocks are chained by virtual address: translate them again
+        __atomic_store_n(&(cr->flush_pending), 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        *(uint64_t *)decode_operand(&(inst->dst), cr) = cr->pdbr;
+    }
+    next_rip(inst, cr);
+}
+
+// lock add, sub, and, or and xor src, mem
+static void lock_alu_handler(inst_t *inst, core_t *cr)
+{
+    od_t *src_od = &(inst->src);
+
+    uint64_t width = inst->width;
+    uint64_t sval = operand_value(src_od, decode_operand(src_od, cr), width, cr);
+    uint64_t paddr = store_paddr(decode_operand(&(inst->dst), cr), width, cr);
+    uint64_t dval;
+
+    switch (inst->op)
+    {
+        case INST_ADD:
+            dval = atomic_rmw_dram(paddr, ATOMIC_ADD, sval, width, cr);
+            set_cflags_width(CFLAGS_OP_ADD, sval, dval, dval + sval, width, cr);
+            break;
+        case INST_SUB:
+            dval = atomic_rmw_dram(paddr, ATOMIC_ADD, ~sval + 1, width, cr);
+            set_cflags_width(CFLAGS_OP_SUB, sval, dval, dval + (~sval + 1), width, cr);
+            break;
+        case INST_AND:
+            dval = atomic_rmw_dram(paddr, ATOMIC_AND, sval, width, cr);
+            set_cflags_width(CFLAGS_OP_LOGIC, sval, dval, dval & sval, width, cr);
+            break;
+        case INST_OR:
+            dval = atomic_rmw_dram(paddr, ATOMIC_OR, sval, width, cr);
+            set_cflags_width(CFLAGS_OP_LOGIC, sval, dval, dval | sval, width, cr);
+            break;
+        default:
+            dval = atomic_rmw_dram(paddr, ATOMIC_XOR, sval, width, cr);
+            set_cflags_width(CFLAGS_OP_LOGIC, sval, dval, dval ^ sval, width, cr);
+            break;
+    }
+    next_rip(inst, cr);
+}
+
+/*======================================*/
+/*      specialized handlers            */
+/*======================================*/
+
+// the general handlers above test the operand types on every execution
+// the variants below are generated for each (operator, src type, dst type)
+// and chosen once when decoding, so they never test the types
+// e.g. mov_REG_MEM_IMM_REG1 for mov %rdi,-0x18(%rbp)
+
+#define SRC_REG     (*(uint64_t *)reg_addr(inst->src.reg1, cr))
+#define DST_REG     (*(uint64_t *)reg_addr(inst->dst.reg1, cr))
+
+static void mov_REG_REG(inst_t *inst, core_t *cr)
+{
+    DST_REG = SRC_REG;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+static void mov_IMM_REG(inst_t *inst, core_t *cr)
+{
+    DST_REG = inst->src.imm;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+#define DEFINE_MOV_MEM(type)                                                   \
+    static void mov_REG_##type(inst_t *inst, core_t *cr)                       \
+    {                                                                          \
+        store(ea_##type(&(inst->dst), cr), SRC_REG, 8, cr);                    \
+        next_rip(inst, cr);                                                    \
+        reset_cflags(cr);                                                      \
+    }                                                                          \
+    static void mov_##type##_REG(inst_t *inst, core_t *cr)                     \
+    {                                                                          \
+        DST_REG = load64(ea_##type(&(inst->src), cr), cr);                     \
+        next_rip(inst, cr);                                                    \
+        reset_cflags(cr);                                                      \
+    }
+
+FOR_EACH_MEM_TYPE(DEFINE_MOV_MEM)
+
+static void push_REG(inst_t *inst, core_t *cr)
+{
+    store((cr->reg).rsp - 8, SRC_REG, 8, cr);
+    (cr->reg).rsp = (cr->reg).rsp - 8;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+static void pop_REG(inst_t *inst, core_t *cr)
+{
+    uint64_t old_val = load64((cr->reg).rsp, cr);
+    (cr->reg).rsp = (cr->reg).rsp + 8;
+    SRC_REG = old_val;
+    next_rip(inst, cr);
+    reset_cflags(cr);
+}
+
+static void call_MEM_IMM(inst_t *inst, core_t *cr)
+{
+    store((cr->reg).rsp - 8, cr->rip + inst->length, 8, cr);
+    (cr->reg).rsp = (cr->reg).rsp - 8;
+    cr->rip = inst->src.imm;
+    reset_cflags(cr);
+}
+
+static void add_REG_REG(inst_t *inst, core_t *cr)
+{
+    uint64_t src = SRC_REG;
+    uint64_t dst = DST_REG;
+    uint64_t val = dst + src;
+
+    set_cflags(CFLAGS_OP_ADD, src, dst, val, cr);
+    DST_REG = val;
+    next_rip(inst, cr);
+}
+
+// dst - src with the condition flags set
+static inline uint64_t sub_flags(uint64_t src, uint64_t dst, core_t *cr)
+{
+    uint64_t val = dst + (~src + 1);
+
+    set_cflags(CFLAGS_OP_SUB, src, dst, val, cr);
+    return val;
+}
+
+static void sub_IMM_REG(inst_t *inst, core_t *cr)
+{
+    DST_REG = sub_flags(inst->src.imm, DST_REG, cr);
+    next_rip(inst, cr);
+}
+
+#define DEFINE_CMP_MEM(type)                                                         \
+    static void cmp_IMM_##type(inst_t *inst, core_t *cr)                             \
+    {                                                                                \
+        uint64_t dval = load64(ea_##type(&(inst->dst), cr), cr);                     \
+        sub_flags(inst->src.imm, dval, cr);                                          \
+        next_rip(inst, cr);                                                          \
+    }
+
+FOR_EACH_MEM_TYPE(DEFINE_CMP_MEM)
+
+static void jne_MEM_IMM(inst_t *inst, core_t *cr)
+{
+    if (read_ZF(cr) == 0)
+    {
+        cr->rip = inst->src.imm;
+    }
+    else
+    {
+        next_rip(inst, cr);
+    }
+    reset_cflags(cr);
+}
+
+static void jmp_MEM_IMM(inst_t *inst, core_t *cr)
+{
+    cr->rip = inst->src.imm;
+    reset_cflags(cr);
+}
+
+#undef SRC_REG
+#undef DST_REG
+#undef DEFINE_MOV_MEM
+#undef DEFINE_CMP_MEM
+
+// fused super-instructions: the idioms of compiled code executed at once
+// the handler gets the two instructions in inst[0] and inst[1]
+
+#define REG_RBP REG_ID(6, REG_64)
+#define REG_RSP REG_ID(7, REG_64)
+
+// cmpq $imm,mem; jne target
+// jne resets the flags at once, so they are never computed
+#define DEFINE_CMP_JNE(type)                                                            \
+    static void cmp_jne_##type(inst_t *inst, core_t *cr)                                \
+    {                                                                                   \
+        uint64_t dval = load64(ea_##type(&(inst[0].dst), cr), cr);                      \
+        if (dval != inst[0].src.imm)                                                    \
+        {                                                                               \
+            cr->rip = inst[1].src.imm;                                                  \
+        }                                                                               \
+        else                                                                            \
+        {                                                                               \
+            next_rip(&inst[0], cr);                                                     \
+            next_rip(&inst[1], cr);                                                     \
+        }                                                                               \
+        reset_cflags(cr);                                                               \
+    }
+
+FOR_EACH_MEM_TYPE(DEFINE_CMP_JNE)
+
+// push %rbp; mov %rsp,%rbp
+static void prologue_fused(inst_t *inst, core_t *cr)
+{
+    store((cr->reg).rsp - 8, (cr->reg).rbp, 8, cr);
+    (cr->reg).rsp = (cr->reg).rsp - 8;
+    (cr->reg).rbp = (cr->reg).rsp;
+    next_rip(&inst[0], cr);
+    next_rip(&inst[1], cr);
+    reset_cflags(cr);
+}
+
+// pop %rbp; retq from the stack at rsp
+// both loads come first: a page fault on either leaves the registers as they were
+static inline void pop_ret(uint64_t rsp, core_t *cr)
+{
+    uint64_t rbp = load64(rsp, cr);
+    uint64_t rip = load64(rsp + 8, cr);
+    (cr->reg).rbp = rbp;
+    (cr->reg).rsp = rsp + 16;
+    cr->rip = rip;
+    reset_cflags(cr);
+}
+
+// pop %rbp; retq
+static void pop_ret_fused(inst_t *inst, core_t *cr)
+{
+    pop_ret((cr->reg).rsp, cr);
+}
+
+// leaveq; retq
+static void leave_ret_fused(inst_t *inst, core_t *cr)
+{
+    pop_ret((cr->reg).rbp, cr);
+}
+
+#undef DEFINE_CMP_JNE
+
+#define NUM_OD_TYPE (MEM_IMM_REG1_REG2_SCAL + 1)
+
+#define MOV_MEM_ENTRY(type)                                 \
+    [INST_MOV][REG][type] = &mov_REG_##type,                \
+    [INST_MOV][type][REG] = &mov_##type##_REG,
+#define CMP_MEM_ENTRY(type)                                 \
+    [INST_CMP][IMM][type] = &cmp_IMM_##type,
+
+// indexed by [op][src type][dst type], NULL if there is no variant
+// the targets of callq, jne and jmp are parsed as MEM_IMM: absolute addresses
+static handler_t specialized_table[NUM_INSTRTYPE][NUM_OD_TYPE][NUM_OD_TYPE] = {
+    [INST_MOV][REG][REG]        = &mov_REG_REG,
+    [INST_MOV][IMM][REG]        = &mov_IMM_REG,
+    FOR_EACH_MEM_TYPE(MOV_MEM_ENTRY)
+    [INST_PUSH][REG][EMPTY]     = &push_REG,
+    [INST_POP][REG][EMPTY]      = &pop_REG,
+    [INST_LEAVE][EMPTY][EMPTY]  = &leave_handler,
+    [INST_CALL][MEM_IMM][EMPTY] = &call_MEM_IMM,
+    [INST_RET][EMPTY][EMPTY]    = &ret_handler,
+    [INST_ADD][REG][REG]        = &add_REG_REG,
+    [INST_SUB][IMM][REG]        = &sub_IMM_REG,
+    FOR_EACH_MEM_TYPE(CMP_MEM_ENTRY)
+    [INST_JNE][MEM_IMM][EMPTY]  = &jne_MEM_IMM,
+    [INST_JMP][MEM_IMM][EMPTY]  = &jmp_MEM_IMM,
+    [INST_HLT][EMPTY][EMPTY]    = &hlt_handler,
+};
+
+#undef MOV_MEM_ENTRY
+#undef CMP_MEM_ENTRY
+
+#define CMP_JNE_ENTRY(type) [type] = &cmp_jne_##type,
+
+// indexed by the memory operand type of cmpq
+static handler_t cmp_jne_table[NUM_OD_TYPE] = {
+    FOR_EACH_MEM_TYPE(CMP_JNE_ENTRY)
+};
+
+#undef CMP_JNE_ENTRY
+
+// the variants run the 8-byte operations: the narrower ones take the general handlers
+static inline handler_t specialized_handler(const inst_t *inst)
+{
+    if (inst->width != 8 || inst->lock == 1)
+    {
+        return NULL;
+    }
+    return specialized_table[inst->op][inst->src.type][inst->dst.type];
+}
+
+static inline int is_reg(const od_t *od, uint64_t id)
+{
+    return od->type == REG && od->reg1 == id;
+}
+
+// the handler of the super-instruction fusing the two instructions
+// NULL if they are not one of the idioms
+static handler_t fuse_handler(inst_t *first, inst_t *second, record_op_t *op)
+{
+    if (first->op == INST_CMP && first->width == 8 && second->op == INST_JNE &&
+        first->src.type == IMM && second->src.type == MEM_IMM &&
+        cmp_jne_table[first->dst.type] != NULL)
+    {
+        *op = FUSED_CMP_JNE;
+        return cmp_jne_table[first->dst.type];
+    }
+    else if (first->op == INST_PUSH && is_reg(&(first->src), REG_RBP) &&
+        second->op == INST_MOV && is_reg(&(second->src), REG_RSP) &&
+        is_reg(&(second->dst), REG_RBP))
+    {
+        *op = FUSED_PROLOGUE;
+        return &prologue_fused;
+    }
+    else if (first->op == INST_POP && is_reg(&(first->src), REG_RBP) &&
+        second->op == INST_RET)
+    {
+        *op = FUSED_POP_RET;
+        return &pop_ret_fused;
+    }
+    else if (first->op == INST_LEAVE && second->op == INST_RET)
+    {
+        *op = FUSED_LEAVE_RET;
+        return &leave_ret_fused;
+    }
+    return NULL;
+}
+
+// choose the handler once at decode time
+// fall back to the general handler for the combinations without variant
+// NULL for the 2-byte push and pop, which are not simulated
+static handler_t select_handler(const inst_t *inst)
+{
+    if (inst->lock == 1 && inst->op != INST_XCHG && inst->op != INST_CMPXCHG &&
+        inst->op != INST_XADD)
+    {
+        return &lock_alu_handler;
+    }
+
+    if ((inst->op == INST_PUSH || inst->op == INST_POP) && inst->width != 8)
+    {
+        return NULL;
+    }
+
+    handler_t handler = specialized_handler(inst);
+
+    if (handler == NULL)
+    {
+        handler = handler_table[inst->op];
+    }
+    return handler;
+}
+
+#if ENABLE_JIT == 1
+/*======================================*/
+/*      template JIT                    */
+/*======================================*/
+
+// hot blocks are compiled to host x86-64 code from per-handler templates
+// the guest registers stay in core_t, kept in rbx while the code runs
+// the simple register instructions are inlined, all the others call
+// their bound handler, which accesses memory by read64bits_dram, etc.
+// blocks with a record bound to a general handler are left to interpreter
+
+#define JIT_BUFFER_SIZE (1 << 20)
+// upper bound of the code emitted for one record
+#define MAX_JIT_RECORD_CODE 64
+
+typedef struct JIT_BUFFER_STRUCT
+{
+    uint8_t *base;      // mmap RWX buffer, NULL if not available
+    uint8_t *cur;
+    int unavailable;
+} jit_buffer_t;
+
+static inline void emit_u8(jit_buffer_t *jit, uint8_t v)
+{
+    *(jit->cur) = v;
+    jit->cur ++;
+}
+
+static inline void emit_u32(jit_buffer_t *jit, uint32_t v)
+{
+    memcpy(jit->cur, &v, sizeof(v));
+    jit->cur += sizeof(v);
+}
+
+static inline void emit_u64(jit_buffer_t *jit, uint64_t v)
+{
+    memcpy(jit->cur, &v, sizeof(v));
+    jit->cur += sizeof(v);
+}
+
+// displacements of the core fields from rbx
+#define CORE_REG_DISP(id)   ((uint32_t)(offsetof(core_t, reg) + REG_NUM(id) * sizeof(uint64_t)))
+#define CORE_RIP_DISP       ((uint32_t)offsetof(core_t, rip))
+#define CORE_FLAGS_DISP     ((uint32_t)offsetof(core_t, flags))
+#define CORE_LAZY_DISP(f)   ((uint32_t)(offsetof(core_t, lazy_cflags) + offsetof(lazy_cflags_t, f)))
+
+// mov rax, [rbx + disp32]
+static inline void emit_load_rax(jit_buffer_t *jit, uint32_t disp)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0x8b); emit_u8(jit, 0x83); emit_u32(jit, disp);
+}
+
+// mov [rbx + disp32], rax
+static inline void emit_store_rax(jit_buffer_t *jit, uint32_t disp)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0x89); emit_u8(jit, 0x83); emit_u32(jit, disp);
+}
+
+// mov [rbx + disp32], rcx
+static inline void emit_store_rcx(jit_buffer_t *jit, uint32_t disp)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0x89); emit_u8(jit, 0x8b); emit_u32(jit, disp);
+}
+
+// mov rcx, [rbx + disp32]
+static inline void emit_load_rcx(jit_buffer_t *jit, uint32_t disp)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0x8b); emit_u8(jit, 0x8b); emit_u32(jit, disp);
+}
+
+// next_rip: add qword [rbx + rip], length
+// imm8 is sign-extended: the lengths are up to MAX_INSTRUCTION_CHAR
+static inline void emit_next_rip(jit_buffer_t *jit, const inst_t *inst)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0x83); emit_u8(jit, 0x83); emit_u32(jit, CORE_RIP_DISP);
+    emit_u8(jit, (uint8_t)inst->length);
+}
+
+// reset_cflags: mov qword [rbx + flags], 0 and the lazy operation
+static inline void emit_reset_cflags(jit_buffer_t *jit)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0xc7); emit_u8(jit, 0x83);
+    emit_u32(jit, CORE_FLAGS_DISP); emit_u32(jit, 0);
+#if ENABLE_LAZY_CFLAGS == 1
+    // mov dword [rbx + lazy_cflags.op], CFLAGS_OP_NONE
+    emit_u8(jit, 0xc7); emit_u8(jit, 0x83);
+    emit_u32(jit, CORE_LAZY_DISP(op)); emit_u32(jit, CFLAGS_OP_NONE);
+#endif
+}
+
+// the generic template: handler(inst, cr)
+static void emit_call_handler(jit_buffer_t *jit, block_record_t *rec)
+{
+    emit_u8(jit, 0x48); emit_u8(jit, 0xbf); emit_u64(jit, (uint64_t)rec->inst);     // mov rdi, inst
+    emit_u8(jit, 0x48); emit_u8(jit, 0x89); emit_u8(jit, 0xde);                     // mov rsi, rbx
+    emit_u8(jit, 0x48); emit_u8(jit, 0xb8); emit_u64(jit, (uint64_t)rec->handler);  // mov rax, handler
+    emit_u8(jit, 0xff); emit_u8(jit, 0xd0);                                         // call rax
+}
+
+// the inlined templates, return 0 if the record has none
+static int emit_inline(jit_buffer_t *jit, block_record_t *rec)
+{
+    inst_t *inst = rec->inst;
+
+    // the high byte registers are not at the start of the register
+    if ((inst->src.type == REG && REG_WIDTH(inst->src.reg1) == REG_8H) ||
+        (inst->dst.type == REG && REG_WIDTH(inst->dst.reg1) == REG_8H))
+    {
+        return 0;
+    }
+
+    if (rec->handler == &mov_REG_REG)
+    {
+        emit_load_rax(jit, CORE_REG_DISP(inst->src.reg1));
+        emit_store_rax(jit, CORE_REG_DISP(inst->dst.reg1));
+        emit_next_rip(jit, inst);
+        emit_reset_cflags(jit);
+        return 1;
+    }
+    else if (rec->handler == &mov_IMM_REG)
+    {
+        emit_u8(jit, 0x48); emit_u8(jit, 0xb8); emit_u64(jit, inst->src.imm);    // mov rax, imm
+        emit_store_rax(jit, CORE_REG_DISP(inst->dst.reg1));
+        emit_next_rip(jit, inst);
+        emit_reset_cflags(jit);
+        return 1;
+    }
+#if ENABLE_LAZY_CFLAGS == 1
+    else if (rec->handler == &add_REG_REG || rec->handler == &sub_IMM_REG)
+    {
+        // record the lazy flags as set_cflags does
+        if (rec->handler == &add_REG_REG)
+        {
+            emit_load_rcx(jit, CORE_REG_DISP(inst->src.reg1));
+        }
+        else
+        {
+            emit_u8(jit, 0x48); emit_u8(jit, 0xb9); emit_u64(jit, inst->src.imm);    // mov rcx, imm
+        }
+        emit_load_rax(jit, CORE_REG_DISP(inst->dst.reg1));
+        emit_store_rcx(jit, CORE_LAZY_DISP(src));
+        emit_store_rax(jit, CORE_LAZY_DISP(dst));
+        if (rec->handler == &add_REG_REG)
+        {
+            emit_u8(jit, 0x48); emit_u8(jit, 0x01); emit_u8(jit, 0xc8);              // add rax, rcx
+        }
+        else
+        {
+            emit_u8(jit, 0x48); emit_u8(jit, 0x29); emit_u8(jit, 0xc8);              // sub rax, rcx
+        }
+        emit_store_rax(jit, CORE_REG_DISP(inst->dst.reg1));
+        emit_store_rax(jit, CORE_LAZY_DISP(val));
+        // mov dword [rbx + lazy_cflags.op], op
+        emit_u8(jit, 0xc7); emit_u8(jit, 0x83); emit_u32(jit, CORE_LAZY_DISP(op));
+        emit_u32(jit, rec->handler == &add_REG_REG ? CFLAGS_OP_ADD : CFLAGS_OP_SUB);
+        emit_next_rip(jit, inst);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+// drop all the compiled code, the buffer is refilled from the start
+static void jit_flush(core_t *cr)
+{
+    for (int i = 0; i < NUM_BLOCK_CACHE_ENTRY; ++ i)
+    {
+        cr->block_cache->blocks[i].jit_code = NULL;
+    }
+    cr->jit->cur = cr->jit->base;
+}
+
+static void jit_compile(block_t *block, core_t *cr)
+{
+    jit_buffer_t *jit = cr->jit;
+    if (jit->unavailable == 1)
+    {
+        return;
+    }
+
+    if (jit->base == NULL)
+    {
+        void *buf = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED)
+        {
+            // e.g. W^X enforced by the host: stay in interpreter
+            debug_printf(DEBUG_INSTRUCTION, "jit: no executable buffer\n");
+            jit->unavailable = 1;
+            return;
+        }
+        jit->base = (uint8_t *)buf;
+        jit->cur = jit->base;
+    }
+
+    // fall back to interpreter on the records without template
+    for (uint64_t i = 0; i < block->num_record; ++ i)
+    {
+        block_record_t *rec = &(block->records[i]);
+        inst_t *inst = rec->inst;
+        if (rec->num_inst == 1 && specialized_handler(inst) == NULL)
+        {
+            block->exec_count = 0;
+            return;
+        }
+    }
+
+    if (jit->cur + (block->num_record + 1) * MAX_JIT_RECORD_CODE > jit->base + JIT_BUFFER_SIZE)
+    {
+        jit_flush(cr);
+    }
+
+    uint8_t *code = jit->cur;
+
+    emit_u8(jit, 0x53);                                             // push rbx
+    emit_u8(jit, 0x48); emit_u8(jit, 0x89); emit_u8(jit, 0xfb);     // mov rbx, rdi
+
+    for (uint64_t i = 0; i < block->num_record; ++ i)
+    {
+        block_record_t *rec = &(block->records[i]);
+        if (emit_inline(jit, rec) == 0)
+        {
+            emit_call_handler(jit, rec);
+        }
+    }
+
+    emit_u8(jit, 0x5b);                                             // pop rbx
+    emit_u8(jit, 0xc3);                                             // ret
+
+    block->jit_code = (void (*)(core_t *))code;
+}
+#endif
+
+/*======================================*/
+/*      decoded code caches             */
+/*======================================*/
+
+// each core owns its caches, so the cores run without locks
+// and only the writes to code reach the other cores
+void init_cpu_cache(machine_t *m)
+{
+    m->code_cores = calloc(NUM_CODE_LINE, sizeof(uint64_t));
+    if (m->code_cores == NULL)
+    {
+        printf("cannot allocate the code lines of the machine\n");
+        exit(0);
+    }
+
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &(m->cores[i]);
+        cr->inst_cache = calloc(1, sizeof(inst_cache_t));
+        cr->block_cache = calloc(1, sizeof(block_cache_t));
+#if ENABLE_JIT == 1
+        cr->jit = calloc(1, sizeof(jit_buffer_t));
+        if (cr->jit == NULL)
+        {
+            printf("cannot allocate the jit buffer\n");
+            exit(0);
+        }
+#endif
+        if (cr->inst_cache == NULL || cr->block_cache == NULL)
+        {
+            printf("cannot allocate the decoded code caches\n");
+            exit(0);
+        }
+    }
+
+#if ENABLE_THREADED_DISPATCH == 1
+    // the labels are shared by all the machines
+    if (threaded_labels == NULL)
+    {
+        run_threaded(NULL, NULL);
+    }
+#endif
+}
+
+void free_cpu_cache(machine_t *m)
+{
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &(m->cores[i]);
+#if ENABLE_JIT == 1
+        if (cr->jit != NULL && cr->jit->base != NULL)
+        {
+            munmap(cr->jit->base, JIT_BUFFER_SIZE);
+        }
+        free(cr->jit);
+        cr->jit = NULL;
+#endif
+        free(cr->inst_cache);
+        free(cr->block_cache);
+        cr->inst_cache = NULL;
+        cr->block_cache = NULL;
+    }
+    free(m->code_cores);
+    m->code_cores = NULL;
+}
+
+/*======================================*/
+/*      pre-decoded instruction records */
+/*======================================*/
+
+// the linker decodes the text once per build and stores each instruction
+// as a binary record in its slot instead of the assembly string:
+//  [0] INST_RECORD_MAGIC, never an ASCII character
+//  [1] op, [2] width
+//  [3, 15) src, [15, 27) dst: type, reg1, reg2, scal, imm (little-endian)
+//  [27] lock
+#define INST_RECORD_OD_SIZE 12
+
+static void pack_od(const od_t *od, uint8_t *p)
+{
+    p[0] = (uint8_t)od->type;
+    p[1] = (uint8_t)od->reg1;
+    p[2] = (uint8_t)od->reg2;
+    p[3] = (uint8_t)od->scal;
+    for (int i = 0; i < 8; ++ i)
+    {
+        p[4 + i] = (od->imm >> (8 * i)) & 0xff;
+    }
+}
+
+// return 0 if the record does not hold a valid operand
+static int unpack_od(const uint8_t *p, od_t *od)
+{
+    od->type = (od_type_t)p[0];
+    od->reg1 = p[1];
+    od->reg2 = p[2];
+    od->scal = p[3];
+    od->imm = 0;
+    for (int i = 0; i < 8; ++ i)
+    {
+        od->imm |= (uint64_t)p[4 + i] << (8 * i);
+    }
+    return od->type <= MEM_IMM_REG1_REG2_SCAL &&
+        REG_WIDTH(od->reg1) <= REG_8H && REG_WIDTH(od->reg2) <= REG_8H;
+}
+
+void pack_inst_record(const inst_t *inst, uint8_t *slot)
+{
+    memset(slot, 0, MAX_INSTRUCTION_CHAR);
+    slot[0] = INST_RECORD_MAGIC;
+    slot[1] = (uint8_t)inst->op;
+    slot[2] = (uint8_t)inst->width;
+    pack_od(&(inst->src), slot + 3);
+    pack_od(&(inst->dst), slot + 3 + INST_RECORD_OD_SIZE);
+    slot[3 + 2 * INST_RECORD_OD_SIZE] = (uint8_t)inst->lock;
+}
+
+static int unpack_inst_record(const uint8_t *slot, inst_t *inst)
+{
+    inst->op = (op_t)slot[1];
+    inst->width = slot[2];
+    inst->lock = slot[3 + 2 * INST_RECORD_OD_SIZE];
+    inst->length = sizeof(char) * MAX_INSTRUCTION_CHAR;
+    return slot[1] < NUM_INSTRTYPE && inst->lock <= 1 &&
+        unpack_od(slot + 3, &(inst->src)) == 1 &&
+        unpack_od(slot + 3 + INST_RECORD_OD_SIZE, &(inst->dst)) == 1 &&
+        lock_allowed(inst) == 1;
+}
+
+int parse_inst_string(const char *str, inst_t *inst)
+{
+    char slot[MAX_INSTRUCTION_CHAR] = {'\0'};
+    if (strlen(str) >= MAX_INSTRUCTION_CHAR)
+    {
+        return 0;
+    }
+    strcpy(slot, str);
+    return parse_instruction(slot, inst);
+}
+
+// instruction cycle is implemented in CPU
+// the only exposed interface outside CPU
+void instruction_cycle(core_t *cr)
+{
+    if (cr->halt == 1)
+    {
+        return;
+    }
+
+    sync_code(cr);
+    // the host may have changed the address space between the instructions
+    soft_tlb_sync(cr);
+
+    fault_frame_t frame;
+    frame.num_inst = 0;
+    frame.block = NULL;
+    cr->fault_frame = &frame;
+    if (setjmp(frame.env) != 0)
+    {
+        // rip stays at the faulting instruction
+        cr->fault_frame = NULL;
+        return;
+    }
+
+    uint64_t paddr = va2pa_fetch(cr->rip, cr);
+
+    if ((DEBUG_VERBOSE_SET & DEBUG_INSTRUCTION) != 0x0 && cr->fetch_mode == FETCH_X86)
+    {
+        debug_printf(DEBUG_INSTRUCTION, "%lx    <x86-64 opcode %02x>\n", cr->rip, cr->machine->pm[paddr]);
+    }
+    else if ((DEBUG_VERBOSE_SET & DEBUG_INSTRUCTION) != 0x0)
+    {
+        char inst_str[MAX_INSTRUCTION_CHAR + 10];
+        readinst_dram(paddr, inst_str, cr);
+        if ((uint8_t)inst_str[0] == INST_RECORD_MAGIC)
+        {
+            debug_printf(DEBUG_INSTRUCTION, "%lx    <pre-decoded op %d>\n", cr->rip, inst_str[1]);
+        }
+        else
+        {
+            debug_printf(DEBUG_INSTRUCTION, "%lx    %s\n", cr->rip, inst_str);
+        }
+    }
+
+    // FETCH and DECODE: hit the decoded instruction cache first
+    inst_cache_entry_t *entry = decode_inst(cr->rip, paddr, cr);
+    if (entry->handler == NULL)
+    {
+        printf("cannot decode instruction at 0x%lx\n", cr->rip);
+        exit(0);
+    }
+
+    // EXECUTE: update CPU and memory according the instruction
+    entry->handler(&(entry->inst), cr);
+
+    // single stepping: every store is visible after its instruction
+    flush_store_buffer(cr);
+    cr->fault_frame = NULL;
+}
+
+void print_register(core_t *cr)
+{
+    if ((DEBUG_VERBOSE_SET & DEBUG_REGISTER) == 0x0)
+    {
+        return;
+    }
+
+    sync_cflags(cr);
+    reg_t reg = cr->reg;
+
+    printf("rax = %16lx\trbx = %16lx\trcx = %16lx\trdx = %16lx\n",
+        reg.rax, reg.rbx, reg.rcx, reg.rdx);
+    printf("rsi = %16lx\trdi = %16lx\trbp = %16lx\trsp = %16lx\n",
+        reg.rsi, reg.rdi, reg.rbp, reg.rsp);
+    printf("rip = %16lx\n", cr->rip);
+    printf("CF = %u\tZF = %u\tSF = %u\tOF = %u\n",
+        cr->flags.CF, cr->flags.ZF, cr->flags.SF, cr->flags.OF);
+}
+
+void print_stack(core_t *cr)
+{
+    if ((DEBUG_VERBOSE_SET & DEBUG_PRINTSTACK) == 0x0)
+    {
+        return;
+    }
+
+    int n = 10;    
+    uint64_t *high = (uint64_t*)&(cr->machine->pm[va2pa((cr->reg).rsp, cr)]);
+    high = &high[n];
+    uint64_t va = (cr->reg).rsp + n * 8;
+
+    for (int i = 0; i < 2 * n; ++ i)
+    {
+        uint64_t *ptr = (uint64_t *)(high - i);
+        printf("0x%16lx : %16lx", va, (uint64_t)*ptr);
+
+        if (i == n)
+        {
+            printf(" <== rsp");
+        }
+
+        printf("\n");
+        va -= 8;
+    }
+}
+
+void TestParseOperand()
+{
+    const char *strs[11] = {
+       "$0x1234",
+       "%rax",
+       "0xabcd",
+       "(%rsp)",
+       "0xabcd(%rsp)",
+       "(%rsp,%rbx)",
+       "0xabcd(%rsp,%rbx)",
+       "(,%rbx,8)",
+       "0xabcd(,%rbx,8)",
+       "(%rsp,%rbx,8)",
+       "0xabcd(%rsp,%rbx,8)",
+    };
+
+    printf("rax %lx\n", REG_ID(0, REG_64));
+    printf("rsp %lx\n", REG_ID(7, REG_64));
+    printf("rbx %lx\n", REG_ID(1, REG_64));
+
+    for (int i = 0; i < 11; i++)
+    {
+        char slot[MAX_INSTRUCTION_CHAR] = {'\0'};
+        strcpy(slot, strs[i]);
+        token_mask_t m;
+        scan_slot(slot, &m);
+
+        od_t od;
+        parse_operand(slot, &m, 0, strlen(slot), &od);
+
+        printf("\n%s\n", strs[i]);
+        printf("od enum type: %d\n", od.type);
+        printf("od imm: %lx\n", od.imm);
+        printf("od reg1: %lx\n", od.reg1);
+        printf("od reg2: %lx\n", od.reg2);
+        printf("od scal: %lx\n", od.scal);
+    }
+}
+
+// the objdump text of add() and its caller
+static const char parse_corpus[15][MAX_INSTRUCTION_CHAR] = {
+    "push   %rbp",              // 0
+    "mov    %rsp,%rbp",         // 1
+    "mov    %rdi,-0x18(%rbp)",  // 2
+    "mov    %rsi,-0x20(%rbp)",  // 3
+    "mov    -0x18(%rbp),%rdx",  // 4
+    "mov    -0x20(%rbp),%rax",  // 5
+    "add    %rdx,%rax",         // 6
+    "mov    %rax,-0x8(%rbp)",   // 7
+    "mov    -0x8(%rbp),%rax",   // 8
+    "pop    %rbp",              // 9
+    "retq",                     // 10
+    "mov    %rdx,%rsi",         // 11
+    "mov    %rax,%rdi",         // 12
+    "callq  0",                 // 13
+    "mov    %rax,-0x8(%rbp)",   // 14
+};
+
+static int od_equal(const od_t *a, const od_t *b)
+{
+    return a->type == b->type && a->imm == b->imm && a->scal == b->scal &&
+        a->reg1 == b->reg1 && a->reg2 == b->reg2;
+}
+
+void TestParseInstruction()
+{
+    // the separator masks must not depend on the scanner
+    int match = 1;
+    for (int i = 0; i < 15; i++)
+    {
+        token_mask_t m, n;
+        scan_slot(parse_corpus[i], &m);
+        scan_slot_scalar(parse_corpus[i], &n);
+        match = match && memcmp(&m, &n, sizeof(token_mask_t)) == 0;
+    }
+    printf(match ? "tokenizer match\n" : "tokenizer mismatch\n");
+
+    // the parsed fields of the corpus
+    uint64_t rax = REG_ID(0, REG_64), rdx = REG_ID(3, REG_64), rsi = REG_ID(4, REG_64);
+    uint64_t rdi = REG_ID(5, REG_64), rbp = REG_ID(6, REG_64), rsp = REG_ID(7, REG_64);
+    od_t none = {EMPTY, 0, 0, 0, 0};
+    od_t reg_rax = {REG, 0, 0, rax, 0}, reg_rdx = {REG, 0, 0, rdx, 0};
+    od_t reg_rsi = {REG, 0, 0, rsi, 0}, reg_rdi = {REG, 0, 0, rdi, 0};
+    od_t reg_rbp = {REG, 0, 0, rbp, 0}, reg_rsp = {REG, 0, 0, rsp, 0};
+    od_t rbp_8 = {MEM_IMM_REG1, -0x8, 0, rbp, 0};
+    od_t rbp_18 = {MEM_IMM_REG1, -0x18, 0, rbp, 0};
+    od_t rbp_20 = {MEM_IMM_REG1, -0x20, 0, rbp, 0};
+    od_t target = {MEM_IMM, 0, 0, 0, 0};
+    struct
+    {
+        op_t op;
+        uint64_t width;
+        od_t src;
+        od_t dst;
+    } expected[15] = {
+        {INST_PUSH, 8, reg_rbp, none},
+        {INST_MOV, 8, reg_rsp, reg_rbp},
+        {INST_MOV, 8, reg_rdi, rbp_18},
+        {INST_MOV, 8, reg_rsi, rbp_20},
+        {INST_MOV, 8, rbp_18, reg_rdx},
+        {INST_MOV, 8, rbp_20, reg_rax},
+        {INST_ADD, 8, reg_rdx, reg_rax},
+        {INST_MOV, 8, reg_rax, rbp_8},
+        {INST_MOV, 8, rbp_8, reg_rax},
+        {INST_POP, 8, reg_rbp, none},
+        {INST_RET, 8, none, none},
+        {INST_MOV, 8, reg_rdx, reg_rsi},
+        {INST_MOV, 8, reg_rax, reg_rdi},
+        {INST_CALL, 8, target, none},
+        {INST_MOV, 8, reg_rax, rbp_8},
+    };
+
+    match = 1;
+    for (int i = 0; i < 15; i++)
+    {
+        inst_t inst;
+        if (parse_instruction(parse_corpus[i], &inst) == 0 ||
+            inst.op != expected[i].op || inst.width != expected[i].width || inst.lock != 0 ||
+            od_equal(&inst.src, &expected[i].src) == 0 || od_equal(&inst.dst, &expected[i].dst) == 0)
+        {
+            printf("parsed %s differently\n", parse_corpus[i]);
+            match = 0;
+        }
+    }
+    printf(match ? "parser match\n" : "parser mismatch\n");
+
+    // no byte or word lea, and the byte imul has no two-operand form
+    const char *rejected[5] = {
+        "leab   (%rax),%bl",
+        "leaw   (%rax),%bx",
+        "lea    (%rax),%bx",
+        "imulb  %al,%bl",
+        "imul   %al,%bl",
+    };
+    inst_t checked;
+    match = parse_inst_string("leal   (%rax),%ebx", &checked) == 1 &&
+        parse_inst_string("imulw  %ax,%bx", &checked) == 1;
+    for (int i = 0; i < 5; i++)
+    {
+        match = match && parse_inst_string(rejected[i], &checked) == 0;
+    }
+    printf(match ? "operand size match\n" : "operand size mismatch\n");
+}
+
+// time the parser and the scanners on the corpus: make bench
+void BenchParseInstruction()
+{
+    int num_round = 10000;
+    inst_t inst;
+    token_mask_t m;
+
+    clock_t begin = clock();
+    for (int r = 0; r < num_round; ++ r)
+    {
+        for (int i = 0; i < 15; i++)
+        {
+            parse_instruction(parse_corpus[i], &inst);
+        }
+    }
+    clock_t parse_time = clock() - begin;
+
+    begin = clock();
+    for (int r = 0; r < num_round; ++ r)
+    {
+        for (int i = 0; i < 15; i++)
+        {
+            scan_slot(parse_corpus[i], &m);
+            __asm__ volatile("" : : "r"(&m) : "memory");
+        }
+    }
+    clock_t scan_time = clock() - begin;
+
+    begin = clock();
+    for (int r = 0; r < num_round; ++ r)
+    {
+        for (int i = 0; i < 15; i++)
+        {
+            scan_slot_scalar(parse_corpus[i], &m);
+            __asm__ volatile("" : : "r"(&m) : "memory");
+        }
+    }
+    clock_t scalar_time = clock() - begin;
+
+    double ns = 1e9 / CLOCKS_PER_SEC / (num_round * 15);
+    printf("parse %.1f ns, scan %.1f ns, scalar scan %.1f ns per instruction\n",
+        parse_time * ns, scan_time * ns, scalar_time * ns);
+}
+
+void TestDecodeInstruction()
+{
+    // machine code by as, at 0x400000, and the objdump text of it
+    struct
+    {
+        uint8_t code[MAX_X86_INST_LEN];
+        uint64_t length;
+        const char *assembly;
+    } corpus[45] = {
+        {{0x55}, 1, "push   %rbp"},
+        {{0x48, 0x89, 0xe5}, 3, "mov    %rsp,%rbp"},
+        {{0x48, 0x89, 0x7d, 0xe8}, 4, "mov    %rdi,-0x18(%rbp)"},
+        {{0x48, 0xc7, 0x45, 0xf8, 0x00, 0x00, 0x00, 0x00}, 8, "movq   $0x0,-0x8(%rbp)"},
+        {{0x48, 0x8d, 0x14, 0xc5, 0x00, 0x00, 0x00, 0x00}, 8, "lea    0x0(,%rax,8),%rdx"},
+        {{0x48, 0x8b, 0x00}, 3, "mov    (%rax),%rax"},
+        {{0x48, 0x01, 0x45, 0xf8}, 4, "add    %rax,-0x8(%rbp)"},
+        {{0x48, 0x83, 0x45, 0xf0, 0x01}, 5, "addq   $0x1,-0x10(%rbp)"},
+        {{0x48, 0x3b, 0x45, 0xe0}, 4, "cmp    -0x20(%rbp),%rax"},
+        {{0x48, 0x83, 0xec, 0x10}, 4, "sub    $0x10,%rsp"},
+        {{0xb8, 0x00, 0x00, 0x00, 0x00}, 5, "mov    $0x0,%eax"},
+        {{0x88, 0xc6}, 2, "mov    %al,%dh"},
+        {{0xc6, 0x04, 0x1c, 0x7f}, 4, "movb   $0x7f,(%rsp,%rbx,1)"},
+        {{0x45, 0x89, 0x44, 0x24, 0x10}, 5, "mov    %r8d,0x10(%r12)"},
+        {{0x44, 0x30, 0xee}, 3, "xor    %r13b,%sil"},
+        {{0x85, 0xc0}, 2, "test   %eax,%eax"},
+        {{0x83, 0xe4, 0xf0}, 3, "and    $0xfffffff0,%esp"},
+        {{0x48, 0x0f, 0xaf, 0x55, 0xf8}, 5, "imul   -0x8(%rbp),%rdx"},
+        {{0x66, 0x0d, 0x00, 0x01}, 4, "or     $0x100,%ax"},
+        {{0x48, 0xb9, 0x89, 0x67, 0x45, 0x23, 0x01, 0x00, 0x00, 0x00}, 10, "mov    $0x123456789,%rcx"},
+        {{0x0f, 0x1f, 0x40, 0x00}, 4, "nopl   0x0(%rax)"},
+        {{0xc9}, 1, "leaveq"},
+        {{0xc3}, 1, "retq"},
+        {{0xf4}, 1, "hlt"},
+        {{0xe8, 0xfb, 0xff, 0xff, 0xff}, 5, "callq  0x400000"},
+        {{0x72, 0x3e}, 2, "jb     0x400040"},
+        {{0x0f, 0x85, 0xfa, 0x01, 0x00, 0x00}, 6, "jne    0x400200"},
+        {{0xe9, 0x7b, 0x03, 0x00, 0x00}, 5, "jmp    0x400380"},
+        {{0x48, 0x8b, 0x05, 0x00, 0x02, 0x00, 0x00}, 7, "mov    0x400207,%rax"},     // 0x200(%rip)
+        {{0x80, 0x3f, 0x2f}, 3, "cmpb   $0x2f,(%rdi)"},
+        {{0x48, 0x6b, 0xc0, 0x18}, 4, "imul   $0x18,%rax"},                         // imul $0x18,%rax,%rax
+        {{0x41, 0x5c}, 2, "pop    %r12"},
+        {{0xf3, 0xc3}, 2, "retq"},                                                  // repz retq
+        {{0x48, 0x87, 0x03}, 3, "xchg   %rax,(%rbx)"},
+        {{0x48, 0x91}, 2, "xchg   %rax,%rcx"},
+        {{0x86, 0x17}, 2, "xchg   %dl,(%rdi)"},
+        {{0xf0, 0x48, 0x0f, 0xb1, 0x0b}, 5, "lock cmpxchg %rcx,(%rbx)"},
+        {{0xf0, 0x0f, 0xb1, 0x57, 0x08}, 5, "lock cmpxchg %edx,0x8(%rdi)"},
+        {{0xf0, 0x48, 0x0f, 0xc1, 0x03}, 5, "lock xadd %rax,(%rbx)"},
+        {{0xf0, 0x48, 0x83, 0x07, 0x01}, 5, "lock addq $0x1,(%rdi)"},
+        {{0xf0, 0x81, 0x27, 0xff, 0x00, 0x00, 0x00}, 7, "lock andl $0xff,(%rdi)"},
+        {{0x0f, 0xae, 0xf0}, 3, "mfence"},
+        {{0x0f, 0x22, 0xd8}, 3, "mov    %rax,%cr3"},
+        {{0x0f, 0x20, 0xdb}, 3, "mov    %cr3,%rbx"},
+        {{0x41, 0x0f, 0x22, 0xd9}, 4, "mov    %r9,%cr3"},
+    };
+
+    int match = 1;
+    for (int i = 0; i < 45; ++ i)
+    {
+        inst_t decoded, parsed;
+        if (decode_x86_inst(corpus[i].code, 0x400000, &decoded) == 0 ||
+            parse_inst_string(corpus[i].assembly, &parsed) == 0)
+        {
+            printf("cannot decode %s\n", corpus[i].assembly);
+            match = 0;
+            continue;
+        }
+        if (decoded.length != corpus[i].length || decoded.op != parsed.op ||
+            decoded.width != parsed.width || decoded.lock != parsed.lock ||
+            od_equal(&decoded.src, &parsed.src) == 0 || od_equal(&decoded.dst, &parsed.dst) == 0)
+        {
+            printf("decoded %s differently\n", corpus[i].assembly);
+            match = 0;
+        }
+    }
+
+    // out of the subset: adc, jo, push imm, and lock on cmp or a register
+    uint8_t unsupported[5][MAX_X86_INST_LEN] = {
+        {0x48, 0x11, 0xc0},
+        {0x70, 0x00},
+        {0x6a, 0x01},
+        {0xf0, 0x48, 0x39, 0x07},
+        {0xf0, 0x48, 0x01, 0xc0},
+    };
+    for (int i = 0; i < 5; ++ i)
+    {
+        inst_t inst;
+        match = match && decode_x86_inst(unsupported[i], 0x400000, &inst) == 0;
+    }
+
+    printf(match ? "decoder match\n" : "decoder mismatch\n");
+}
@@ -1,11 +1,632 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <assert.h>
-#include <headers/cpu.h>
-#include <headers/common.h>
-#include <headers/memory.h>
-
-uint64_t va2pa(uint64_t vaddr, core_t* cr)
-{
-    return vaddr % PHYSICAL_MEMORY_SPACE;
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <headers/cpu.h>
+#include <headers/common.h>
+#include <headers/memory.h>
+#include <headers/machine.h>
+
+/*======================================*/
+/*      page walk                       */
+/*======================================*/
+
+#if ENABLE_PAGE_WALK == 1
+static int page_fault(uint64_t vaddr, uint64_t code, core_t *cr)
+{
+    cr->fault_vaddr = vaddr;
+    cr->fault_code = code;
+    cr->walk_stats.num_fault ++;
+    return 0;
+}
+
+// the walker reads the entries from the physical memory as the hardware does:
+// the stores of the core reach it once they leave the store buffer
+// *leaf gets the 4 KiB frame of vaddr with the rights allowed by all the levels:
+// PTE_WRITABLE, PTE_USER, and PTE_DIRTY once the page is marked dirty
+static int page_walk(uint64_t vaddr, uint64_t access, core_t *cr, uint64_t *leaf)
+{
+    uint8_t *pm = cr->machine->pm;
+    uint64_t pm_size = cr->machine->pm_size;
+    uint64_t user = cr->cpl == 3 ? PF_USER : 0;
+
+    // the rights of the page are those allowed by all the levels
+    uint64_t allowed = PTE_WRITABLE | PTE_USER;
+    uint64_t table = cr->pdbr & PTE_FRAME;
+
+    cr->walk_stats.num_walk ++;
+    for (int level = 0; level < PAGE_TABLE_LEVEL; ++ level)
+    {
+        // 9 bits of index per level, from bits 47 - 39 of the PML4 down
+        uint64_t shift = 39 - 9 * level;
+        uint64_t entry_addr = table + ((vaddr >> shift) & 0x1ff) * 8;
+        if (entry_addr + 8 > pm_size)
+        {
+            return page_fault(vaddr, access | user | PF_RESERVED | PF_PROTECTION, cr);
+        }
+
+        uint64_t *entry = (uint64_t *)&(pm[entry_addr]);
+        uint64_t e = __atomic_load_n(entry, __ATOMIC_RELAXED);
+        cr->walk_stats.num_read[level] ++;
+
+        if ((e & PTE_PRESENT) == 0)
+        {
+            return page_fault(vaddr, access | user, cr);
+        }
+        allowed &= e;
+
+        if (level == PAGE_TABLE_LEVEL - 1 || (level > 0 && (e & PTE_HUGE) != 0))
+        {
+            if (((access & PF_WRITE) != 0 && (allowed & PTE_WRITABLE) == 0) ||
+                (user != 0 && (allowed & PTE_USER) == 0))
+            {
+                return page_fault(vaddr, access | user | PF_PROTECTION, cr);
+            }
+
+            // the 4 KiB, 2 MiB or 1 GiB frame
+            uint64_t offset_mask = (1ULL << shift) - 1;
+            uint64_t pa = (e & PTE_FRAME & ~offset_mask) | (vaddr & offset_mask);
+            if (pa >= pm_size)
+            {
+                return page_fault(vaddr, access | user | PF_RESERVED | PF_PROTECTION, cr);
+            }
+
+            uint64_t set = (access & PF_WRITE) != 0 ? PTE_ACCESSED | PTE_DIRTY : PTE_ACCESSED;
+            if ((e & set) != set)
+            {
+                __atomic_fetch_or(entry, set, __ATOMIC_RELAXED);
+            }
+
+            *leaf = (pa & PTE_FRAME) | (allowed & (PTE_WRITABLE | PTE_USER)) |
+                ((e | set) & PTE_DIRTY);
+            return 1;
+        }
+
+        if ((e & PTE_ACCESSED) == 0)
+        {
+            __atomic_fetch_or(entry, PTE_ACCESSED, __ATOMIC_RELAXED);
+        }
+        table = e & PTE_FRAME;
+    }
+    return 0;
+}
+#endif
+
+/*======================================*/
+/*      TLB                             */
+/*======================================*/
+
+#if ENABLE_PAGE_WALK == 1 && ENABLE_TLB == 1
+
+#if (L1_DTLB_SETS & (L1_DTLB_SETS - 1)) != 0 || (L1_DTLB_WAYS & (L1_DTLB_WAYS - 1)) != 0 || \
+    (L1_ITLB_SETS & (L1_ITLB_SETS - 1)) != 0 || (L1_ITLB_WAYS & (L1_ITLB_WAYS - 1)) != 0 || \
+    (L2_TLB_SETS & (L2_TLB_SETS - 1)) != 0 || (L2_TLB_WAYS & (L2_TLB_WAYS - 1)) != 0 || \
+    L1_DTLB_WAYS > 64 || L1_ITLB_WAYS > 64 || L2_TLB_WAYS > 64
+#error "the sets and the ways of the TLBs are powers of two, at most 64 ways"
+#endif
+
+// the address spaces a core tells apart: switching among them flushes nothing
+// the least recently used one is given to a new pdbr, and its translations flushed
+#define NUM_ASID 16
+
+// tag: the page of vaddr | asid << 1 | 1 for valid, 0 for an empty entry
+// leaf: the frame and the rights as page_walk gives them
+typedef struct
+{
+    uint64_t tag;
+    uint64_t leaf;
+} tlb_entry_t;
+
+typedef struct
+{
+    tlb_entry_t *entries;   // the ways of set 0, then of set 1, ...
+    // TLB_LRU: the time each entry was last used
+    // TLB_PLRU: per set, bit n - 1 of the tree node n points to the half to replace
+    uint64_t *order;
+    uint64_t num_set;
+    uint64_t num_way;
+    uint64_t clock;
+    tlb_stats_t *stats;
+} tlb_t;
+
+typedef struct TLB_STRUCT
+{
+    tlb_t level[NUM_TLB];   // indexed by TLB_L1D, TLB_L1I, TLB_L2
+
+    // the pml4 of each asid, 0 for unused, and when it was last switched to
+    uint64_t asid_pdbr[NUM_ASID];
+    uint64_t asid_time[NUM_ASID];
+    uint64_t asid_clock;
+
+    // the address space of the entries filled: asid of pdbr
+    uint64_t pdbr;
+    uint64_t asid;
+} tlb_cache_t;
+
+static void init_level(tlb_t *t, uint64_t num_set, uint64_t num_way, tlb_stats_t *stats)
+{
+    t->entries = calloc(num_set * num_way, sizeof(tlb_entry_t));
+#if TLB_REPLACEMENT == TLB_LRU
+    t->order = calloc(num_set * num_way, sizeof(uint64_t));
+#else
+    t->order = calloc(num_set, sizeof(uint64_t));
+#endif
+    if (t->entries == NULL || t->order == NULL)
+    {
+        printf("cannot allocate the TLB of %lu entries\n", num_set * num_way);
+        exit(0);
+    }
+    t->num_set = num_set;
+    t->num_way = num_way;
+    t->stats = stats;
+}
+
+// the way of the set just used is made the last to replace
+static inline void touch(tlb_t *t, uint64_t set, uint64_t way)
+{
+#if TLB_REPLACEMENT == TLB_LRU
+    t->order[set * t->num_way + way] = ++ t->clock;
+#else
+    // from the root, each node points away from the half holding way
+    uint64_t bits = t->order[set];
+    uint64_t node = 1;
+    for (uint64_t half = t->num_way >> 1; half > 0; half >>= 1)
+    {
+        uint64_t right = (way & half) != 0;
+        bits = right ? bits & ~(1ULL << (node - 1)) : bits | (1ULL << (node - 1));
+        node = node * 2 + right;
+    }
+    t->order[set] = bits;
+#endif
+}
+
+static inline uint64_t victim(tlb_t *t, uint64_t set)
+{
+    tlb_entry_t *ways = &(t->entries[set * t->num_way]);
+    for (uint64_t w = 0; w < t->num_way; ++ w)
+    {
+        if (ways[w].tag == 0)
+        {
+            return w;
+        }
+    }
+
+#if TLB_REPLACEMENT == TLB_LRU
+    uint64_t *time = &(t->order[set * t->num_way]);
+    uint64_t way = 0;
+    for (uint64_t w = 1; w < t->num_way; ++ w)
+    {
+        if (time[w] < time[way])
+        {
+            way = w;
+        }
+    }
+    return way;
+#else
+    uint64_t node = 1;
+    while (node < t->num_way)
+    {
+        node = node * 2 + ((t->order[set] >> (node - 1)) & 1);
+    }
+    return node - t->num_way;
+#endif
+}
+
+// the entry of tag if it allows the rights needed, else NULL
+static inline tlb_entry_t *lookup(tlb_t *t, uint64_t vaddr, uint64_t tag, uint64_t need)
+{
+    uint64_t set = (vaddr / PAGE_SIZE) & (t->num_set - 1);
+    tlb_entry_t *ways = &(t->entries[set * t->num_way]);
+    for (uint64_t w = 0; w < t->num_way; ++ w)
+    {
+        if (ways[w].tag == tag && (ways[w].leaf & need) == need)
+        {
+            touch(t, set, w);
+            t->stats->num_hit ++;
+            return &(ways[w]);
+        }
+    }
+    t->stats->num_miss ++;
+    return NULL;
+}
+
+static inline void fill(tlb_t *t, uint64_t vaddr, uint64_t tag, uint64_t leaf)
+{
+    uint64_t set = (vaddr / PAGE_SIZE) & (t->num_set - 1);
+    tlb_entry_t *ways = &(t->entries[set * t->num_way]);
+
+    // an entry with fewer rights is replaced in place
+    uint64_t way = t->num_way;
+    for (uint64_t w = 0; w < t->num_way; ++ w)
+    {
+        if (ways[w].tag == tag)
+        {
+            way = w;
+            break;
+        }
+    }
+    if (way == t->num_way)
+    {
+        way = victim(t, set);
+        if (ways[way].tag != 0)
+        {
+            t->stats->num_evict ++;
+        }
+    }
+
+    ways[way].tag = tag;
+    ways[way].leaf = leaf;
+    touch(t, set, way);
+}
+
+// invalidate the entries of asid, and of the page of vaddr only unless all_pages
+static void invalidate(tlb_t *t, uint64_t asid, uint64_t vaddr, int all_pages)
+{
+    for (uint64_t i = 0; i < t->num_set * t->num_way; ++ i)
+    {
+        uint64_t tag = t->entries[i].tag;
+        if (tag != 0 && ((tag >> 1) & (PAGE_SIZE / 2 - 1)) == asid &&
+            (all_pages == 1 || (tag & ~(PAGE_SIZE - 1)) == (vaddr & ~(PAGE_SIZE - 1))))
+        {
+            t->entries[i].tag = 0;
+        }
+    }
+    t->stats->num_flush ++;
+}
+
+static void invalidate_all(tlb_cache_t *tlb, uint64_t asid, uint64_t vaddr, int all_pages)
+{
+    for (int i = 0; i < NUM_TLB; ++ i)
+    {
+        invalidate(&(tlb->level[i]), asid, vaddr, all_pages);
+    }
+}
+
+// the asid of pml4, NUM_ASID if it has none
+static uint64_t find_asid(tlb_cache_t *tlb, uint64_t pml4)
+{
+    for (uint64_t i = 0; i < NUM_ASID; ++ i)
+    {
+        if (tlb->asid_pdbr[i] == pml4)
+        {
+            return i;
+        }
+    }
+    return NUM_ASID;
+}
+
+// pdbr has changed since the last translation
+static void switch_address_space(core_t *cr)
+{
+    tlb_cache_t *tlb = cr->tlb;
+    uint64_t asid = find_asid(tlb, cr->pdbr);
+    if (asid == NUM_ASID)
+    {
+        asid = 0;
+        for (uint64_t i = 1; i < NUM_ASID; ++ i)
+        {
+            if (tlb->asid_time[i] < tlb->asid_time[asid])
+            {
+                asid = i;
+            }
+        }
+        if (tlb->asid_pdbr[asid] != 0)
+        {
+            invalidate_all(tlb, asid, 0, 1);
+        }
+        tlb->asid_pdbr[asid] = cr->pdbr;
+    }
+
+    tlb->asid_time[asid] = ++ tlb->asid_clock;
+    tlb->pdbr = cr->pdbr;
+    tlb->asid = asid;
+}
+
+// look vaddr up in the L1 then the L2 TLB, and walk the page tables on a miss
+// the entries are 4 KiB: a 2 MiB or 1 GiB page is cached by its 4 KiB pages
+static int tlb_translate(uint64_t vaddr, uint64_t access, core_t *cr, uint64_t *leaf)
+{
+    tlb_cache_t *tlb = cr->tlb;
+    if (cr->pdbr != tlb->pdbr)
+    {
+        switch_address_space(cr);
+    }
+
+    uint64_t tag = (vaddr & ~(PAGE_SIZE - 1)) | (tlb->asid << 1) | 1;
+    uint64_t need = ((access & PF_WRITE) != 0 ? PTE_WRITABLE | PTE_DIRTY : 0) |
+        (cr->cpl == 3 ? PTE_USER : 0);
+    tlb_t *l1 = &(tlb->level[(access & PF_FETCH) != 0 ? TLB_L1I : TLB_L1D]);
+
+    tlb_entry_t *e = lookup(l1, vaddr, tag, need);
+    if (e != NULL)
+    {
+        *leaf = e->leaf;
+        return 1;
+    }
+
+    e = lookup(&(tlb->level[TLB_L2]), vaddr, tag, need);
+    if (e != NULL)
+    {
+        *leaf = e->leaf;
+    }
+    else
+    {
+        // missing, or without the rights needed: the walk sets the dirty bit or faults
+        if (page_walk(vaddr, access, cr, leaf) == 0)
+        {
+            return 0;
+        }
+        fill(&(tlb->level[TLB_L2]), vaddr, tag, *leaf);
+    }
+    fill(l1, vaddr, tag, *leaf);
+    return 1;
+}
+
+static void model_init(core_t *cr)
+{
+    cr->tlb = calloc(1, sizeof(tlb_cache_t));
+    if (cr->tlb == NULL)
+    {
+        printf("cannot allocate the TLBs of core %lu\n", cr->id);
+        exit(0);
+    }
+    init_level(&(cr->tlb->level[TLB_L1D]), L1_DTLB_SETS, L1_DTLB_WAYS, &(cr->tlb_stats[TLB_L1D]));
+    init_level(&(cr->tlb->level[TLB_L1I]), L1_ITLB_SETS, L1_ITLB_WAYS, &(cr->tlb_stats[TLB_L1I]));
+    init_level(&(cr->tlb->level[TLB_L2]), L2_TLB_SETS, L2_TLB_WAYS, &(cr->tlb_stats[TLB_L2]));
+}
+
+static void model_free(core_t *cr)
+{
+    for (int j = 0; j < NUM_TLB; ++ j)
+    {
+        free(cr->tlb->level[j].entries);
+        free(cr->tlb->level[j].order);
+    }
+    free(cr->tlb);
+    cr->tlb = NULL;
+}
+
+static void model_flush(core_t *cr)
+{
+    tlb_cache_t *tlb = cr->tlb;
+    for (int i = 0; i < NUM_TLB; ++ i)
+    {
+        tlb_t *t = &(tlb->level[i]);
+        memset(t->entries, 0, t->num_set * t->num_way * sizeof(tlb_entry_t));
+        t->stats->num_flush ++;
+    }
+    memset(tlb->asid_pdbr, 0, sizeof(tlb->asid_pdbr));
+    // the next translation looks the asid up again
+    tlb->pdbr = 0;
+}
+
+// the pages of the address space at pml4: all of them, or the page of vaddr only
+static void model_flush_pages(core_t *cr, uint64_t pml4, uint64_t vaddr, int all_pages)
+{
+    uint64_t asid = find_asid(cr->tlb, pml4);
+    if (asid != NUM_ASID)
+    {
+        invalidate_all(cr->tlb, asid, vaddr, all_pages);
+    }
+}
+
+#else
+
+static inline void model_init(core_t *cr)
+{
+}
+
+static inline void model_free(core_t *cr)
+{
+}
+
+static inline void model_flush(core_t *cr)
+{
+}
+
+static inline void model_flush_pages(core_t *cr, uint64_t pml4, uint64_t vaddr, int all_pages)
+{
+}
+
+#endif
+
+/*======================================*/
+/*      soft MMU                        */
+/*======================================*/
+
+// the entries hold the translations of the address space at pdbr for the cpl
+// so they are flushed with the TLBs, and when the host changes pdbr or cpl
+void soft_tlb_flush(core_t *cr)
+{
+    soft_tlb_t *soft = cr->soft_tlb;
+    memset(soft->entries, 0xff, sizeof(soft->entries));
+    soft->pdbr = cr->pdbr;
+    soft->cpl = cr->cpl;
+}
+
+void soft_tlb_sync(core_t *cr)
+{
+    if (cr->pdbr != cr->soft_tlb->pdbr || cr->cpl != cr->soft_tlb->cpl)
+    {
+        soft_tlb_flush(cr);
+    }
+}
+
+static void soft_tlb_flush_page(core_t *cr, uint64_t vaddr)
+{
+    soft_tlb_entry_t *e = &(cr->soft_tlb->entries[(vaddr / PAGE_SIZE) % NUM_SOFT_TLB_ENTRY]);
+    if ((e->read_tag & ~(PAGE_SIZE - 1)) == (vaddr & ~(PAGE_SIZE - 1)))
+    {
+        memset(e, 0xff, sizeof(soft_tlb_entry_t));
+    }
+}
+
+// the page of vaddr only: the callers split an access crossing into the next page
+uint64_t soft_tlb_fill(uint64_t vaddr, uint64_t access, core_t *cr)
+{
+    uint64_t paddr;
+    if (translate_va(vaddr, access, cr, &paddr) == 0)
+    {
+        raise_page_fault(cr);
+    }
+
+    // a load only tells the page readable: the first store fills the entry again
+    // to have the page checked writable and marked dirty
+    soft_tlb_entry_t *e = &(cr->soft_tlb->entries[(vaddr / PAGE_SIZE) % NUM_SOFT_TLB_ENTRY]);
+    uint64_t page = vaddr & ~(PAGE_SIZE - 1);
+    if (e->read_tag != page)
+    {
+        e->write_tag = SOFT_TLB_INVALID;
+    }
+    e->read_tag = page;
+    if ((access & PF_WRITE) != 0)
+    {
+        e->write_tag = page;
+    }
+    e->pa_offset = (paddr & ~(PAGE_SIZE - 1)) - page;
+    e->host_offset = (uintptr_t)cr->machine->pm + e->pa_offset;
+    return paddr;
+}
+
+/*======================================*/
+/*      TLB flushes                     */
+/*======================================*/
+
+void init_tlb(machine_t *m)
+{
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &(m->cores[i]);
+        cr->soft_tlb = malloc(sizeof(soft_tlb_t));
+        if (cr->soft_tlb == NULL)
+        {
+            printf("cannot allocate the soft MMU of core %d\n", i);
+            exit(0);
+        }
+        soft_tlb_flush(cr);
+        model_init(cr);
+    }
+}
+
+void free_tlb(machine_t *m)
+{
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &(m->cores[i]);
+        model_free(cr);
+        free(cr->soft_tlb);
+        cr->soft_tlb = NULL;
+    }
+}
+
+void tlb_flush(core_t *cr)
+{
+    soft_tlb_flush(cr);
+    model_flush(cr);
+}
+
+void tlb_flush_address_space(core_t *cr)
+{
+    soft_tlb_flush(cr);
+    model_flush_pages(cr, cr->pdbr, 0, 1);
+}
+
+void tlb_flush_page(core_t *cr, uint64_t vaddr)
+{
+    soft_tlb_flush_page(cr, vaddr);
+    model_flush_pages(cr, cr->pdbr, vaddr, 0);
+}
+
+static void flush_mapping(core_t *cr, uint64_t pml4, uint64_t vaddr)
+{
+    if (pml4 == cr->soft_tlb->pdbr)
+    {
+        soft_tlb_flush_page(cr, vaddr);
+    }
+    model_flush_pages(cr, pml4, vaddr, 0);
+}
+
+/*======================================*/
+/*      address translation             */
+/*======================================*/
+
+int translate_va(uint64_t vaddr, uint64_t access, core_t *cr, uint64_t *paddr)
+{
+#if ENABLE_PAGE_WALK == 1
+    if (cr->pdbr != 0)
+    {
+        uint64_t leaf;
+#if ENABLE_TLB == 1
+        if (tlb_translate(vaddr, access, cr, &leaf) == 0)
+#else
+        if (page_walk(vaddr, access, cr, &leaf) == 0)
+#endif
+        {
+            return 0;
+        }
+        *paddr = (leaf & PTE_FRAME) | (vaddr & (PAGE_SIZE - 1));
+        return 1;
+    }
+#endif
+    *paddr = vaddr & (cr->machine->pm_size - 1);
+    return 1;
+}
+
+static inline uint64_t translate(uint64_t vaddr, uint64_t access, core_t *cr)
+{
+    uint64_t paddr;
+    if (translate_va(vaddr, access, cr, &paddr) == 0)
+    {
+        raise_page_fault(cr);
+    }
+    return paddr;
+}
+
+uint64_t va2pa(uint64_t vaddr, core_t* cr)
+{
+    return translate(vaddr, 0, cr);
+}
+
+uint64_t va2pa_write(uint64_t vaddr, core_t* cr)
+{
+    return translate(vaddr, PF_WRITE, cr);
+}
+
+uint64_t va2pa_fetch(uint64_t vaddr, core_t* cr)
+{
+    return translate(vaddr, PF_FETCH, cr);
+}
+
+/*======================================*/
+/*      page table construction         */
+/*======================================*/
+
+void map_page(uint64_t pml4, uint64_t vaddr, uint64_t paddr, uint64_t flags,
+    uint64_t *next_frame, core_t *cr)
+{
+    uint64_t table = pml4 & PTE_FRAME;
+    for (int level = 0; level < PAGE_TABLE_LEVEL - 1; ++ level)
+    {
+        uint64_t entry_addr = table + ((vaddr >> (39 - 9 * level)) & 0x1ff) * 8;
+        uint64_t e = read64bits_dram(entry_addr, cr);
+        assert((e & PTE_PRESENT) == 0 || level == 0 || (e & PTE_HUGE) == 0);
+
+        if ((e & PTE_PRESENT) == 0)
+        {
+            assert(*next_frame % PAGE_SIZE == 0 && *next_frame + PAGE_SIZE <= cr->machine->pm_size);
+            memset_dram(*next_frame, 0, PAGE_SIZE, cr);
+            e = *next_frame | PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+            write64bits_dram(entry_addr, e, cr);
+            *next_frame += PAGE_SIZE;
+        }
+        table = e & PTE_FRAME;
+    }
+
+    uint64_t entry_addr = table + ((vaddr >> 12) & 0x1ff) * 8;
+    write64bits_dram(entry_addr, (paddr & PTE_FRAME) | PTE_PRESENT |
+        (flags & (PTE_WRITABLE | PTE_USER)), cr);
+
+    // the walks read the memory, not the store buffer
+    flush_store_buffer(cr);
+    flush_mapping(cr, pml4, vaddr);
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <headers/machine.h>
+
+/*======================================*/
+/*      physical memory                 */
+/*======================================*/
+
+// reserved, not allocated: the host gives a zero page on the first write to it
+static uint8_t *map_physical_memory(uint64_t size)
+{
+    uint64_t page_size = 1 << PHYSICAL_PAGE_OFFSET_LENGTH;
+    if (size < page_size || (size & (size - 1)) != 0)
+    {
+        printf("physical memory of 0x%lx bytes: not a power of two of pages\n", size);
+        exit(0);
+    }
+
+    void *pm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pm == MAP_FAILED)
+    {
+        printf("cannot map 0x%lx bytes of physical memory\n", size);
+        exit(0);
+    }
+#ifdef MADV_HUGEPAGE
+    // fewer host TLB misses on the large memories, only a hint
+    madvise(pm, size, MADV_HUGEPAGE);
+#endif
+    return (uint8_t *)pm;
+}
+
+// the words of the bitmap of the frames written
+static uint64_t num_written_words(uint64_t size)
+{
+    uint64_t num_frames = size >> PHYSICAL_PAGE_OFFSET_LENGTH;
+    return (num_frames + 63) / 64;
+}
+
+/*======================================*/
+/*      machine                         */
+/*======================================*/
+
+void init_machine(machine_t *m, uint64_t pm_size)
+{
+    memset(m, 0, sizeof(machine_t));
+    m->pm = map_physical_memory(pm_size);
+    m->pm_size = pm_size;
+    m->written_frames = calloc(num_written_words(pm_size), sizeof(uint64_t));
+    if (m->written_frames == NULL)
+    {
+        printf("cannot allocate the written frames of 0x%lx bytes\n", pm_size);
+        exit(0);
+    }
+
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        m->cores[i].machine = m;
+        m->cores[i].id = i;
+    }
+
+    init_cpu_cache(m);
+    init_tlb(m);
+}
+
+void free_machine(machine_t *m)
+{
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        if (m->threads[i].running == 1)
+        {
+            stop_core(m, i);
+            join_core(m, i);
+        }
+    }
+
+    free_cpu_cache(m);
+    free_tlb(m);
+    munmap(m->pm, m->pm_size);
+    m->pm = NULL;
+    free(m->written_frames);
+    m->written_frames = NULL;
+}
+
+void reset_machine(machine_t *m)
+{
+    for (int i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &(m->cores[i]);
+        struct INST_CACHE_STRUCT *inst_cache = cr->inst_cache;
+        struct BLOCK_CACHE_STRUCT *block_cache = cr->block_cache;
+        struct JIT_BUFFER_STRUCT *jit = cr->jit;
+        struct TLB_STRUCT *tlb = cr->tlb;
+        soft_tlb_t *soft_tlb = cr->soft_tlb;
+
+        // the translations are gone with the page tables
+        tlb_flush(cr);
+
+        memset(cr, 0, sizeof(core_t));
+        cr->machine = m;
+        cr->id = i;
+        cr->inst_cache = inst_cache;
+        cr->block_cache = block_cache;
+        cr->jit = jit;
+        cr->tlb = tlb;
+        cr->soft_tlb = soft_tlb;
+
+        // the code decoded by the core is gone with the memory
+        cr->flush_pending = 1;
+    }
+
+    // back to the zero pages, without touching the memory never written
+    madvise(m->pm, m->pm_size, MADV_DONTNEED);
+    memset(m->written_frames, 0, num_written_words(m->pm_size) * sizeof(uint64_t));
+    memset(&(m->sram), 0, sizeof(m->sram));
+}
+
+/*======================================*/
+/*      core threads                    */
+/*======================================*/
+
+static void *run_core_thread(void *arg)
+{
+    core_t *cr = (core_t *)arg;
+    core_thread_t *t = &(cr->machine->threads[cr->id]);
+
+    t->reason = RUN_EXIT_BUDGET;
+    t->num_inst = 0;
+    while (__atomic_load_n(&(t->stop), __ATOMIC_ACQUIRE) == 0)
+    {
+        run_result_t result = run_until(cr, CORE_THREAD_QUANTUM, 0, 0);
+        t->reason = result.reason;
+        t->num_inst += result.num_inst;
+
+        if (result.reason == RUN_EXIT_HALT || result.reason == RUN_EXIT_INVALID ||
+            result.reason == RUN_EXIT_PAGE_FAULT || result.reason == RUN_EXIT_BUS_ERROR ||
+            result.reason == RUN_EXIT_SPLIT_LOCK)
+        {
+            break;
+        }
+    }
+
+    // nothing runs the core any more to write its stores
+    flush_store_buffer(cr);
+    return NULL;
+}
+
+void start_core(machine_t *m, uint64_t id)
+{
+    core_thread_t *t = &(m->threads[id]);
+    if (t->running == 1)
+    {
+        printf("core %lu is already running\n", id);
+        exit(0);
+    }
+
+    t->stop = 0;
+    t->running = 1;
+    if (pthread_create(&(t->thread), NULL, run_core_thread, &(m->cores[id])) != 0)
+    {
+        printf("cannot create the thread of core %lu\n", id);
+        exit(0);
+    }
+}
+
+void stop_core(machine_t *m, uint64_t id)
+{
+    __atomic_store_n(&(m->threads[id].stop), 1, __ATOMIC_RELEASE);
+}
+
+void join_core(machine_t *m, uint64_t id)
+{
+    core_thread_t *t = &(m->threads[id]);
+    if (t->running == 0)
+    {
+        return;
+    }
+
+    pthread_join(t->thread, NULL);
+    t->running = 0;
+}
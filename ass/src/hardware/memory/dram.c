@@ -1,69 +1,390 @@
-#include<headers/cpu.h>
-#include<headers/memory.h>
-#include<headers/common.h>
-#include<assert.h>
-#include<string.h>
-
-uint64_t read64bits_dram(uint64_t paddr, core_t *cr)
-{
-    if (DEBUG_ENABLE_SRAM_CACHE == 1)
-    {
-        return 0x0;
-    }
-
-    uint64_t val = 0x0;
-
-    val += (((uint64_t)pm[paddr + 0]) << 0);
-    val += (((uint64_t)pm[paddr + 1]) << 8);
-    val += (((uint64_t)pm[paddr + 2]) << 16);
-    val += (((uint64_t)pm[paddr + 3]) << 24);
-    val += (((uint64_t)pm[paddr + 4]) << 32);
-    val += (((uint64_t)pm[paddr + 5]) << 40);
-    val += (((uint64_t)pm[paddr + 6]) << 48);
-    val += (((uint64_t)pm[paddr + 7]) << 56);
-
-    return val;
-}
-void write64bits_dram(uint64_t paddr, uint64_t data, core_t *cr)
-{
-    if (DEBUG_ENABLE_SRAM_CACHE == 1)
-    {
-        return;
-    }
-    // little-endian
-    pm[paddr + 0] = (data >> 0) & 0xff;
-    pm[paddr + 1] = (data >> 8) & 0xff;
-    pm[paddr + 2] = (data >> 16) & 0xff;
-    pm[paddr + 3] = (data >> 24) & 0xff;
-    pm[paddr + 4] = (data >> 32) & 0xff;
-    pm[paddr + 5] = (data >> 40) & 0xff;
-    pm[paddr + 6] = (data >> 48) & 0xff;
-    pm[paddr + 7] = (data >> 56) & 0xff;
-}
-
-void readinst_dram(uint64_t paddr, char *buf, core_t *cr)
-{
-    for (int i = 0; i < MAX_INSTRUCTION_CHAR; i++)
-    {
-        buf[i] = (char)pm[paddr + i];
-    }
-
-}
-
-void writeinst_dram(uint64_t paddr, const char *str, core_t *cr)
-{
-    int len = strlen(str);
-    assert(len < MAX_INSTRUCTION_CHAR);
-
-    for (int i = 0; i < MAX_INSTRUCTION_CHAR; i++)
-    {
-        if (i < len)
-        {
-            pm[paddr + i] = (uint8_t)str[i];
-        }
-        else
-        {
-            pm[paddr + i] = 0;
-        }
-    }
-}
+#include<headers/cpu.h>
+#include<headers/memory.h>
+#include<headers/machine.h>
+#include<headers/common.h>
+#include<assert.h>
+#include<string.h>
+#include<stdio.h>
+#include<stdlib.h>
+
+/*======================================*/
+/*      store buffer                    */
+/*======================================*/
+
+// x86-TSO: the stores of a core reach the memory in program order but later
+// than its own loads, which read the newest buffered store of their bytes
+
+// record the frames of [paddr, paddr + len) as written, for the checksums of the memory
+// a bit is set once per frame: the stores after it only read the word
+static inline void mark_written(uint64_t paddr, uint64_t len, core_t *cr)
+{
+    uint64_t *bits = cr->machine->written_frames;
+    for (uint64_t ppn = paddr / PAGE_SIZE; len > 0 && ppn <= (paddr + len - 1) / PAGE_SIZE; ++ ppn)
+    {
+        uint64_t bit = 1ULL << (ppn % 64);
+        if ((__atomic_load_n(&(bits[ppn / 64]), __ATOMIC_RELAXED) & bit) == 0)
+        {
+            __atomic_fetch_or(&(bits[ppn / 64]), bit, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline void write_pm(uint64_t paddr, uint64_t data, uint64_t width, core_t *cr)
+{
+    inst_cache_invalidate(paddr, width, cr);
+    mark_written(paddr, width, cr);
+    store_pm(&(cr->machine->pm[paddr]), data, width);
+}
+
+void drain_store_buffer(core_t *cr, uint64_t until)
+{
+    store_buffer_t *sb = &(cr->store_buffer);
+    while (sb->head < until && sb->head < sb->tail)
+    {
+        uint64_t i = sb->head % STORE_BUFFER_SIZE;
+        write_pm(sb->paddr[i], sb->data[i], sb->width[i], cr);
+        sb->head ++;
+    }
+}
+
+void flush_store_buffer(core_t *cr)
+{
+    drain_store_buffer(cr, cr->store_buffer.tail);
+}
+
+// the bytes of [paddr, paddr + width) still in the store buffer, oldest first
+static uint64_t forward_stores(uint64_t paddr, uint64_t val, uint64_t width, core_t *cr)
+{
+    store_buffer_t *sb = &(cr->store_buffer);
+    for (uint64_t n = sb->head; n < sb->tail; ++ n)
+    {
+        uint64_t i = n % STORE_BUFFER_SIZE;
+        uint64_t store = sb->paddr[i];
+        if (store + sb->width[i] <= paddr || paddr + width <= store)
+        {
+            continue;
+        }
+
+        for (uint64_t k = 0; k < sb->width[i]; ++ k)
+        {
+            if (store + k >= paddr && store + k < paddr + width)
+            {
+                uint64_t shift = 8 * (store + k - paddr);
+                val = (val & ~(0xffULL << shift)) | (((sb->data[i] >> (8 * k)) & 0xff) << shift);
+            }
+        }
+    }
+    return val;
+}
+
+/*======================================*/
+/*      physical memory                 */
+/*======================================*/
+
+// the addresses come from the guest: one beyond the memory stops its run
+static inline void check_range(uint64_t paddr, uint64_t len, core_t *cr)
+{
+    if (paddr + len > cr->machine->pm_size || paddr + len < paddr)
+    {
+        cr->fault_paddr = paddr;
+        raise_run_exit(cr, RUN_EXIT_BUS_ERROR);
+    }
+}
+
+static inline void store_dram(uint64_t paddr, uint64_t data, uint64_t width, core_t *cr)
+{
+    if (DEBUG_ENABLE_SRAM_CACHE == 1)
+    {
+        return;
+    }
+
+#if ENABLE_STORE_BUFFER == 1
+    store_buffer_t *sb = &(cr->store_buffer);
+    if (sb->tail - sb->head == STORE_BUFFER_SIZE)
+    {
+        drain_store_buffer(cr, sb->head + 1);
+    }
+
+    // the decoded code of this core at once, the other cores when it is written
+    inst_cache_invalidate(paddr, width, cr);
+    sb->paddr[sb->tail % STORE_BUFFER_SIZE] = paddr;
+    sb->data[sb->tail % STORE_BUFFER_SIZE] = data;
+    sb->width[sb->tail % STORE_BUFFER_SIZE] = width;
+    sb->tail ++;
+#else
+    write_pm(paddr, data, width, cr);
+#endif
+}
+
+// the loads and stores of 1, 2, 4 and 8 bytes at any address
+// each is one host load or store of the physical memory by load_pm and store_pm
+#define DEFINE_DRAM_ACCESS(bits)                                                    \
+    uint##bits##_t read##bits##bits_dram(uint64_t paddr, core_t *cr)                 \
+    {                                                                               \
+        if (DEBUG_ENABLE_SRAM_CACHE == 1)                                           \
+        {                                                                           \
+            return 0x0;                                                             \
+        }                                                                           \
+                                                                                    \
+        check_range(paddr, sizeof(uint##bits##_t), cr);                            \
+        uint##bits##_t val = load_pm(&(cr->machine->pm[paddr]), sizeof(val));       \
+        if (cr->store_buffer.head != cr->store_buffer.tail)                         \
+        {                                                                           \
+            val = (uint##bits##_t)forward_stores(paddr, val, sizeof(val), cr);      \
+        }                                                                           \
+        return val;                                                                 \
+    }                                                                               \
+                                                                                    \
+    void write##bits##bits_dram(uint64_t paddr, uint##bits##_t data, core_t *cr)     \
+    {                                                                               \
+        check_range(paddr, sizeof(data), cr);                                       \
+        store_dram(paddr, data, sizeof(data), cr);                                  \
+    }
+
+DEFINE_DRAM_ACCESS(8)
+DEFINE_DRAM_ACCESS(16)
+DEFINE_DRAM_ACCESS(32)
+DEFINE_DRAM_ACCESS(64)
+
+#undef DEFINE_DRAM_ACCESS
+
+// the host atomics operate on the physical memory bytes in place (little-endian hosts)
+// so the cores on the other host threads never see a half-done update
+#define DEFINE_ATOMIC_RMW(type)                                                    \
+    static type atomic_rmw_##type(type *p, atomic_op_t op, type val)               \
+    {                                                                              \
+        switch (op)                                                                \
+        {                                                                          \
+            case ATOMIC_XCHG:                                                      \
+                return __atomic_exchange_n(p, val, __ATOMIC_SEQ_CST);              \
+            case ATOMIC_ADD:                                                       \
+                return __atomic_fetch_add(p, val, __ATOMIC_SEQ_CST);               \
+            case ATOMIC_AND:                                                       \
+                return __atomic_fetch_and(p, val, __ATOMIC_SEQ_CST);               \
+            case ATOMIC_OR:                                                        \
+                return __atomic_fetch_or(p, val, __ATOMIC_SEQ_CST);                \
+            default:                                                               \
+                return __atomic_fetch_xor(p, val, __ATOMIC_SEQ_CST);               \
+        }                                                                          \
+    }                                                                              \
+                                                                                   \
+    static int atomic_cas_##type(type *p, uint64_t *expected, type desired)        \
+    {                                                                              \
+        type e = (type)*expected;                                                  \
+        int ok = __atomic_compare_exchange_n(p, &e, desired, 0,                    \
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);                                   \
+        *expected = e;                                                             \
+        return ok;                                                                 \
+    }
+
+DEFINE_ATOMIC_RMW(uint8_t)
+DEFINE_ATOMIC_RMW(uint16_t)
+DEFINE_ATOMIC_RMW(uint32_t)
+DEFINE_ATOMIC_RMW(uint64_t)
+
+#undef DEFINE_ATOMIC_RMW
+
+// the host atomics need the natural alignment: a split lock is not emulated
+// but stops the run of the core, the others go on
+static void check_lock_alignment(uint64_t paddr, uint64_t width, core_t *cr)
+{
+    check_range(paddr, width, cr);
+    if (paddr % width != 0)
+    {
+        cr->fault_paddr = paddr;
+        raise_run_exit(cr, RUN_EXIT_SPLIT_LOCK);
+    }
+}
+
+// the locked instructions drain the store buffer first
+uint64_t atomic_rmw_dram(uint64_t paddr, atomic_op_t op, uint64_t val, uint64_t width, core_t *cr)
+{
+    check_lock_alignment(paddr, width, cr);
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, width, cr);
+    mark_written(paddr, width, cr);
+
+    void *p = &(cr->machine->pm[paddr]);
+    switch (width)
+    {
+        case 1:
+            return atomic_rmw_uint8_t((uint8_t *)p, op, (uint8_t)val);
+        case 2:
+            return atomic_rmw_uint16_t((uint16_t *)p, op, (uint16_t)val);
+        case 4:
+            return atomic_rmw_uint32_t((uint32_t *)p, op, (uint32_t)val);
+        default:
+            return atomic_rmw_uint64_t((uint64_t *)p, op, val);
+    }
+}
+
+int atomic_cas_dram(uint64_t paddr, uint64_t *expected, uint64_t desired, uint64_t width, core_t *cr)
+{
+    check_lock_alignment(paddr, width, cr);
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, width, cr);
+    mark_written(paddr, width, cr);
+
+    void *p = &(cr->machine->pm[paddr]);
+    switch (width)
+    {
+        case 1:
+            return atomic_cas_uint8_t((uint8_t *)p, expected, (uint8_t)desired);
+        case 2:
+            return atomic_cas_uint16_t((uint16_t *)p, expected, (uint16_t)desired);
+        case 4:
+            return atomic_cas_uint32_t((uint32_t *)p, expected, (uint32_t)desired);
+        default:
+            return atomic_cas_uint64_t((uint64_t *)p, expected, desired);
+    }
+}
+
+// the instruction fetches and the code writes see the stores of the core before them
+void readinst_dram(uint64_t paddr, char *buf, core_t *cr)
+{
+    check_range(paddr, MAX_INSTRUCTION_CHAR, cr);
+    flush_store_buffer(cr);
+    memcpy(buf, &(cr->machine->pm[paddr]), MAX_INSTRUCTION_CHAR);
+}
+
+void writeinst_dram(uint64_t paddr, const char *str, core_t *cr)
+{
+    uint8_t *pm = cr->machine->pm;
+
+    int len = strlen(str);
+    assert(len < MAX_INSTRUCTION_CHAR);
+    check_range(paddr, MAX_INSTRUCTION_CHAR, cr);
+
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, MAX_INSTRUCTION_CHAR, cr);
+    mark_written(paddr, MAX_INSTRUCTION_CHAR, cr);
+
+    memcpy(&(pm[paddr]), str, len);
+    memset(&(pm[paddr + len]), 0, MAX_INSTRUCTION_CHAR - len);
+}
+
+void writeinst_slot_dram(uint64_t paddr, const uint8_t *slot, core_t *cr)
+{
+    check_range(paddr, MAX_INSTRUCTION_CHAR, cr);
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, MAX_INSTRUCTION_CHAR, cr);
+    mark_written(paddr, MAX_INSTRUCTION_CHAR, cr);
+
+    memcpy(&(cr->machine->pm[paddr]), slot, MAX_INSTRUCTION_CHAR);
+}
+
+// read len bytes of machine code, the bytes beyond the physical memory are 0
+void readcode_dram(uint64_t paddr, uint8_t *buf, uint64_t len, core_t *cr)
+{
+    flush_store_buffer(cr);
+    uint8_t *pm = cr->machine->pm;
+
+    if (paddr + len <= cr->machine->pm_size)
+    {
+        memcpy(buf, &(pm[paddr]), len);
+        return;
+    }
+    for (uint64_t i = 0; i < len; ++ i)
+    {
+        buf[i] = paddr + i < cr->machine->pm_size ? pm[paddr + i] : 0;
+    }
+}
+
+void writecode_dram(uint64_t paddr, const uint8_t *code, uint64_t len, core_t *cr)
+{
+    check_range(paddr, len, cr);
+
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, len, cr);
+    mark_written(paddr, len, cr);
+
+    memcpy(&(cr->machine->pm[paddr]), code, len);
+}
+
+/*======================================*/
+/*      bulk operations                 */
+/*======================================*/
+
+// the ranges are physical: the callers split them at the page boundaries
+// they see the stores of the core before them, like the string instructions
+
+void memcpy_dram(uint64_t dst, uint64_t src, uint64_t len, core_t *cr)
+{
+    check_range(dst, len, cr);
+    check_range(src, len, cr);
+
+    flush_store_buffer(cr);
+    inst_cache_invalidate(dst, len, cr);
+    mark_written(dst, len, cr);
+
+    uint8_t *pm = cr->machine->pm;
+    memmove(&(pm[dst]), &(pm[src]), len);
+}
+
+void memset_dram(uint64_t paddr, uint8_t val, uint64_t len, core_t *cr)
+{
+    check_range(paddr, len, cr);
+
+    flush_store_buffer(cr);
+    inst_cache_invalidate(paddr, len, cr);
+    mark_written(paddr, len, cr);
+
+    memset(&(cr->machine->pm[paddr]), val, len);
+}
+
+int memcmp_dram(uint64_t paddr1, uint64_t paddr2, uint64_t len, core_t *cr)
+{
+    check_range(paddr1, len, cr);
+    check_range(paddr2, len, cr);
+
+    flush_store_buffer(cr);
+
+    uint8_t *pm = cr->machine->pm;
+    return memcmp(&(pm[paddr1]), &(pm[paddr2]), len);
+}
+
+// copy the slots of the instruction image to memory from vaddr on
+// return the number of slots loaded
+uint64_t load_inst_image(const char *filename, uint64_t vaddr, core_t *cr)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        printf("unable to open instruction image %s\n", filename);
+        exit(0);
+    }
+
+    uint64_t header[2];
+    if (fread(header, sizeof(uint64_t), 2, fp) != 2 || header[0] != INST_IMAGE_MAGIC)
+    {
+        printf("%s is not an instruction image\n", filename);
+        exit(0);
+    }
+
+    // all the slots by one read, then one copy per page
+    uint64_t len = header[1] * MAX_INSTRUCTION_CHAR;
+    uint8_t *slots = malloc(len);
+    if (slots == NULL)
+    {
+        printf("cannot allocate instruction image %s\n", filename);
+        exit(0);
+    }
+    if (fread(slots, 1, len, fp) != len)
+    {
+        printf("instruction image %s is truncated\n", filename);
+        exit(0);
+    }
+
+    uint64_t page_size = 1 << PHYSICAL_PAGE_OFFSET_LENGTH;
+    for (uint64_t done = 0; done < len; )
+    {
+        uint64_t n = page_size - (vaddr + done) % page_size;
+        n = n < len - done ? n : len - done;
+        writecode_dram(va2pa(vaddr + done, cr), slots + done, n, cr);
+        done += n;
+    }
+    free(slots);
+
+    fclose(fp);
+    return header[1];
+}
@@ -0,0 +1,59 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <headers/cpu.h>
+
+/*======================================*/
+/*      batch of guest programs         */
+/*======================================*/
+
+// bytes copied to the memory at vaddr before the job runs, with paging off
+typedef struct BATCH_SEGMENT_STRUCT
+{
+    uint64_t vaddr;
+    const uint8_t *data;    // shared read-only by the jobs
+    uint64_t len;
+} batch_segment_t;
+
+// one independent program run by the first core of a fresh machine
+typedef struct BATCH_JOB_STRUCT
+{
+    // the program image: code, data and stack contents
+    const batch_segment_t *segments;
+    uint64_t num_segments;
+
+    // the initial state of the core
+    reg_t reg;
+    uint64_t rip;
+    fetch_mode_t fetch_mode;
+    uint64_t pdbr;          // 0: no paging
+
+    // instruction budget
+    uint64_t max_num_inst;
+} batch_job_t;
+
+typedef struct BATCH_RESULT_STRUCT
+{
+    run_exit_t reason;
+    uint64_t num_inst;
+
+    // the final state of the core
+    reg_t reg;
+    uint64_t rip;
+
+    // FNV-1a of the registers, rip and flags, and of the nonzero pages of the memory
+    uint64_t reg_checksum;
+    uint64_t mem_checksum;
+} batch_result_t;
+
+// run the jobs on num_threads host threads, each with its own machine of pm_size bytes
+// the threads steal the jobs from each other when they run out of their own
+// results[i] gets the result of jobs[i]
+void run_batch(const batch_job_t *jobs, uint64_t num_jobs, uint64_t num_threads,
+    uint64_t pm_size, batch_result_t *results);
+
+// write one line per job: index, reason, instructions, rip and the checksums
+void write_batch_results(const char *filename, const batch_result_t *results, uint64_t num_jobs);
+
+#endif
@@ -1,30 +1,130 @@
-#ifndef DEBUG_H
-#define DEBUG_H
-
-#include <stdint.h>
-
-#define DEBUG_INSTRUCTION    0x1
-#define DEBUG_REGISTER       0x2
-#define DEBUG_PRINTSTACK     0x4
-#define DEBUG_PRINTCACHESET  0x8
-#define DEBUG_CACHEDETAILS   0x10
-#define DEBUG_MMU            0x20
-#define DEBUG_LINKER         0x40
-#define DEBUG_LOADER         0x80
-#define DEBUG_PARSEINST      0x100
-
-#define DEBUG_VERBOSE_SET    0x41
-// do page walk
-#define DEBUG_ENABLE_PAGE_WALK  0
-
-// use sram cache for memory access
-#define DEBUG_ENABLE_SRAM_CACHE 0
-
-uint64_t debug_printf(uint64_t open_set, const char *format, ...);
-
-uint32_t uint2float(uint32_t u);
-
-uint64_t string2uint(const char *str);
-uint64_t string2uint_range(const char *str, int start, int end);
-
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <stdint.h>
+
+#define DEBUG_INSTRUCTION    0x1
+#define DEBUG_REGISTER       0x2
+#define DEBUG_PRINTSTACK     0x4
+#define DEBUG_PRINTCACHESET  0x8
+#define DEBUG_CACHEDETAILS   0x10
+#define DEBUG_MMU            0x20
+#define DEBUG_LINKER         0x40
+#define DEBUG_LOADER         0x80
+#define DEBUG_PARSEINST      0x100
+
+#define DEBUG_VERBOSE_SET    0x41
+// translate the addresses by the page tables at pdbr once it is set
+// 0 to map every address into the physical memory by its low bits
+#ifndef ENABLE_PAGE_WALK
+#define ENABLE_PAGE_WALK 1
+#endif
+
+// cache the translations of each core in the L1 data, L1 instruction and L2 TLBs
+// 0 to walk the page tables on every access
+#ifndef ENABLE_TLB
+#define ENABLE_TLB 1
+#endif
+
+// the sets and the ways of the TLBs, powers of two
+#ifndef L1_DTLB_SETS
+#define L1_DTLB_SETS 16
+#endif
+#ifndef L1_DTLB_WAYS
+#define L1_DTLB_WAYS 4
+#endif
+#ifndef L1_ITLB_SETS
+#define L1_ITLB_SETS 16
+#endif
+#ifndef L1_ITLB_WAYS
+#define L1_ITLB_WAYS 8
+#endif
+#ifndef L2_TLB_SETS
+#define L2_TLB_SETS 128
+#endif
+#ifndef L2_TLB_WAYS
+#define L2_TLB_WAYS 8
+#endif
+
+// the way replaced in a full set of a TLB
+#define TLB_LRU     0   // least recently used
+#define TLB_PLRU    1   // tree pseudo-LRU
+#ifndef TLB_REPLACEMENT
+#define TLB_REPLACEMENT TLB_LRU
+#endif
+
+// cache the page translations of the loads and stores of each core by host pointers
+// as the softmmu of QEMU: the modeled TLBs only see the accesses missing them
+// 0 to translate every access by the modeled TLBs
+#ifndef ENABLE_SOFT_MMU
+#define ENABLE_SOFT_MMU 1
+#endif
+
+// use sram cache for memory access
+#define DEBUG_ENABLE_SRAM_CACHE 0
+
+// dispatch translated blocks by computed goto (gcc labels as values)
+// 0 to call the handlers through handler_table instead
+#ifndef ENABLE_THREADED_DISPATCH
+#define ENABLE_THREADED_DISPATCH 1
+#endif
+
+// compute the condition flags only when some instruction reads them
+// 0 to compute them eagerly after each flag-setting operation
+#ifndef ENABLE_LAZY_CFLAGS
+#define ENABLE_LAZY_CFLAGS 1
+#endif
+
+// compile the hot translated blocks to host code, x86-64 hosts only
+#ifndef ENABLE_JIT
+#define ENABLE_JIT 1
+#endif
+
+#if ENABLE_JIT == 1 && !defined(__x86_64__)
+#undef ENABLE_JIT
+#define ENABLE_JIT 0
+#endif
+
+// classify the separators of an instruction slot by SSE2 compares
+// 0 to scan the slot byte by byte
+#ifndef ENABLE_SIMD_TOKENIZER
+#define ENABLE_SIMD_TOKENIZER 1
+#endif
+
+#if ENABLE_SIMD_TOKENIZER == 1 && !defined(__SSE2__)
+#undef ENABLE_SIMD_TOKENIZER
+#define ENABLE_SIMD_TOKENIZER 0
+#endif
+
+// buffer the stores of each core as x86-TSO: loads may pass the earlier stores
+// 0 to make every store visible to the other cores at once
+#ifndef ENABLE_STORE_BUFFER
+#define ENABLE_STORE_BUFFER 1
+#endif
+
+// number of executions making a block hot: the blocks run fewer times are interpreted
+#ifndef JIT_HOT_THRESHOLD
+#define JIT_HOT_THRESHOLD 1000
+#endif
+
+uint64_t debug_printf(uint64_t open_set, const char *format, ...);
+
+uint32_t uint2float(uint32_t u);
+
+typedef enum
+{
+    CONVERT_OK,
+    CONVERT_INVALID,    // not a decimal or 0x hexadecimal number
+    CONVERT_OVERFLOW,   // out of the range of uint64_t (int64_t if negative)
+} convert_status_t;
+
+// report the malformed input instead of exiting
+convert_status_t string2uint_checked(const char *str, int start, int end, uint64_t *value);
+uint64_t string2uint_batch(const char **strs, uint64_t count, uint64_t *values,
+    convert_status_t *status);
+
+// exit on the malformed input
+uint64_t string2uint(const char *str);
+uint64_t string2uint_range(const char *str, int start, int end);
+
 #endif
\ No newline at end of file
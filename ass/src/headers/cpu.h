@@ -1,301 +1,613 @@
-#ifndef CPU_H
-#define CPU_H
-#include <stdlib.h>
-#include <stdint.h>
-
-/*======================================*/
-/*      registers                       */
-/*======================================*/
-
-// struct of registers in each core
-// resource accessible to the core itself only
-
-typedef struct REGISTER_STRUCT 
-{
-    // return value
-    union 
-    {
-        uint64_t rax;
-        uint32_t eax;
-        uint16_t ax;
-        struct 
-        { 
-            uint8_t al; 
-            uint8_t ah; 
-        };
-    };
-
-    // callee saved
-    union 
-    {
-        uint64_t rbx;
-        uint32_t ebx;
-        uint16_t bx;
-        struct 
-        { 
-            uint8_t bl;
-            uint8_t bh;
-        };
-    };
-
-    // 4th argument
-    union 
-    {
-        uint64_t rcx;
-        uint32_t ecx;
-        uint16_t cx;
-        struct 
-        { 
-            uint8_t cl;
-            uint8_t ch;
-        };
-    };
-    // 3th argument
-    union 
-    {
-        uint64_t rdx;
-        uint32_t edx;
-        uint16_t dx;
-        struct 
-        { 
-            uint8_t dl;
-            uint8_t dh;
-        };
-    };
-    // 2nd argument
-    union 
-    {
-        uint64_t rsi;
-        uint32_t esi;
-        uint16_t si;
-        struct 
-        { 
-            uint8_t sil;
-            uint8_t sih;
-        };
-    };
-    // 1st argument
-    union 
-    {
-        uint64_t rdi;
-        uint32_t edi;
-        uint16_t di;
-        struct 
-        { 
-            uint8_t dil;
-            uint8_t dih;
-        };
-    };
-
-    // callee saved frame pointer
-    union 
-    {
-        uint64_t rbp;
-        uint32_t ebp;
-        uint16_t bp;
-        struct 
-        { 
-            uint8_t bpl;
-            uint8_t bph;
-        };
-    };
-    // stack pointer
-    union 
-    {
-        uint64_t rsp;
-        uint32_t esp;
-        uint16_t sp;
-        struct 
-        { 
-            uint8_t spl;
-            uint8_t sph;
-        };
-    };
-
-    // 5th argument
-    union 
-    {
-        uint64_t r8;
-        uint32_t r8d;
-        uint16_t r8w;
-        uint8_t  r8b;
-    };
-    // 6th argument
-    union 
-    {
-        uint64_t r9;
-        uint32_t r9d;
-        uint16_t r9w;
-        uint8_t  r9b;
-    };
-
-    // caller saved
-    union 
-    {
-        uint64_t r10;
-        uint32_t r10d;
-        uint16_t r10w;
-        uint8_t  r10b;
-    };
-    // caller saved
-    union 
-    {
-        uint64_t r11;
-        uint32_t r11d;
-        uint16_t r11w;
-        uint8_t  r11b;
-    };
-
-    // callee saved
-    union 
-    {
-        uint64_t r12;
-        uint32_t r12d;
-        uint16_t r12w;
-        uint8_t  r12b;
-    };
-    // callee saved
-    union 
-    {
-        uint64_t r13;
-        uint32_t r13d;
-        uint16_t r13w;
-        uint8_t  r13b;
-    };
-    // callee saved
-    union 
-    {
-        uint64_t r14;
-        uint32_t r14d;
-        uint16_t r14w;
-        uint8_t  r14b;
-    };
-    // callee saved
-    union 
-    {
-        uint64_t r15;
-        uint32_t r15d;
-        uint16_t r15w;
-        uint8_t  r15b;
-    };
-} reg_t;
-
-typedef union CPU_FLAGS_STRUCT
-{
-    uint64_t _cpu_flag_value;
-    struct 
-    {
-         // carry flag: detect overflow for unsigned operations
-        uint16_t CF;
-        // zero flag: result is zero
-        uint16_t ZF;
-        // sign flag: result is negative: highest bit
-        uint16_t SF;
-        // overflow flag: detect overflow for signed operations
-        uint16_t OF;
-    };
-}cpu_flag_t;
-
-typedef struct CORE_STRUCT
-{
-    // program counter or instruction pointer
-    union 
-    {
-        uint64_t rip;
-        uint32_t eip;
-    };
-
-    // condition code flags of most recent (latest) operation
-    // condition codes will only be set by the following integer arithmetic instructions
-
-    /* integer arithmetic instructions
-        inc     increment 1
-        dec     decrement 1
-        neg     negate
-        not     complement
-        ----------------------------
-        add     add
-        sub     subtract
-        imul    multiply
-        xor     exclusive or
-        or      or
-        and     and
-        ----------------------------
-        sal     left shift
-        shl     left shift (same as sal)
-        sar     arithmetic right shift
-        shr     logical right shift
-    */
-
-    /* comparison and test instructions
-        cmp     compare
-        test    test
-    */
-
-    cpu_flag_t flags;
-
-    // register files
-    reg_t       reg;
-    uint64_t    pdbr;   // page directory base register
-} core_t;
-
-#define NUM_CORE 1
-core_t cores[NUM_CORE];
-
-uint64_t ACTIVE_CORE;
-
-#define MAX_INSTRUCTION_CHAR 64
-#define NUM_INSTRTYPE 14
-
-typedef enum INST_OPERATION
-{
-    INST_MOV,
-    INST_PUSH,
-    INST_POP,
-    INST_LEAVE,
-    INST_CALL,
-    INST_RET,
-    INST_ADD,
-    INST_SUB,
-    INST_CMP,
-    INST_JNE,
-    INST_JMP,
-}op_t;
-
-typedef enum OPERAND_TYPE
-{
-    EMPTY,
-    IMM,
-    REG,
-    MEM_IMM,
-    MEM_REG1,
-    MEM_IMM_REG1,
-    MEM_REG1_REG2,
-    MEM_IMM_REG1_REG2,
-    MEM_REG2_SCAL,
-    MEM_IMM_REG2_SCAL,
-    MEM_REG1_REG2_SCAL,
-    MEM_IMM_REG1_REG2_SCAL,
-} od_type_t;
-
-typedef struct OPERAND_STRUCT
-{
-    od_type_t type;
-    uint64_t imm;
-    uint64_t scal;
-    uint64_t reg1;
-    uint64_t reg2;
-} od_t;
-
-typedef struct INST_STRUCT
-{
-    op_t op;    // enum of operators. e.g. mov, call, etc.
-    od_t src;   // operand src of instruction
-    od_t dst;   // operand dst of instruction
-} inst_t;
-
-void instruction_cycle(core_t *cr);
-
-uint64_t va2pa(uint64_t vaddr, core_t *cr);
-
+#ifndef CPU_H
+#define CPU_H
+#include <stdlib.h>
+#include <stdint.h>
+
+/*======================================*/
+/*      registers                       */
+/*======================================*/
+
+// struct of registers in each core
+// resource accessible to the core itself only
+// registers are numbered in the order of declaration: rax 0, rbx 1, ..., r15 15
+#define NUM_REG 16
+
+typedef struct REGISTER_STRUCT
+{
+    union
+    {
+        struct
+        {
+            // return value
+            union 
+            {
+                uint64_t rax;
+                uint32_t eax;
+                uint16_t ax;
+                struct 
+                { 
+                    uint8_t al; 
+                    uint8_t ah; 
+                };
+            };
+
+            // callee saved
+            union 
+            {
+                uint64_t rbx;
+                uint32_t ebx;
+                uint16_t bx;
+                struct 
+                { 
+                    uint8_t bl;
+                    uint8_t bh;
+                };
+            };
+
+            // 4th argument
+            union 
+            {
+                uint64_t rcx;
+                uint32_t ecx;
+                uint16_t cx;
+                struct 
+                { 
+                    uint8_t cl;
+                    uint8_t ch;
+                };
+            };
+            // 3th argument
+            union 
+            {
+                uint64_t rdx;
+                uint32_t edx;
+                uint16_t dx;
+                struct 
+                { 
+                    uint8_t dl;
+                    uint8_t dh;
+                };
+            };
+            // 2nd argument
+            union 
+            {
+                uint64_t rsi;
+                uint32_t esi;
+                uint16_t si;
+                struct 
+                { 
+                    uint8_t sil;
+                    uint8_t sih;
+                };
+            };
+            // 1st argument
+            union 
+            {
+                uint64_t rdi;
+                uint32_t edi;
+                uint16_t di;
+                struct 
+                { 
+                    uint8_t dil;
+                    uint8_t dih;
+                };
+            };
+
+            // callee saved frame pointer
+            union 
+            {
+                uint64_t rbp;
+                uint32_t ebp;
+                uint16_t bp;
+                struct 
+                { 
+                    uint8_t bpl;
+                    uint8_t bph;
+                };
+            };
+            // stack pointer
+            union 
+            {
+                uint64_t rsp;
+                uint32_t esp;
+                uint16_t sp;
+                struct 
+                { 
+                    uint8_t spl;
+                    uint8_t sph;
+                };
+            };
+
+            // 5th argument
+            union 
+            {
+                uint64_t r8;
+                uint32_t r8d;
+                uint16_t r8w;
+                uint8_t  r8b;
+            };
+            // 6th argument
+            union 
+            {
+                uint64_t r9;
+                uint32_t r9d;
+                uint16_t r9w;
+                uint8_t  r9b;
+            };
+
+            // caller saved
+            union 
+            {
+                uint64_t r10;
+                uint32_t r10d;
+                uint16_t r10w;
+                uint8_t  r10b;
+            };
+            // caller saved
+            union 
+            {
+                uint64_t r11;
+                uint32_t r11d;
+                uint16_t r11w;
+                uint8_t  r11b;
+            };
+
+            // callee saved
+            union 
+            {
+                uint64_t r12;
+                uint32_t r12d;
+                uint16_t r12w;
+                uint8_t  r12b;
+            };
+            // callee saved
+            union 
+            {
+                uint64_t r13;
+                uint32_t r13d;
+                uint16_t r13w;
+                uint8_t  r13b;
+            };
+            // callee saved
+            union 
+            {
+                uint64_t r14;
+                uint32_t r14d;
+                uint16_t r14w;
+                uint8_t  r14b;
+            };
+            // callee saved
+            union 
+            {
+                uint64_t r15;
+                uint32_t r15d;
+                uint16_t r15w;
+                uint8_t  r15b;
+            };
+        };
+
+        // register file indexed by the register number
+        uint64_t regs[NUM_REG];
+    };
+} reg_t;
+
+typedef union CPU_FLAGS_STRUCT
+{
+    uint64_t _cpu_flag_value;
+    struct 
+    {
+         // carry flag: detect overflow for unsigned operations
+        uint16_t CF;
+        // zero flag: result is zero
+        uint16_t ZF;
+        // sign flag: result is negative: highest bit
+        uint16_t SF;
+        // overflow flag: detect overflow for signed operations
+        uint16_t OF;
+    };
+}cpu_flag_t;
+
+// the operation setting the condition flags lazily
+typedef enum CFLAGS_OPERATION
+{
+    CFLAGS_OP_NONE,     // flags are up to date
+    CFLAGS_OP_ADD,      // val = dst + src
+    CFLAGS_OP_SUB,      // val = dst - src
+    CFLAGS_OP_LOGIC,    // val = dst & src, dst | src or dst ^ src
+    CFLAGS_OP_MUL,      // val = dst * src, signed
+} cflags_op_t;
+
+typedef struct LAZY_CFLAGS_STRUCT
+{
+    cflags_op_t op;
+    uint64_t src;
+    uint64_t dst;
+    uint64_t val;
+} lazy_cflags_t;
+
+#define MAX_NUM_BREAKPOINT 16
+
+// the cores of a machine run on host threads at the same time
+// their states are aligned to the host cache lines so they never share one
+#define HOST_CACHE_LINE_SIZE 64
+
+// the formats of the instructions in memory
+typedef enum FETCH_MODE
+{
+    FETCH_ASSEMBLY,     // MAX_INSTRUCTION_CHAR byte slots: assembly strings or pre-decoded records
+    FETCH_X86,          // x86-64 machine code
+} fetch_mode_t;
+
+// the stores of the core not yet visible to the other cores, in program order
+// head and tail count the stores from the first one, the slot is the count modulo the size
+#define STORE_BUFFER_SIZE 16
+
+typedef struct STORE_BUFFER_STRUCT
+{
+    uint64_t paddr[STORE_BUFFER_SIZE];
+    uint64_t data[STORE_BUFFER_SIZE];
+    uint8_t width[STORE_BUFFER_SIZE];  // 1, 2, 4 or 8 bytes
+    uint64_t head;      // the oldest store
+    uint64_t tail;      // the next store
+} store_buffer_t;
+
+typedef struct WALK_STATS_STRUCT
+{
+    uint64_t num_walk;
+    uint64_t num_read[4];   // entries read at each level: PML4, PDPT, PD, PT
+    uint64_t num_fault;
+} walk_stats_t;
+
+// the TLBs of a core
+#define TLB_L1D 0
+#define TLB_L1I 1
+#define TLB_L2  2
+#define NUM_TLB 3
+
+typedef struct TLB_STATS_STRUCT
+{
+    uint64_t num_hit;
+    uint64_t num_miss;
+    uint64_t num_evict;     // valid entries replaced
+    uint64_t num_flush;     // flushes reaching the TLB: all, an address space or a page
+} tlb_stats_t;
+
+// the translations of the simulator itself, not of the modeled hardware:
+// direct-mapped by the page of vaddr, filled by the accesses missing them
+#define NUM_SOFT_TLB_ENTRY 256
+
+// no vaddr masked for a lookup equals it
+#define SOFT_TLB_INVALID (~0ULL)
+
+typedef struct SOFT_TLB_ENTRY_STRUCT
+{
+    uint64_t read_tag;      // the page of vaddr if the loads may use the entry
+    uint64_t write_tag;     // the page of vaddr if the stores may use it
+    uint64_t pa_offset;     // paddr - vaddr
+    uintptr_t host_offset;  // host address - vaddr
+} soft_tlb_entry_t;
+
+typedef struct SOFT_TLB_STRUCT
+{
+    soft_tlb_entry_t entries[NUM_SOFT_TLB_ENTRY];
+    // the translation context of the entries
+    uint64_t pdbr;
+    uint64_t cpl;
+} soft_tlb_t;
+
+typedef struct CORE_STRUCT
+{
+    // program counter or instruction pointer
+    union 
+    {
+        uint64_t rip;
+        uint32_t eip;
+    };
+
+    // condition code flags of most recent (latest) operation
+    // condition codes will only be set by the following integer arithmetic instructions
+
+    /* integer arithmetic instructions
+        inc     increment 1
+        dec     decrement 1
+        neg     negate
+        not     complement
+        ----------------------------
+        add     add
+        sub     subtract
+        imul    multiply
+        xor     exclusive or
+        or      or
+        and     and
+        ----------------------------
+        sal     left shift
+        shl     left shift (same as sal)
+        sar     arithmetic right shift
+        shr     logical right shift
+    */
+
+    /* comparison and test instructions
+        cmp     compare
+        test    test
+    */
+
+    cpu_flag_t flags;
+
+    // the latest flag-setting operation not yet computed into flags
+    // call sync_cflags before reading flags from outside the CPU
+    lazy_cflags_t lazy_cflags;
+
+    // register files
+    reg_t       reg;
+    uint64_t    pdbr;   // page directory base register
+
+    // how the instructions at rip are fetched and decoded
+    fetch_mode_t fetch_mode;
+
+    // the machine owning the core: physical memory shared by all its cores
+    struct MACHINE_STRUCT *machine;
+    uint64_t    id;     // index in the cores of the machine
+
+    // the caches of the decoded code, private to the core
+    struct INST_CACHE_STRUCT *inst_cache;
+    struct BLOCK_CACHE_STRUCT *block_cache;
+    struct JIT_BUFFER_STRUCT *jit;
+
+    // the translations cached by the core
+    struct TLB_STRUCT *tlb;
+    soft_tlb_t *soft_tlb;
+
+    // set by the other cores writing the code decoded by this core
+    uint64_t    flush_pending;
+
+    // 8-byte stores waiting to be written to the physical memory
+    store_buffer_t store_buffer;
+
+    // set by hlt: the core does not run until it is cleared
+    uint64_t    halt;
+
+    // current privilege level: 3 for the user mode, checked by the page walk
+    uint64_t    cpl;
+
+    // the last page fault: the address (cr2) and the error code (PF_*)
+    uint64_t    fault_vaddr;
+    uint64_t    fault_code;
+
+    // the physical address of the last access stopping the run otherwise
+    uint64_t    fault_paddr;
+
+    // where a page fault unwinds to, NULL out of the runs
+    void        *fault_frame;
+
+    // counters of the page walks of the core
+    walk_stats_t walk_stats;
+    tlb_stats_t tlb_stats[NUM_TLB];
+
+    // rip of the instructions run_until stops before
+    uint64_t    breakpoints[MAX_NUM_BREAKPOINT];
+    uint64_t    num_breakpoints;
+} __attribute__((aligned(HOST_CACHE_LINE_SIZE))) core_t;
+
+// cores of a machine, at most 64
+#ifndef NUM_CORE
+#define NUM_CORE 4
+#endif
+
+#define MAX_INSTRUCTION_CHAR 64
+#define NUM_INSTRTYPE 33
+
+typedef enum INST_OPERATION
+{
+    INST_MOV,
+    INST_PUSH,
+    INST_POP,
+    INST_LEAVE,
+    INST_CALL,
+    INST_RET,
+    INST_ADD,
+    INST_SUB,
+    INST_CMP,
+    INST_JNE,
+    INST_JMP,
+    INST_HLT,
+    INST_LEA,
+    INST_AND,
+    INST_OR,
+    INST_XOR,
+    INST_TEST,
+    INST_IMUL,
+    INST_JE,
+    INST_JB,
+    INST_JAE,
+    INST_JBE,
+    INST_JA,
+    INST_JL,
+    INST_JGE,
+    INST_JLE,
+    INST_JG,
+    INST_NOP,
+    INST_XCHG,
+    INST_CMPXCHG,
+    INST_XADD,
+    INST_MFENCE,
+    INST_MOV_CR3,   // mov %reg,%cr3 (src) or mov %cr3,%reg (dst)
+}op_t;
+
+typedef enum OPERAND_TYPE
+{
+    EMPTY,
+    IMM,
+    REG,
+    MEM_IMM,
+    MEM_REG1,
+    MEM_IMM_REG1,
+    MEM_REG1_REG2,
+    MEM_IMM_REG1_REG2,
+    MEM_REG2_SCAL,
+    MEM_IMM_REG2_SCAL,
+    MEM_REG1_REG2_SCAL,
+    MEM_IMM_REG1_REG2_SCAL,
+} od_type_t;
+
+// width of the register operand
+typedef enum REG_WIDTH
+{
+    REG_64,     // rax
+    REG_32,     // eax
+    REG_16,     // ax
+    REG_8L,     // al
+    REG_8H,     // ah
+} reg_width_t;
+
+// register operands are encoded as (register number, width)
+// instead of host addresses, so decoded instructions do not bind to a core
+#define REG_ID(num, width)  (((uint64_t)(width) << 4) | (num))
+#define REG_NUM(id)         ((id) & 0xf)
+#define REG_WIDTH(id)       ((reg_width_t)((id) >> 4))
+
+typedef struct OPERAND_STRUCT
+{
+    od_type_t type;
+    uint64_t imm;
+    uint64_t scal;
+    uint64_t reg1;  // REG_ID
+    uint64_t reg2;  // REG_ID
+} od_t;
+
+typedef struct INST_STRUCT
+{
+    op_t op;        // enum of operators. e.g. mov, call, etc.
+    uint64_t width; // operand size in bytes: by the suffix or the register operands
+    uint64_t length; // bytes of the encoding: MAX_INSTRUCTION_CHAR for the slots
+    uint64_t lock;  // lock prefix: the read-modify-write of the memory operand is atomic
+    od_t src;       // operand src of instruction
+    od_t dst;       // operand dst of instruction
+} inst_t;
+
+void instruction_cycle(core_t *cr);
+
+// first byte of an instruction slot holding a pre-decoded record
+// instead of the assembly string
+#define INST_RECORD_MAGIC 0xff
+
+// parse the assembly string, return 0 if it is malformed
+int parse_inst_string(const char *str, inst_t *inst);
+
+// encode the decoded instruction into a MAX_INSTRUCTION_CHAR byte slot
+void pack_inst_record(const inst_t *inst, uint8_t *slot);
+
+// the longest x86-64 instruction
+#define MAX_X86_INST_LEN 15
+
+// decode the x86-64 machine code at vaddr, code holds MAX_X86_INST_LEN bytes
+// return 0 if the instruction is out of the op_t subset
+int decode_x86_inst(const uint8_t *code, uint64_t vaddr, inst_t *inst);
+
+// stop conditions of run_until besides the instruction budget, halt
+// and undecodable instructions, which always stop it
+#define RUN_STOP_RIP        0x1     // before executing stop_rip
+#define RUN_STOP_BREAKPOINT 0x2     // before executing a breakpoint of the core
+
+typedef enum RUN_EXIT
+{
+    RUN_EXIT_BUDGET,
+    RUN_EXIT_RIP,
+    RUN_EXIT_BREAKPOINT,
+    RUN_EXIT_HALT,
+    RUN_EXIT_INVALID,   // rip points to an undecodable instruction
+    RUN_EXIT_PAGE_FAULT,    // rip points to the faulting instruction, see fault_vaddr
+    RUN_EXIT_BUS_ERROR,     // rip points to an instruction accessing beyond the memory, see fault_paddr
+    RUN_EXIT_SPLIT_LOCK,    // rip points to a locked instruction not naturally aligned, see fault_paddr
+} run_exit_t;
+
+typedef struct RUN_RESULT_STRUCT
+{
+    run_exit_t reason;
+    uint64_t num_inst;  // number of instructions executed
+} run_result_t;
+
+run_result_t run_until(core_t *cr, uint64_t max_num_inst, uint64_t stop_rip, uint64_t stop_mask);
+
+typedef struct SCHEDULE_RESULT_STRUCT
+{
+    run_exit_t reason;  // BUDGET, HALT when all the cores halt, INVALID or the faults
+    uint64_t num_inst;  // number of instructions executed by all the cores
+    uint64_t core;      // index of the core at the undecodable or faulting instruction
+} schedule_result_t;
+
+schedule_result_t run_round_robin(core_t *cores, uint64_t num_cores, uint64_t quantum,
+    uint64_t max_num_inst);
+
+int set_breakpoint(core_t *cr, uint64_t vaddr);
+
+void clear_breakpoint(core_t *cr, uint64_t vaddr);
+
+void sync_cflags(core_t *cr);
+
+void inst_cache_invalidate(uint64_t paddr, uint64_t len, core_t *cr);
+
+/*======================================*/
+/*      page tables                     */
+/*======================================*/
+
+// x86-64 4-level paging: PML4, PDPT, PD and PT of 512 8-byte entries each
+// pdbr holds the physical address of the PML4, 0 for no paging
+#define PAGE_SIZE (1ULL << 12)
+#define PAGE_TABLE_LEVEL 4
+
+// entry bits
+#define PTE_PRESENT     0x1
+#define PTE_WRITABLE    0x2
+#define PTE_USER        0x4
+#define PTE_ACCESSED    0x20
+#define PTE_DIRTY       0x40
+#define PTE_HUGE        0x80    // 1 GiB page in PDPT, 2 MiB page in PD
+#define PTE_FRAME       0x000ffffffffff000
+
+// page fault error code bits
+#define PF_PROTECTION   0x1     // 0: the page is not present
+#define PF_WRITE        0x2
+#define PF_USER         0x4
+#define PF_RESERVED     0x8     // the entry points beyond the physical memory
+#define PF_FETCH        0x10
+
+// set in the value moved to cr3: keep the translations cached for the new address space
+// without it they are flushed, those of the other address spaces are kept anyway
+#define CR3_NOFLUSH     (1ULL << 63)
+
+// translate vaddr for a load (0), store (PF_WRITE) or fetch (PF_FETCH)
+// return 1 with *paddr, or 0 with fault_vaddr and fault_code of the core set
+int translate_va(uint64_t vaddr, uint64_t access, core_t *cr, uint64_t *paddr);
+
+// give up the instruction at the page fault of the core: the run stops before it
+void raise_page_fault(core_t *cr) __attribute__((noreturn));
+
+// give up the instruction as a page fault does, the run stops by reason
+void raise_run_exit(core_t *cr, run_exit_t reason) __attribute__((noreturn));
+
+// translate the address of a load, store or instruction fetch
+// a page fault stops the run, the instruction restarts once it is resolved
+uint64_t va2pa(uint64_t vaddr, core_t *cr);
+uint64_t va2pa_write(uint64_t vaddr, core_t *cr);
+uint64_t va2pa_fetch(uint64_t vaddr, core_t *cr);
+
+// the TLBs of the core are not coherent with the page tables:
+// flush them after changing the entries they may cache
+void tlb_flush(core_t *cr);                     // every address space
+void tlb_flush_address_space(core_t *cr);       // the one at pdbr
+void tlb_flush_page(core_t *cr, uint64_t vaddr);   // the page of vaddr at pdbr, as invlpg
+
+// the soft MMU: fill the entry of vaddr for a load (0) or store (PF_WRITE) and return paddr
+uint64_t soft_tlb_fill(uint64_t vaddr, uint64_t access, core_t *cr);
+void soft_tlb_flush(core_t *cr);
+// flush the entries if pdbr or cpl was changed since they were filled
+void soft_tlb_sync(core_t *cr);
+
+// map the page of vaddr to the frame paddr in the page tables at pml4
+// the missing tables are taken from *next_frame on, which is advanced
+// flags: PTE_WRITABLE and PTE_USER, the tables above allow them all
+// the old translation of the page is flushed from the TLBs of cr
+void map_page(uint64_t pml4, uint64_t vaddr, uint64_t paddr, uint64_t flags,
+    uint64_t *next_frame, core_t *cr);
+
 #endif
\ No newline at end of file
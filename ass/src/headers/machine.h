@@ -0,0 +1,113 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <headers/address.h>
+#include <headers/cpu.h>
+#include <headers/memory.h>
+
+/*======================================*/
+/*      sram cache                      */
+/*======================================*/
+
+#define NUM_CACHE_LINE_PER_SET (8)
+
+typedef enum
+{
+    CACHE_LINE_INVALID,
+    CACHE_LINE_CLEAN,
+    CACHE_LINE_DIRTY
+} sram_cacheline_state_t;
+
+typedef struct 
+{
+    sram_cacheline_state_t state;
+    uint64_t tag;
+    uint8_t block[1 << SRAM_CACHE_OFFSET_LENGTH];
+} sram_cacheline_t;
+
+typedef struct 
+{
+    sram_cacheline_t lines[NUM_CACHE_LINE_PER_SET];
+}sram_cacheset_t;
+
+typedef struct sram
+{
+    sram_cacheset_t sets[1 << SRAM_CACHE_INDEX_LENGTH];
+}sram_cache_t;
+
+/*======================================*/
+/*      machine                         */
+/*======================================*/
+
+#if NUM_CORE > 64
+#error "the code lines record the cores by the bits of uint64_t"
+#endif
+
+// the host thread running a core
+typedef struct CORE_THREAD_STRUCT
+{
+    pthread_t thread;
+    int running;        // started and not joined yet
+    int stop;           // set by stop_core, read by the thread
+
+    // why and after how many instructions the thread returned
+    run_exit_t reason;
+    uint64_t num_inst;
+} __attribute__((aligned(HOST_CACHE_LINE_SIZE))) core_thread_t;
+
+// one simulated machine: all the state an instruction can reach
+// machines share nothing, so one process can run many of them
+typedef struct MACHINE_STRUCT
+{
+    core_t cores[NUM_CORE];
+    core_thread_t threads[NUM_CORE];
+
+    // anonymous mapping: the pages are zero and take no host memory until written
+    uint8_t *pm;
+    uint64_t pm_size;   // a power of two, at least one page
+
+    // one bit per 4 KiB frame written since the reset, by the cores or the host
+    // the others are still zero, whether the host keeps them resident or not
+    uint64_t *written_frames;
+
+    sram_cache_t sram;
+
+    // bits of the cores having decoded some instruction in the code lines of each slot:
+    // a filter, the cores keep the lines themselves
+    uint64_t *code_cores;
+} machine_t;
+
+// reset the machine: cores, memory of pm_size bytes and caches
+void init_machine(machine_t *m, uint64_t pm_size);
+
+// release the memory and caches allocated by init_machine
+void free_machine(machine_t *m);
+
+// reset the cores, memory and caches of a machine not running any core
+// cheaper than free_machine and init_machine: the caches stay allocated
+void reset_machine(machine_t *m);
+
+// instructions a core thread runs between the checks of stop_core
+#define CORE_THREAD_QUANTUM 4096
+
+// run the core on its own host thread from its current state
+// until it halts, reaches an undecodable instruction or is stopped
+void start_core(machine_t *m, uint64_t id);
+
+// ask the thread of the core to return, without waiting for it
+void stop_core(machine_t *m, uint64_t id);
+
+// wait for the thread of the core to return
+void join_core(machine_t *m, uint64_t id);
+
+// implemented by the CPU
+void init_cpu_cache(machine_t *m);
+void free_cpu_cache(machine_t *m);
+
+// implemented by the MMU
+void init_tlb(machine_t *m);
+void free_tlb(machine_t *m);
+
+#endif
@@ -1,19 +1,122 @@
-#ifndef MEMORY_H
-#define MEMORY_H
-
-#include <stdint.h>
-
-#define PHYSICAL_MEMORY_SPACE 65536
-#define MAX_INDEX_PHYSICAL_PAGE 15
-
-uint8_t pm[PHYSICAL_MEMORY_SPACE];
-
-uint64_t read64bits_dram(uint64_t paddr, core_t *cr);
-
-void write64bits_dram(uint64_t paddr, uint64_t data, core_t *cr);
-
-void readinst_dram(uint64_t paddr, char *buf, core_t *cr);
-
-void writeinst_dram(uint64_t paddr, const char *str, core_t *cr);
-
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+#include <string.h>
+
+// default size of the physical memory of a machine
+#define PHYSICAL_MEMORY_SPACE 65536
+#define MAX_INDEX_PHYSICAL_PAGE 15
+
+// the host loads and stores of the width (1, 2, 4, 8) bytes of the guest at p
+// with the cores on host threads, the aligned ones are relaxed atomics as the
+// locked instructions update the same words by the host atomics: still one mov
+// each on x86-64 hosts, the misaligned ones are plain (little-endian hosts)
+static inline uint64_t load_pm(const uint8_t *p, uint64_t width)
+{
+#if NUM_CORE >= 2
+    if (((uintptr_t)p & (width - 1)) == 0)
+    {
+        switch (width)
+        {
+            case 1:
+                return __atomic_load_n(p, __ATOMIC_RELAXED);
+            case 2:
+                return __atomic_load_n((const uint16_t *)p, __ATOMIC_RELAXED);
+            case 4:
+                return __atomic_load_n((const uint32_t *)p, __ATOMIC_RELAXED);
+            default:
+                return __atomic_load_n((const uint64_t *)p, __ATOMIC_RELAXED);
+        }
+    }
+#endif
+    uint64_t val = 0;
+    memcpy(&val, p, width);
+    return val;
+}
+
+static inline void store_pm(uint8_t *p, uint64_t data, uint64_t width)
+{
+#if NUM_CORE >= 2
+    if (((uintptr_t)p & (width - 1)) == 0)
+    {
+        switch (width)
+        {
+            case 1:
+                __atomic_store_n(p, (uint8_t)data, __ATOMIC_RELAXED);
+                return;
+            case 2:
+                __atomic_store_n((uint16_t *)p, (uint16_t)data, __ATOMIC_RELAXED);
+                return;
+            case 4:
+                __atomic_store_n((uint32_t *)p, (uint32_t)data, __ATOMIC_RELAXED);
+                return;
+            default:
+                __atomic_store_n((uint64_t *)p, data, __ATOMIC_RELAXED);
+                return;
+        }
+    }
+#endif
+    memcpy(p, &data, width);
+}
+
+// loads and stores of 1, 2, 4 and 8 bytes at any physical address, little-endian
+uint8_t read8bits_dram(uint64_t paddr, core_t *cr);
+uint16_t read16bits_dram(uint64_t paddr, core_t *cr);
+uint32_t read32bits_dram(uint64_t paddr, core_t *cr);
+uint64_t read64bits_dram(uint64_t paddr, core_t *cr);
+
+void write8bits_dram(uint64_t paddr, uint8_t data, core_t *cr);
+void write16bits_dram(uint64_t paddr, uint16_t data, core_t *cr);
+void write32bits_dram(uint64_t paddr, uint32_t data, core_t *cr);
+void write64bits_dram(uint64_t paddr, uint64_t data, core_t *cr);
+
+// write the buffered stores of the core issued before the until-th one to the memory
+void drain_store_buffer(core_t *cr, uint64_t until);
+
+// write all the buffered stores of the core: mfence, the locked instructions, hlt
+void flush_store_buffer(core_t *cr);
+
+// the atomic read-modify-write operations of the guest
+typedef enum ATOMIC_OPERATION
+{
+    ATOMIC_XCHG,
+    ATOMIC_ADD,
+    ATOMIC_AND,
+    ATOMIC_OR,
+    ATOMIC_XOR,
+} atomic_op_t;
+
+// apply op with val to the width (1, 2, 4, 8) bytes at paddr atomically
+// return the value before the operation
+uint64_t atomic_rmw_dram(uint64_t paddr, atomic_op_t op, uint64_t val, uint64_t width, core_t *cr);
+
+// replace the width bytes at paddr by desired if they equal *expected, atomically
+// return 1 if replaced, otherwise 0 with the bytes in *expected
+int atomic_cas_dram(uint64_t paddr, uint64_t *expected, uint64_t desired, uint64_t width, core_t *cr);
+
+void readinst_dram(uint64_t paddr, char *buf, core_t *cr);
+
+void writeinst_dram(uint64_t paddr, const char *str, core_t *cr);
+
+void writeinst_slot_dram(uint64_t paddr, const uint8_t *slot, core_t *cr);
+
+void readcode_dram(uint64_t paddr, uint8_t *buf, uint64_t len, core_t *cr);
+
+void writecode_dram(uint64_t paddr, const uint8_t *code, uint64_t len, core_t *cr);
+
+// bulk operations on the physical ranges, the ranges of memcpy_dram may overlap
+void memcpy_dram(uint64_t dst, uint64_t src, uint64_t len, core_t *cr);
+
+void memset_dram(uint64_t paddr, uint8_t val, uint64_t len, core_t *cr);
+
+// compare as memcmp
+int memcmp_dram(uint64_t paddr1, uint64_t paddr2, uint64_t len, core_t *cr);
+
+// instruction image written by the linker:
+// INST_IMAGE_MAGIC, the number of slots, then the MAX_INSTRUCTION_CHAR byte slots
+#define INST_IMAGE_MAGIC 0x0000474d49464f45     // "EOFIMG"
+
+uint64_t load_inst_image(const char *filename, uint64_t vaddr, core_t *cr);
+
 #endif
\ No newline at end of file
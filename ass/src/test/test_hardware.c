@@ -1,220 +1,1493 @@
-#include<stdio.h>
-#include<string.h>
-#include<headers/cpu.h>
-#include<headers/memory.h>
-#include<headers/common.h>
-
-#define MAX_NUM_INSTRUCTION_CYCLE 100
-
-static void TestAddFunctionCallAndComputation();
-
-// symbols from isa and sram
-void print_register(core_t *cr);
-void print_stack(core_t *cr);
-
-void TestParseOperand();
-void TestParseInstruction();
-static void TestSumRecursiveCondition();
-
-int main()
-{
-    TestAddFunctionCallAndComputation();
-    TestSumRecursiveCondition();
-    return 0;
-}
-
-static void TestAddFunctionCallAndComputation()
-{
-    ACTIVE_CORE = 0x0;
-
-    core_t *ac = (core_t *)&cores[ACTIVE_CORE];
-
-    // init state
-    ac->reg.rax = 0xabcd;
-    ac->reg.rbx = 0x8000670;
-    ac->reg.rcx = 0x8000670;
-    ac->reg.rdx = 0x12340000;
-    ac->reg.rsi = 0x7ffffffee208;
-    ac->reg.rdi = 0x1;
-    ac->reg.rbp = 0x7ffffffee110;
-    ac->reg.rsp = 0x7ffffffee0f0;
-
-    ac->flags._cpu_flag_value = 0;
-
-    write64bits_dram(va2pa(0x7ffffffee110, ac), 0x0000000000000000, ac);    // rbp
-    write64bits_dram(va2pa(0x7ffffffee108, ac), 0x0000000000000000, ac);
-    write64bits_dram(va2pa(0x7ffffffee100, ac), 0x0000000012340000, ac);
-    write64bits_dram(va2pa(0x7ffffffee0f8, ac), 0x000000000000abcd, ac);
-    write64bits_dram(va2pa(0x7ffffffee0f0, ac), 0x0000000000000000, ac);    // rsp
-
-    // 2 before call
-    // 3 after call before push
-    // 5 after rbp
-    // 13 before pop
-    // 14 after pop before ret
-    // 15 after ret
-    char assembly[15][MAX_INSTRUCTION_CHAR] = {
-        "push   %rbp",              // 0
-        "mov    %rsp,%rbp",         // 1
-        "mov    %rdi,-0x18(%rbp)",  // 2
-        "mov    %rsi,-0x20(%rbp)",  // 3
-        "mov    -0x18(%rbp),%rdx",  // 4
-        "mov    -0x20(%rbp),%rax",  // 5
-        "add    %rdx,%rax",         // 6
-        "mov    %rax,-0x8(%rbp)",   // 7
-        "mov    -0x8(%rbp),%rax",   // 8
-        "pop    %rbp",              // 9
-        "retq",                     // 10
-        "mov    %rdx,%rsi",         // 11
-        "mov    %rax,%rdi",         // 12
-        "callq  0x00400000",        // 13
-        "mov    %rax,-0x8(%rbp)",   // 14
-    };
-     // copy to physical memory
-    for (int i = 0; i < 15; ++ i)
-    {
-        writeinst_dram(va2pa(i * 0x40 + 0x00400000, ac), assembly[i], ac);
-    }
-
-    ac->rip = MAX_INSTRUCTION_CHAR * sizeof(char) * 11 + 0x00400000;
-
-    printf("begin\n");
-    int time = 0;
-    while (time < 15)
-    {
-        instruction_cycle(ac);
-        print_register(ac);
-        print_stack(ac);
-        time ++;
-    } 
-
-    // gdb state ret from func
-    int match = 1;
-    match = match && ac->reg.rax == 0x1234abcd;
-    match = match && ac->reg.rbx == 0x8000670;
-    match = match && ac->reg.rcx == 0x8000670;
-    match = match && ac->reg.rdx == 0xabcd;
-    match = match && ac->reg.rsi == 0x12340000;
-    match = match && ac->reg.rdi == 0xabcd;
-    match = match && ac->reg.rbp == 0x7ffffffee110;
-    match = match && ac->reg.rsp == 0x7ffffffee0f0;
-
-    if (match)
-    {
-        printf("register match\n");
-    }
-    else
-    {
-        printf("register mismatch\n");
-    }
-
-    match = match && (read64bits_dram(va2pa(0x7ffffffee110, ac), ac) == 0x0000000000000000); // rbp
-    match = match && (read64bits_dram(va2pa(0x7ffffffee108, ac), ac) == 0x000000001234abcd);
-    match = match && (read64bits_dram(va2pa(0x7ffffffee100, ac), ac) == 0x0000000012340000);
-    match = match && (read64bits_dram(va2pa(0x7ffffffee0f8, ac), ac) == 0x000000000000abcd);
-    match = match && (read64bits_dram(va2pa(0x7ffffffee0f0, ac), ac) == 0x0000000000000000); // rsp
-
-    if (match)
-    {
-        printf("memory match\n");
-    }
-    else
-    {
-        printf("memory mismatch\n");
-    }
-}
-
-static void TestSumRecursiveCondition()
-{
-    ACTIVE_CORE = 0x0;
-    core_t *cr = (core_t *)&cores[ACTIVE_CORE];
-
-    // init state
-    cr->reg.rax = 0x8000630;
-    cr->reg.rbx = 0x0;
-    cr->reg.rcx = 0x8000650;
-    cr->reg.rdx = 0x7ffffffee328;
-    cr->reg.rsi = 0x7ffffffee318;
-    cr->reg.rdi = 0x1;
-    cr->reg.rbp = 0x7ffffffee230;
-    cr->reg.rsp = 0x7ffffffee220;
-
-    cr->flags._cpu_flag_value = 0;
-
-    write64bits_dram(va2pa(0x7ffffffee230, cr), 0x0000000008000650, cr);    // rbp
-    write64bits_dram(va2pa(0x7ffffffee228, cr), 0x0000000000000000, cr);
-    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x00007ffffffee310, cr);    // rsp
-
-    char assembly[19][MAX_INSTRUCTION_CHAR] = {
-        "push   %rbp",              // 0
-        "mov    %rsp,%rbp",         // 1
-        "sub    $0x10,%rsp",        // 2
-        "mov    %rdi,-0x8(%rbp)",   // 3
-        "cmpq   $0x0,-0x8(%rbp)",   // 4
-        "jne    0x400200",          // 5: jump to 8
-        "mov    $0x0,%eax",         // 6
-        "jmp    0x400380",          // 7: jump to 14
-        "mov    -0x8(%rbp),%rax",   // 8
-        "sub    $0x1,%rax",         // 9
-        "mov    %rax,%rdi",         // 10
-        "callq  0x00400000",        // 11
-        "mov    -0x8(%rbp),%rdx",   // 12
-        "add    %rdx,%rax",         // 13
-        "leaveq ",                  // 14
-        "retq   ",                  // 15
-        "mov    $0x3,%edi",         // 16
-        "callq  0x00400000",        // 17
-        "mov    %rax,-0x8(%rbp)",   // 18
-    };
-
-    // copy to physical memory
-    for (int i = 0; i < 19; ++ i)
-    {
-        writeinst_dram(va2pa(i * 0x40 + 0x00400000, cr), assembly[i], cr);
-    }
-    cr->rip = MAX_INSTRUCTION_CHAR * sizeof(char) * 16 + 0x00400000;
-
-    printf("begin\n");
-    int time = 0;
-    while ((cr->rip <= 18 * 0x40 + 0x00400000) &&
-           time < MAX_NUM_INSTRUCTION_CYCLE)
-    {
-        instruction_cycle(cr);
-        print_register(cr);
-        print_stack(cr);
-        time ++;
-    } 
-
-    // gdb state ret from func
-    int match = 1;
-    match = match && cr->reg.rax == 0x6;
-    match = match && cr->reg.rbx == 0x0;
-    match = match && cr->reg.rcx == 0x8000650;
-    match = match && cr->reg.rdx == 0x3;
-    match = match && cr->reg.rsi == 0x7ffffffee318;
-    match = match && cr->reg.rdi == 0x0;
-    match = match && cr->reg.rbp == 0x7ffffffee230;
-    match = match && cr->reg.rsp == 0x7ffffffee220;
-
-    if (match)
-    {
-        printf("register match\n");
-    }
-    else
-    {
-        printf("register mismatch\n");
-    }
-
-    match = match && (read64bits_dram(va2pa(0x7ffffffee230, cr), cr) == 0x0000000008000650); // rbp
-    match = match && (read64bits_dram(va2pa(0x7ffffffee228, cr), cr) == 0x0000000000000006);
-    match = match && (read64bits_dram(va2pa(0x7ffffffee220, cr), cr) == 0x00007ffffffee310); // rsp
-
-    if (match)
-    {
-        printf("memory match\n");
-    }
-    else
-    {
-        printf("memory mismatch\n");
-    }
-}
\ No newline at end of file
+#include<stdio.h>
+#include<string.h>
+#include<headers/cpu.h>
+#include<headers/memory.h>
+#include<headers/common.h>
+#include<headers/machine.h>
+#include<headers/batch.h>
+
+#define MAX_NUM_INSTRUCTION_CYCLE 100
+
+// the tests run one after another on the first core of the machine
+static machine_t machine;
+
+static void TestAddFunctionCallAndComputation(int block_mode);
+
+// symbols from isa and sram
+void print_register(core_t *cr);
+void print_stack(core_t *cr);
+
+void TestParseOperand();
+void TestParseInstruction();
+void BenchParseInstruction();
+void TestDecodeInstruction();
+static void TestSumRecursiveCondition(int block_mode);
+static void TestSumArrayLoop(int block_mode, int predecoded);
+static void TestSumArrayLoopMachineCode(int block_mode);
+static void TestOperandWidth(int block_mode, int machine_code);
+static void TestMultiCore();
+#if NUM_CORE >= 2
+static void TestRoundRobin();
+#endif
+static void TestAtomics();
+#if NUM_CORE >= 2
+static void TestStoreBuffer();
+#endif
+static void TestMemoryAccess();
+static void TestLargeMemory();
+static void TestPageWalk();
+#if ENABLE_PAGE_WALK == 1
+static void TestTlb();
+#endif
+static void TestBatch();
+
+int main()
+{
+#ifdef BENCH_PARSE
+    // the timing only, host dependent: make bench
+    BenchParseInstruction();
+    return 0;
+#endif
+
+    init_machine(&machine, PHYSICAL_MEMORY_SPACE);
+
+    TestParseInstruction();
+    TestDecodeInstruction();
+
+    TestAddFunctionCallAndComputation(0);
+    TestSumRecursiveCondition(0);
+    TestSumArrayLoop(0, 0);
+
+    // the same programs by the basic block translation
+    TestAddFunctionCallAndComputation(1);
+    TestSumRecursiveCondition(1);
+    TestSumArrayLoop(1, 0);
+
+    // the text pre-decoded as the linker does
+    TestSumArrayLoop(0, 1);
+    TestSumArrayLoop(1, 1);
+
+    // the machine code of the same function
+    TestSumArrayLoopMachineCode(0);
+    TestSumArrayLoopMachineCode(1);
+    TestOperandWidth(0, 1);
+    TestOperandWidth(1, 1);
+    TestOperandWidth(0, 0);
+    TestOperandWidth(1, 0);
+
+    // all the cores at once on host threads
+    TestMultiCore();
+#if NUM_CORE >= 2
+    TestRoundRobin();
+#endif
+    TestAtomics();
+#if NUM_CORE >= 2
+    TestStoreBuffer();
+#endif
+    TestMemoryAccess();
+    TestLargeMemory();
+    TestPageWalk();
+#if ENABLE_PAGE_WALK == 1
+    TestTlb();
+#endif
+
+    // many independent programs, each on its own machine
+    TestBatch();
+
+    free_machine(&machine);
+    return 0;
+}
+
+static void TestAddFunctionCallAndComputation(int block_mode)
+{
+    core_t *ac = &machine.cores[0];
+
+    // init state
+    ac->reg.rax = 0xabcd;
+    ac->reg.rbx = 0x8000670;
+    ac->reg.rcx = 0x8000670;
+    ac->reg.rdx = 0x12340000;
+    ac->reg.rsi = 0x7ffffffee208;
+    ac->reg.rdi = 0x1;
+    ac->reg.rbp = 0x7ffffffee110;
+    ac->reg.rsp = 0x7ffffffee0f0;
+
+    ac->flags._cpu_flag_value = 0;
+
+    write64bits_dram(va2pa(0x7ffffffee110, ac), 0x0000000000000000, ac);    // rbp
+    write64bits_dram(va2pa(0x7ffffffee108, ac), 0x0000000000000000, ac);
+    write64bits_dram(va2pa(0x7ffffffee100, ac), 0x0000000012340000, ac);
+    write64bits_dram(va2pa(0x7ffffffee0f8, ac), 0x000000000000abcd, ac);
+    write64bits_dram(va2pa(0x7ffffffee0f0, ac), 0x0000000000000000, ac);    // rsp
+
+    // 2 before call
+    // 3 after call before push
+    // 5 after rbp
+    // 13 before pop
+    // 14 after pop before ret
+    // 15 after ret
+    char assembly[15][MAX_INSTRUCTION_CHAR] = {
+        "push   %rbp",              // 0
+        "mov    %rsp,%rbp",         // 1
+        "mov    %rdi,-0x18(%rbp)",  // 2
+        "mov    %rsi,-0x20(%rbp)",  // 3
+        "mov    -0x18(%rbp),%rdx",  // 4
+        "mov    -0x20(%rbp),%rax",  // 5
+        "add    %rdx,%rax",         // 6
+        "mov    %rax,-0x8(%rbp)",   // 7
+        "mov    -0x8(%rbp),%rax",   // 8
+        "pop    %rbp",              // 9
+        "retq",                     // 10
+        "mov    %rdx,%rsi",         // 11
+        "mov    %rax,%rdi",         // 12
+        "callq  0x00400000",        // 13
+        "mov    %rax,-0x8(%rbp)",   // 14
+    };
+     // copy to physical memory
+    for (int i = 0; i < 15; ++ i)
+    {
+        writeinst_dram(va2pa(i * 0x40 + 0x00400000, ac), assembly[i], ac);
+    }
+
+    ac->rip = MAX_INSTRUCTION_CHAR * sizeof(char) * 11 + 0x00400000;
+
+    printf("begin\n");
+    if (block_mode == 1)
+    {
+        run_until(ac, 15, 0, 0);
+    }
+    else
+    {
+        int time = 0;
+        while (time < 15)
+        {
+            instruction_cycle(ac);
+            print_register(ac);
+            print_stack(ac);
+            time ++;
+        }
+    }
+
+    // gdb state ret from func
+    int match = 1;
+    match = match && ac->reg.rax == 0x1234abcd;
+    match = match && ac->reg.rbx == 0x8000670;
+    match = match && ac->reg.rcx == 0x8000670;
+    match = match && ac->reg.rdx == 0xabcd;
+    match = match && ac->reg.rsi == 0x12340000;
+    match = match && ac->reg.rdi == 0xabcd;
+    match = match && ac->reg.rbp == 0x7ffffffee110;
+    match = match && ac->reg.rsp == 0x7ffffffee0f0;
+
+    if (match)
+    {
+        printf("register match\n");
+    }
+    else
+    {
+        printf("register mismatch\n");
+    }
+
+    match = match && (read64bits_dram(va2pa(0x7ffffffee110, ac), ac) == 0x0000000000000000); // rbp
+    match = match && (read64bits_dram(va2pa(0x7ffffffee108, ac), ac) == 0x000000001234abcd);
+    match = match && (read64bits_dram(va2pa(0x7ffffffee100, ac), ac) == 0x0000000012340000);
+    match = match && (read64bits_dram(va2pa(0x7ffffffee0f8, ac), ac) == 0x000000000000abcd);
+    match = match && (read64bits_dram(va2pa(0x7ffffffee0f0, ac), ac) == 0x0000000000000000); // rsp
+
+    if (match)
+    {
+        printf("memory match\n");
+    }
+    else
+    {
+        printf("memory mismatch\n");
+    }
+}
+
+static void TestSumRecursiveCondition(int block_mode)
+{
+    core_t *cr = &machine.cores[0];
+
+    // init state
+    cr->reg.rax = 0x8000630;
+    cr->reg.rbx = 0x0;
+    cr->reg.rcx = 0x8000650;
+    cr->reg.rdx = 0x7ffffffee328;
+    cr->reg.rsi = 0x7ffffffee318;
+    cr->reg.rdi = 0x1;
+    cr->reg.rbp = 0x7ffffffee230;
+    cr->reg.rsp = 0x7ffffffee220;
+
+    cr->flags._cpu_flag_value = 0;
+
+    write64bits_dram(va2pa(0x7ffffffee230, cr), 0x0000000008000650, cr);    // rbp
+    write64bits_dram(va2pa(0x7ffffffee228, cr), 0x0000000000000000, cr);
+    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x00007ffffffee310, cr);    // rsp
+
+    char assembly[20][MAX_INSTRUCTION_CHAR] = {
+        "push   %rbp",              // 0
+        "mov    %rsp,%rbp",         // 1
+        "sub    $0x10,%rsp",        // 2
+        "mov    %rdi,-0x8(%rbp)",   // 3
+        "cmpq   $0x0,-0x8(%rbp)",   // 4
+        "jne    0x400200",          // 5: jump to 8
+        "mov    $0x0,%eax",         // 6
+        "jmp    0x400380",          // 7: jump to 14
+        "mov    -0x8(%rbp),%rax",   // 8
+        "sub    $0x1,%rax",         // 9
+        "mov    %rax,%rdi",         // 10
+        "callq  0x00400000",        // 11
+        "mov    -0x8(%rbp),%rdx",   // 12
+        "add    %rdx,%rax",         // 13
+        "leaveq ",                  // 14
+        "retq   ",                  // 15
+        "mov    $0x3,%edi",         // 16
+        "callq  0x00400000",        // 17
+        "mov    %rax,-0x8(%rbp)",   // 18
+        "hlt",                      // 19
+    };
+
+    // copy to physical memory
+    for (int i = 0; i < 20; ++ i)
+    {
+        writeinst_dram(va2pa(i * 0x40 + 0x00400000, cr), assembly[i], cr);
+    }
+    cr->rip = MAX_INSTRUCTION_CHAR * sizeof(char) * 16 + 0x00400000;
+
+    printf("begin\n");
+    if (block_mode == 1)
+    {
+        // stop at the entry of sum, then resume up to hlt
+        set_breakpoint(cr, 0x00400000);
+        run_result_t result = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, RUN_STOP_BREAKPOINT);
+        if (result.reason != RUN_EXIT_BREAKPOINT || cr->rip != 0x00400000)
+        {
+            printf("breakpoint mismatch\n");
+        }
+        clear_breakpoint(cr, 0x00400000);
+        result = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 19 * 0x40 + 0x00400000, RUN_STOP_RIP);
+        if (result.reason != RUN_EXIT_RIP)
+        {
+            printf("stop rip mismatch\n");
+        }
+        result = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+        if (result.reason != RUN_EXIT_HALT || result.num_inst != 1)
+        {
+            printf("halt mismatch\n");
+        }
+        cr->halt = 0;
+    }
+    else
+    {
+        int time = 0;
+        while ((cr->rip <= 18 * 0x40 + 0x00400000) &&
+               time < MAX_NUM_INSTRUCTION_CYCLE)
+        {
+            instruction_cycle(cr);
+            print_register(cr);
+            print_stack(cr);
+            time ++;
+        }
+    }
+
+    // gdb state ret from func
+    int match = 1;
+    match = match && cr->reg.rax == 0x6;
+    match = match && cr->reg.rbx == 0x0;
+    match = match && cr->reg.rcx == 0x8000650;
+    match = match && cr->reg.rdx == 0x3;
+    match = match && cr->reg.rsi == 0x7ffffffee318;
+    match = match && cr->reg.rdi == 0x0;
+    match = match && cr->reg.rbp == 0x7ffffffee230;
+    match = match && cr->reg.rsp == 0x7ffffffee220;
+
+    if (match)
+    {
+        printf("register match\n");
+    }
+    else
+    {
+        printf("register mismatch\n");
+    }
+
+    match = match && (read64bits_dram(va2pa(0x7ffffffee230, cr), cr) == 0x0000000008000650); // rbp
+    match = match && (read64bits_dram(va2pa(0x7ffffffee228, cr), cr) == 0x0000000000000006);
+    match = match && (read64bits_dram(va2pa(0x7ffffffee220, cr), cr) == 0x00007ffffffee310); // rsp
+
+    if (match)
+    {
+        printf("memory match\n");
+    }
+    else
+    {
+        printf("memory mismatch\n");
+    }
+}
+// the text of files/exe/sum.elf.txt without the relocated global
+static void TestSumArrayLoop(int block_mode, int predecoded)
+{
+    core_t *cr = &machine.cores[0];
+
+    // init state: sum(a, 4) returning to the hlt
+    cr->reg.rax = 0x0;
+    cr->reg.rbx = 0x0;
+    cr->reg.rcx = 0x0;
+    cr->reg.rdx = 0x0;
+    cr->reg.rsi = 0x4;
+    cr->reg.rdi = 0x7ffffffed000;
+    cr->reg.rbp = 0x7ffffffee230;
+    cr->reg.rsp = 0x7ffffffee220;
+
+    cr->flags._cpu_flag_value = 0;
+
+    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x0000000000400500, cr);    // rsp: return address
+    write64bits_dram(va2pa(0x7ffffffed000, cr), 0x3, cr);                   // a
+    write64bits_dram(va2pa(0x7ffffffed008, cr), 0x5, cr);
+    write64bits_dram(va2pa(0x7ffffffed010, cr), 0x7, cr);
+    write64bits_dram(va2pa(0x7ffffffed018, cr), 0xb, cr);
+
+    char assembly[21][MAX_INSTRUCTION_CHAR] = {
+        "push   %rbp",              // 0
+        "mov    %rsp,%rbp",         // 1
+        "mov    %rdi,-0x18(%rbp)",  // 2
+        "mov    %rsi,-0x20(%rbp)",  // 3
+        "movq   $0x0,-0x8(%rbp)",   // 4
+        "movq   $0x0,-0x10(%rbp)",  // 5
+        "jmp    0x400380",          // 6: jump to 14
+        "mov    -0x10(%rbp),%rax",  // 7
+        "lea    0x0(,%rax,8),%rdx", // 8
+        "mov    -0x18(%rbp),%rax",  // 9
+        "add    %rdx,%rax",         // 10
+        "mov    (%rax),%rax",       // 11
+        "add    %rax,-0x8(%rbp)",   // 12
+        "addq   $0x1,-0x10(%rbp)",  // 13
+        "mov    -0x10(%rbp),%rax",  // 14
+        "cmp    -0x20(%rbp),%rax",  // 15
+        "jb     0x4001c0",          // 16: jump to 7
+        "mov    -0x8(%rbp),%rax",   // 17
+        "pop    %rbp",              // 18
+        "retq",                     // 19
+        "hlt",                      // 20
+    };
+
+    // copy to physical memory
+    for (int i = 0; i < 21; ++ i)
+    {
+        if (predecoded == 1)
+        {
+            inst_t inst;
+            uint8_t slot[MAX_INSTRUCTION_CHAR];
+            parse_inst_string(assembly[i], &inst);
+            pack_inst_record(&inst, slot);
+            writeinst_slot_dram(va2pa(i * 0x40 + 0x00400000, cr), slot, cr);
+        }
+        else
+        {
+            writeinst_dram(va2pa(i * 0x40 + 0x00400000, cr), assembly[i], cr);
+        }
+    }
+    cr->rip = 0x00400000;
+
+    printf("begin\n");
+    if (block_mode == 1)
+    {
+        run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    }
+    else
+    {
+        int time = 0;
+        while (cr->halt == 0 && time < MAX_NUM_INSTRUCTION_CYCLE)
+        {
+            instruction_cycle(cr);
+            print_register(cr);
+            print_stack(cr);
+            time ++;
+        }
+    }
+    cr->halt = 0;
+
+    int match = 1;
+    match = match && cr->reg.rax == 0x1a;
+    match = match && cr->reg.rdx == 0x18;
+    match = match && cr->reg.rsi == 0x4;
+    match = match && cr->reg.rdi == 0x7ffffffed000;
+    match = match && cr->reg.rbp == 0x7ffffffee230;
+    match = match && cr->reg.rsp == 0x7ffffffee228;
+    match = match && cr->rip == 0x00400540;
+
+    if (match)
+    {
+        printf("register match\n");
+    }
+    else
+    {
+        printf("register mismatch\n");
+    }
+
+    match = match && (read64bits_dram(va2pa(0x7ffffffee218, cr), cr) == 0x00007ffffffee230); // rbp
+    match = match && (read64bits_dram(va2pa(0x7ffffffee210, cr), cr) == 0x000000000000001a); // s
+    match = match && (read64bits_dram(va2pa(0x7ffffffee208, cr), cr) == 0x0000000000000004); // i
+
+    if (match)
+    {
+        printf("memory match\n");
+    }
+    else
+    {
+        printf("memory mismatch\n");
+    }
+}
+
+// sum in files/exe/sum.elf.txt assembled by as at 0x400000, followed by hlt
+static const uint8_t sum_code[78] = {
+    0x55,                                           // 400000: push   %rbp
+    0x48, 0x89, 0xe5,                               // 400001: mov    %rsp,%rbp
+    0x48, 0x89, 0x7d, 0xe8,                         // 400004: mov    %rdi,-0x18(%rbp)
+    0x48, 0x89, 0x75, 0xe0,                         // 400008: mov    %rsi,-0x20(%rbp)
+    0x48, 0xc7, 0x45, 0xf8, 0x00, 0x00, 0x00, 0x00, // 40000c: movq   $0x0,-0x8(%rbp)
+    0x48, 0xc7, 0x45, 0xf0, 0x00, 0x00, 0x00, 0x00, // 400014: movq   $0x0,-0x10(%rbp)
+    0xeb, 0x1f,                                     // 40001c: jmp    40003d
+    0x48, 0x8b, 0x45, 0xf0,                         // 40001e: mov    -0x10(%rbp),%rax
+    0x48, 0x8d, 0x14, 0xc5, 0x00, 0x00, 0x00, 0x00, // 400022: lea    0x0(,%rax,8),%rdx
+    0x48, 0x8b, 0x45, 0xe8,                         // 40002a: mov    -0x18(%rbp),%rax
+    0x48, 0x01, 0xd0,                               // 40002e: add    %rdx,%rax
+    0x48, 0x8b, 0x00,                               // 400031: mov    (%rax),%rax
+    0x48, 0x01, 0x45, 0xf8,                         // 400034: add    %rax,-0x8(%rbp)
+    0x48, 0x83, 0x45, 0xf0, 0x01,                   // 400038: addq   $0x1,-0x10(%rbp)
+    0x48, 0x8b, 0x45, 0xf0,                         // 40003d: mov    -0x10(%rbp),%rax
+    0x48, 0x3b, 0x45, 0xe0,                         // 400041: cmp    -0x20(%rbp),%rax
+    0x72, 0xd7,                                     // 400045: jb     40001e
+    0x48, 0x8b, 0x45, 0xf8,                         // 400047: mov    -0x8(%rbp),%rax
+    0x5d,                                           // 40004b: pop    %rbp
+    0xc3,                                           // 40004c: retq
+    0xf4,                                           // 40004d: hlt
+};
+
+static void TestSumArrayLoopMachineCode(int block_mode)
+{
+    core_t *cr = &machine.cores[0];
+
+    // init state: sum(a, 4) returning to the hlt
+    cr->reg.rax = 0x0;
+    cr->reg.rbx = 0x0;
+    cr->reg.rcx = 0x0;
+    cr->reg.rdx = 0x0;
+    cr->reg.rsi = 0x4;
+    cr->reg.rdi = 0x7ffffffed000;
+    cr->reg.rbp = 0x7ffffffee230;
+    cr->reg.rsp = 0x7ffffffee220;
+
+    cr->flags._cpu_flag_value = 0;
+
+    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x000000000040004d, cr);    // rsp: return address
+    write64bits_dram(va2pa(0x7ffffffed000, cr), 0x3, cr);                   // a
+    write64bits_dram(va2pa(0x7ffffffed008, cr), 0x5, cr);
+    write64bits_dram(va2pa(0x7ffffffed010, cr), 0x7, cr);
+    write64bits_dram(va2pa(0x7ffffffed018, cr), 0xb, cr);
+
+    // copy to physical memory
+    writecode_dram(va2pa(0x00400000, cr), sum_code, sizeof(sum_code), cr);
+    cr->rip = 0x00400000;
+    cr->fetch_mode = FETCH_X86;
+
+    printf("begin\n");
+    if (block_mode == 1)
+    {
+        run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    }
+    else
+    {
+        int time = 0;
+        while (cr->halt == 0 && time < MAX_NUM_INSTRUCTION_CYCLE)
+        {
+            instruction_cycle(cr);
+            print_register(cr);
+            print_stack(cr);
+            time ++;
+        }
+    }
+    cr->halt = 0;
+    cr->fetch_mode = FETCH_ASSEMBLY;
+
+    int match = 1;
+    match = match && cr->reg.rax == 0x1a;
+    match = match && cr->reg.rdx == 0x18;
+    match = match && cr->reg.rsi == 0x4;
+    match = match && cr->reg.rdi == 0x7ffffffed000;
+    match = match && cr->reg.rbp == 0x7ffffffee230;
+    match = match && cr->reg.rsp == 0x7ffffffee228;
+    match = match && cr->rip == 0x0040004e;
+
+    if (match)
+    {
+        printf("register match\n");
+    }
+    else
+    {
+        printf("register mismatch\n");
+    }
+
+    match = match && (read64bits_dram(va2pa(0x7ffffffee218, cr), cr) == 0x00007ffffffee230); // rbp
+    match = match && (read64bits_dram(va2pa(0x7ffffffee210, cr), cr) == 0x000000000000001a); // s
+    match = match && (read64bits_dram(va2pa(0x7ffffffee208, cr), cr) == 0x0000000000000004); // i
+
+    if (match)
+    {
+        printf("memory match\n");
+    }
+    else
+    {
+        printf("memory mismatch\n");
+    }
+}
+
+// the 1, 2 and 4-byte operands: the registers, the memory and the flags
+// by the machine code, or by the assembly with the b/w/l suffixes
+static void TestOperandWidth(int block_mode, int machine_code)
+{
+    core_t *cr = &machine.cores[0];
+    uint8_t code[57] = {
+        0x48, 0xb8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11,    // 400000: movabs $0x1122334455667788,%rax
+        0x48, 0x89, 0xc3,                   // 40000a: mov    %rax,%rbx
+        0x48, 0x89, 0xc1,                   // 40000d: mov    %rax,%rcx
+        0x48, 0x89, 0xc2,                   // 400010: mov    %rax,%rdx
+        0xb8, 0xff, 0xff, 0xff, 0xff,       // 400013: mov    $0xffffffff,%eax
+        0x88, 0xc7,                         // 400018: mov    %al,%bh
+        0x66, 0x83, 0xc1, 0x01,             // 40001a: add    $0x1,%cx
+        0x80, 0xc2, 0x80,                   // 40001e: add    $0x80,%dl
+        0x73, 0x15,                         // 400021: jae    400038
+        0x80, 0xea, 0x08,                   // 400023: sub    $0x8,%dl
+        0x75, 0x10,                         // 400026: jne    400038
+        0x66, 0xc7, 0x04, 0x24, 0xef, 0xbe, // 400028: movw   $0xbeef,(%rsp)
+        0xf0, 0x0f, 0xc1, 0x04, 0x24,       // 40002e: lock xadd %eax,(%rsp)
+        0x48, 0x8b, 0x34, 0x24,             // 400033: mov    (%rsp),%rsi
+        0xf4,                               // 400037: hlt
+        0xf4,                               // 400038: hlt
+    };
+    char assembly[16][MAX_INSTRUCTION_CHAR] = {
+        "mov    $0x1122334455667788,%rax",  // 0
+        "mov    %rax,%rbx",                 // 1
+        "mov    %rax,%rcx",                 // 2
+        "mov    %rax,%rdx",                 // 3
+        "mov    $0xffffffff,%eax",          // 4
+        "mov    %al,%bh",                   // 5
+        "addw   $0x1,%cx",                  // 6
+        "addb   $0x80,%dl",                 // 7
+        "jae    0x4003c0",                  // 8
+        "subb   $0x8,%dl",                  // 9
+        "jne    0x4003c0",                  // 10
+        "movw   $0xbeef,(%rsp)",            // 11
+        "lock xaddl %eax,(%rsp)",           // 12
+        "mov    (%rsp),%rsi",               // 13
+        "hlt",                              // 14
+        "hlt",                              // 15
+    };
+
+    uint64_t end;
+    if (machine_code == 1)
+    {
+        writecode_dram(va2pa(0x00400000, cr), code, sizeof(code), cr);
+        cr->fetch_mode = FETCH_X86;
+        end = 0x00400038;
+    }
+    else
+    {
+        for (int i = 0; i < 16; ++ i)
+        {
+            writeinst_dram(va2pa(i * 0x40 + 0x00400000, cr), assembly[i], cr);
+        }
+        cr->fetch_mode = FETCH_ASSEMBLY;
+        end = 0x004003c0;
+    }
+    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x0123456789abcdef, cr);
+
+    memset(&(cr->reg), 0, sizeof(reg_t));
+    cr->reg.rsp = 0x7ffffffee220;
+    cr->flags._cpu_flag_value = 0;
+    cr->rip = 0x00400000;
+
+    if (block_mode == 1)
+    {
+        run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    }
+    else
+    {
+        int time = 0;
+        while (cr->halt == 0 && time < MAX_NUM_INSTRUCTION_CYCLE)
+        {
+            instruction_cycle(cr);
+            time ++;
+        }
+    }
+    cr->halt = 0;
+    cr->fetch_mode = FETCH_ASSEMBLY;
+
+    int match = 1;
+    match = match && cr->reg.rax == 0x89abbeef;             // eax clears the upper half
+    match = match && cr->reg.rbx == 0x112233445566ff88;     // bh is the second byte
+    match = match && cr->reg.rcx == 0x1122334455667789;
+    match = match && cr->reg.rdx == 0x1122334455667700;     // carry and zero of dl
+    match = match && cr->reg.rsi == 0x0123456789abbeee;
+    match = match && cr->rip == end;
+
+    if (match)
+    {
+        printf("operand width match\n");
+    }
+    else
+    {
+        printf("operand width mismatch\n");
+    }
+}
+
+// every core sums its own array on its own stack by the shared code
+static void TestMultiCore()
+{
+    core_t *c0 = &machine.cores[0];
+    writecode_dram(va2pa(0x00400000, c0), sum_code, sizeof(sum_code), c0);
+
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &machine.cores[i];
+        uint64_t a = 0x7ffffffed000 + i * 0x40;
+        uint64_t rsp = 0x7ffffffefe20 - i * 0x40;
+
+        memset(&(cr->reg), 0, sizeof(reg_t));
+        cr->reg.rsi = 0x4;
+        cr->reg.rdi = a;
+        cr->reg.rsp = rsp;
+        cr->flags._cpu_flag_value = 0;
+        cr->halt = 0;
+
+        write64bits_dram(va2pa(rsp, cr), 0x000000000040004d, cr);
+        for (uint64_t j = 0; j < 4; ++ j)
+        {
+            write64bits_dram(va2pa(a + j * 8, cr), i + j, cr);
+        }
+
+        cr->rip = 0x00400000;
+        cr->fetch_mode = FETCH_X86;
+    }
+
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        start_core(&machine, i);
+    }
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        join_core(&machine, i);
+    }
+
+    int match = 1;
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &machine.cores[i];
+        match = match && machine.threads[i].reason == RUN_EXIT_HALT;
+        match = match && cr->reg.rax == 4 * i + 6;
+        match = match && cr->reg.rsp == 0x7ffffffefe28 - i * 0x40;
+        match = match && cr->rip == 0x0040004e;
+        cr->halt = 0;
+    }
+
+    if (match)
+    {
+        printf("multi-core register match\n");
+    }
+    else
+    {
+        printf("multi-core register mismatch\n");
+    }
+
+    // a core spinning at jmp . returns only when stopped
+    uint8_t spin[2] = { 0xeb, 0xfe };
+    writecode_dram(va2pa(0x00400100, c0), spin, sizeof(spin), c0);
+    c0->rip = 0x00400100;
+    start_core(&machine, 0);
+    stop_core(&machine, 0);
+    join_core(&machine, 0);
+
+    if (machine.threads[0].reason == RUN_EXIT_BUDGET && c0->rip == 0x00400100)
+    {
+        printf("stop core match\n");
+    }
+    else
+    {
+        printf("stop core mismatch\n");
+    }
+
+    // the code rewritten by core 0 after core 1 has translated it
+    core_t *c1 = &machine.cores[NUM_CORE - 1];
+    uint8_t mov_hlt[6] = { 0xb8, 0x01, 0x00, 0x00, 0x00, 0xf4 };  // mov $0x1,%eax; hlt
+    writecode_dram(va2pa(0x00400200, c0), mov_hlt, sizeof(mov_hlt), c0);
+    c1->rip = 0x00400200;
+    run_until(c1, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = c1->reg.rax == 0x1;
+
+    mov_hlt[1] = 0x02;
+    writecode_dram(va2pa(0x00400200, c0), mov_hlt, sizeof(mov_hlt), c0);
+    c1->rip = 0x00400200;
+    c1->halt = 0;
+    run_until(c1, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && c1->reg.rax == 0x2;
+
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        machine.cores[i].halt = 0;
+        machine.cores[i].fetch_mode = FETCH_ASSEMBLY;
+    }
+
+    if (match)
+    {
+        printf("cross-core code match\n");
+    }
+    else
+    {
+        printf("cross-core code mismatch\n");
+    }
+}
+
+#if NUM_CORE >= 2
+// two cores increment the shared counter without lock: the lost updates
+// depend only on the quantum of the round-robin scheduler
+static uint64_t RunRacingCounter(uint64_t quantum)
+{
+    core_t *cr = &machine.cores[0];
+    uint8_t code[20] = {
+        0x48, 0x8b, 0x03,               // 400300: mov    (%rbx),%rax
+        0x48, 0x83, 0xc0, 0x01,         // 400303: add    $0x1,%rax
+        0x48, 0x89, 0x03,               // 400307: mov    %rax,(%rbx)
+        0x0f, 0xae, 0xf0,               // 40030a: mfence
+        0x48, 0x83, 0xe9, 0x01,         // 40030d: sub    $0x1,%rcx
+        0x75, 0xed,                     // 400311: jne    400300
+        0xf4,                           // 400313: hlt
+    };
+    writecode_dram(va2pa(0x00400300, cr), code, sizeof(code), cr);
+    write64bits_dram(va2pa(0x7ffffffec000, cr), 0x0, cr);
+    flush_store_buffer(cr);
+
+    for (uint64_t i = 0; i < 2; ++ i)
+    {
+        cr = &machine.cores[i];
+        memset(&(cr->reg), 0, sizeof(reg_t));
+        cr->reg.rbx = 0x7ffffffec000;
+        cr->reg.rcx = 10;
+        cr->flags._cpu_flag_value = 0;
+        cr->halt = 0;
+        cr->rip = 0x00400300;
+        cr->fetch_mode = FETCH_X86;
+    }
+
+    schedule_result_t result = run_round_robin(machine.cores, 2, quantum, 1000);
+
+    uint64_t counter = read64bits_dram(va2pa(0x7ffffffec000, cr), cr);
+    for (uint64_t i = 0; i < 2; ++ i)
+    {
+        machine.cores[i].halt = 0;
+        machine.cores[i].fetch_mode = FETCH_ASSEMBLY;
+    }
+
+    if (result.reason != RUN_EXIT_HALT || result.num_inst != 2 * 61)
+    {
+        return 0;
+    }
+    return counter;
+}
+
+static void TestRoundRobin()
+{
+    int match = 1;
+
+    // a whole iteration per turn: no update is lost
+    match = match && RunRacingCounter(6) == 20;
+    // lock-step: both cores load the counter before either stores it
+    match = match && RunRacingCounter(1) == 10;
+    // the same quantum, the same interleaving
+    uint64_t counter = RunRacingCounter(3);
+    match = match && counter != 0 && RunRacingCounter(3) == counter;
+
+    if (match)
+    {
+        printf("round-robin match\n");
+    }
+    else
+    {
+        printf("round-robin mismatch\n");
+    }
+}
+#endif
+
+// all the cores update the shared counters at once: under a xchg spinlock,
+// by lock xadd, by lock add and by a lock cmpxchg loop
+static void TestAtomics()
+{
+    core_t *c0 = &machine.cores[0];
+    uint8_t code[64] = {
+        0xb8, 0x01, 0x00, 0x00, 0x00,   // 400400: mov    $0x1,%eax
+        0x48, 0x87, 0x03,               // 400405: xchg   %rax,(%rbx)
+        0x48, 0x85, 0xc0,               // 400408: test   %rax,%rax
+        0x75, 0xf3,                     // 40040b: jne    400400
+        0x48, 0x8b, 0x07,               // 40040d: mov    (%rdi),%rax
+        0x48, 0x83, 0xc0, 0x01,         // 400410: add    $0x1,%rax
+        0x48, 0x89, 0x07,               // 400414: mov    %rax,(%rdi)
+        0x31, 0xc0,                     // 400417: xor    %eax,%eax
+        0x48, 0x87, 0x03,               // 400419: xchg   %rax,(%rbx)
+        0xba, 0x01, 0x00, 0x00, 0x00,   // 40041c: mov    $0x1,%edx
+        0xf0, 0x48, 0x0f, 0xc1, 0x16,   // 400421: lock xadd %rdx,(%rsi)
+        0xf0, 0x49, 0x83, 0x01, 0x01,   // 400426: lock addq $0x1,(%r9)
+        0x49, 0x8b, 0x00,               // 40042b: mov    (%r8),%rax
+        0x48, 0x8d, 0x50, 0x01,         // 40042e: lea    0x1(%rax),%rdx
+        0xf0, 0x49, 0x0f, 0xb1, 0x10,   // 400432: lock cmpxchg %rdx,(%r8)
+        0x75, 0xf2,                     // 400437: jne    40042b
+        0x48, 0x83, 0xe9, 0x01,         // 400439: sub    $0x1,%rcx
+        0x75, 0xc1,                     // 40043d: jne    400400
+        0xf4,                           // 40043f: hlt
+    };
+    writecode_dram(va2pa(0x00400400, c0), code, sizeof(code), c0);
+
+    // the lock and the counters
+    for (uint64_t a = 0x7ffffffec100; a <= 0x7ffffffec200; a += 0x40)
+    {
+        write64bits_dram(va2pa(a, c0), 0x0, c0);
+    }
+    flush_store_buffer(c0);
+
+    uint64_t num_loop = 2000;
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        core_t *cr = &machine.cores[i];
+        memset(&(cr->reg), 0, sizeof(reg_t));
+        cr->reg.rbx = 0x7ffffffec100;
+        cr->reg.rdi = 0x7ffffffec140;
+        cr->reg.rsi = 0x7ffffffec180;
+        cr->reg.r9 = 0x7ffffffec1c0;
+        cr->reg.r8 = 0x7ffffffec200;
+        cr->reg.rcx = num_loop;
+        cr->flags._cpu_flag_value = 0;
+        cr->halt = 0;
+        cr->rip = 0x00400400;
+        cr->fetch_mode = FETCH_X86;
+    }
+
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        start_core(&machine, i);
+    }
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        join_core(&machine, i);
+    }
+
+    int match = 1;
+    for (uint64_t i = 0; i < NUM_CORE; ++ i)
+    {
+        match = match && machine.threads[i].reason == RUN_EXIT_HALT;
+        machine.cores[i].halt = 0;
+        machine.cores[i].fetch_mode = FETCH_ASSEMBLY;
+    }
+    match = match && read64bits_dram(va2pa(0x7ffffffec100, c0), c0) == 0;
+    for (uint64_t a = 0x7ffffffec140; a <= 0x7ffffffec200; a += 0x40)
+    {
+        match = match && read64bits_dram(va2pa(a, c0), c0) == NUM_CORE * num_loop;
+    }
+
+    // lock xadd on a misaligned counter stops the core before it changes anything
+    c0->halt = 0;
+    c0->fetch_mode = FETCH_X86;
+    c0->reg.rdx = 0x1;
+    c0->reg.rsi = 0x7ffffffec184;
+    c0->rip = 0x00400421;
+    run_result_t run = run_until(c0, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    c0->fetch_mode = FETCH_ASSEMBLY;
+    match = match && run.reason == RUN_EXIT_SPLIT_LOCK && run.num_inst == 0;
+    match = match && c0->rip == 0x00400421 && c0->reg.rdx == 0x1;
+    match = match && c0->fault_paddr == va2pa(0x7ffffffec184, c0);
+    match = match && read64bits_dram(va2pa(0x7ffffffec180, c0), c0) == NUM_CORE * num_loop;
+
+    if (match)
+    {
+        printf("atomics match\n");
+    }
+    else
+    {
+        printf("atomics mismatch\n");
+    }
+}
+
+#if NUM_CORE >= 2
+// the store buffering litmus test: core 0 stores x and loads y, core 1 stores y
+// and loads x, each in one turn, return the two loaded values in r0 and r1
+static void RunStoreBufferingLitmus(int fence, uint64_t *r0, uint64_t *r1)
+{
+    core_t *cr = &machine.cores[0];
+    uint8_t code[25] = {
+        0x48, 0xc7, 0x03, 0x01, 0x00, 0x00, 0x00,   // 400500: movq   $0x1,(%rbx)
+        0x48, 0x8b, 0x01,                           // 400507: mov    (%rcx),%rax
+        0xf4,                                       // 40050a: hlt
+        0x48, 0xc7, 0x03, 0x01, 0x00, 0x00, 0x00,   // 40050b: movq   $0x1,(%rbx)
+        0x0f, 0xae, 0xf0,                           // 400512: mfence
+        0x48, 0x8b, 0x01,                           // 400515: mov    (%rcx),%rax
+        0xf4,                                       // 400518: hlt
+    };
+    writecode_dram(va2pa(0x00400500, cr), code, sizeof(code), cr);
+    write64bits_dram(va2pa(0x7ffffffec300, cr), 0x0, cr);     // x
+    write64bits_dram(va2pa(0x7ffffffec340, cr), 0x0, cr);     // y
+    flush_store_buffer(cr);
+
+    for (uint64_t i = 0; i < 2; ++ i)
+    {
+        cr = &machine.cores[i];
+        memset(&(cr->reg), 0, sizeof(reg_t));
+        cr->reg.rbx = i == 0 ? 0x7ffffffec300 : 0x7ffffffec340;
+        cr->reg.rcx = i == 0 ? 0x7ffffffec340 : 0x7ffffffec300;
+        cr->flags._cpu_flag_value = 0;
+        cr->halt = 0;
+        cr->rip = fence == 1 ? 0x0040050b : 0x00400500;
+        cr->fetch_mode = FETCH_X86;
+    }
+
+    run_round_robin(machine.cores, 2, 2, 100);
+
+    *r0 = machine.cores[0].reg.rax;
+    *r1 = machine.cores[1].reg.rax;
+    for (uint64_t i = 0; i < 2; ++ i)
+    {
+        machine.cores[i].halt = 0;
+        machine.cores[i].fetch_mode = FETCH_ASSEMBLY;
+    }
+}
+
+static void TestStoreBuffer()
+{
+    core_t *c0 = &machine.cores[0];
+    core_t *c1 = &machine.cores[1];
+    uint64_t r0, r1;
+    int match = 1;
+
+    // both loads pass the stores before them
+    RunStoreBufferingLitmus(0, &r0, &r1);
+#if ENABLE_STORE_BUFFER == 1
+    match = match && r0 == 0 && r1 == 0;
+#else
+    match = match && r0 == 0 && r1 == 1;
+#endif
+
+    // mfence: the store is visible before the load
+    RunStoreBufferingLitmus(1, &r0, &r1);
+    match = match && r0 == 1 && r1 == 1;
+
+    // the core loads its buffered stores, partially overlapped too
+    uint64_t p = va2pa(0x7ffffffec380, c0);
+    write64bits_dram(p, 0x0, c0);
+    write64bits_dram(p + 8, 0x0, c0);
+    flush_store_buffer(c0);
+
+    write64bits_dram(p, 0x1122334455667788, c0);
+    match = match && read64bits_dram(p, c0) == 0x1122334455667788;
+    match = match && read64bits_dram(p + 4, c0) == 0x0000000011223344;
+#if ENABLE_STORE_BUFFER == 1
+    match = match && read64bits_dram(p, c1) == 0x0;
+#endif
+    flush_store_buffer(c0);
+    match = match && read64bits_dram(p, c1) == 0x1122334455667788;
+
+    if (match)
+    {
+        printf("store buffer match\n");
+    }
+    else
+    {
+        printf("store buffer mismatch\n");
+    }
+}
+#endif
+
+// sum(a, n) by the machine code for n = 1 .. 16, each job on a fresh machine
+static void TestBatch()
+{
+    static uint64_t a[16];
+    static const uint64_t ret = 0x000000000040004d;
+    for (int i = 0; i < 16; ++ i)
+    {
+        a[i] = i * i + 1;
+    }
+
+    batch_segment_t segments[3] = {
+        { 0x00400000, sum_code, sizeof(sum_code) },
+        { 0x7ffffffed000, (const uint8_t *)a, sizeof(a) },
+        { 0x7ffffffee220, (const uint8_t *)&ret, sizeof(ret) },     // rsp: return address
+    };
+
+    uint64_t num_jobs = 256;
+    batch_job_t *jobs = calloc(num_jobs, sizeof(batch_job_t));
+    batch_result_t *serial = calloc(num_jobs, sizeof(batch_result_t));
+    batch_result_t *parallel = calloc(num_jobs, sizeof(batch_result_t));
+
+    for (uint64_t i = 0; i < num_jobs; ++ i)
+    {
+        jobs[i].segments = segments;
+        jobs[i].num_segments = 3;
+        jobs[i].reg.rsi = i % 16 + 1;
+        jobs[i].reg.rdi = 0x7ffffffed000;
+        jobs[i].reg.rbp = 0x7ffffffee230;
+        jobs[i].reg.rsp = 0x7ffffffee220;
+        jobs[i].rip = 0x00400000;
+        jobs[i].fetch_mode = FETCH_X86;
+        jobs[i].max_num_inst = 1000;
+    }
+
+    run_batch(jobs, num_jobs, 1, PHYSICAL_MEMORY_SPACE, serial);
+    run_batch(jobs, num_jobs, 4, PHYSICAL_MEMORY_SPACE, parallel);
+    write_batch_results("./files/exe/batch.results.txt", parallel, num_jobs);
+
+    int match = 1;
+    for (uint64_t i = 0; i < num_jobs; ++ i)
+    {
+        uint64_t sum = 0;
+        for (uint64_t j = 0; j <= i % 16; ++ j)
+        {
+            sum += a[j];
+        }
+        match = match && parallel[i].reason == RUN_EXIT_HALT;
+        match = match && parallel[i].reg.rax == sum;
+        match = match && parallel[i].rip == 0x0040004e;
+        match = match && parallel[i].num_inst == serial[i].num_inst;
+        match = match && parallel[i].reg_checksum == serial[i].reg_checksum;
+        match = match && parallel[i].mem_checksum == serial[i].mem_checksum;
+        // different n, different registers and stack
+        match = match && (i < 16 || parallel[i].mem_checksum == parallel[i - 16].mem_checksum);
+        match = match && (i == 0 || parallel[i].mem_checksum != parallel[i - 1].mem_checksum);
+    }
+
+    if (match)
+    {
+        printf("batch match\n");
+    }
+    else
+    {
+        printf("batch mismatch\n");
+    }
+
+    free(parallel);
+    free(serial);
+    free(jobs);
+}
+
+// the loads and stores of each width at unaligned addresses, and the bulk operations
+static void TestMemoryAccess()
+{
+    core_t *cr = &machine.cores[0];
+    uint64_t p = va2pa(0x7ffffffec401, cr);
+    int match = 1;
+
+    memset_dram(p, 0, 16, cr);
+    write64bits_dram(p, 0x1122334455667788, cr);
+    write16bits_dram(p + 3, 0xaaaa, cr);
+    write8bits_dram(p + 8, 0x99, cr);
+    write32bits_dram(p + 9, 0xddccbbaa, cr);
+
+    // forwarded from the store buffer, then from the memory
+    for (int i = 0; i < 2; ++ i)
+    {
+        match = match && read64bits_dram(p, cr) == 0x112233aaaa667788;
+        match = match && read32bits_dram(p + 2, cr) == 0x33aaaa66;
+        match = match && read16bits_dram(p + 7, cr) == 0x9911;
+        match = match && read8bits_dram(p + 3, cr) == 0xaa;
+        match = match && read64bits_dram(p + 8, cr) == 0x000000ddccbbaa99;
+        flush_store_buffer(cr);
+    }
+
+    uint64_t q = va2pa(0x7ffffffec500, cr);
+    uint64_t r = va2pa(0x7ffffffec600, cr);
+    memset_dram(q, 0x5a, 100, cr);
+    memcpy_dram(r, q, 100, cr);
+    match = match && memcmp_dram(q, r, 100, cr) == 0;
+    match = match && read64bits_dram(r + 92, cr) == 0x5a5a5a5a5a5a5a5a;
+
+    // the buffered store is compared
+    write8bits_dram(r + 50, 0x5b, cr);
+    match = match && memcmp_dram(q, r, 100, cr) < 0;
+
+    // overlapping copy
+    memcpy_dram(p + 1, p, 15, cr);
+    match = match && read64bits_dram(p + 1, cr) == 0x112233aaaa667788;
+
+    // an instruction slot running past the end of the memory stops the run
+    cr->halt = 0;
+    cr->fetch_mode = FETCH_ASSEMBLY;
+    cr->rip = 0x00400000 + PHYSICAL_MEMORY_SPACE - 8;
+    run_result_t run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_BUS_ERROR && run.num_inst == 0;
+    match = match && cr->fault_paddr == PHYSICAL_MEMORY_SPACE - 8;
+    match = match && cr->rip == 0x00400000 + PHYSICAL_MEMORY_SPACE - 8;
+
+    if (match)
+    {
+        printf("memory access match\n");
+    }
+    else
+    {
+        printf("memory access mismatch\n");
+    }
+}
+
+// 16 GiB of physical memory, only the pages written take host memory
+static void TestLargeMemory()
+{
+    static machine_t large;
+    init_machine(&large, 1ULL << 34);
+    core_t *cr = &large.cores[0];
+
+    // no longer aliased by the 64 KiB memory
+    write64bits_dram(va2pa(0x7ffffffee220, cr), 0x1111, cr);
+    write64bits_dram(va2pa(0x7ffffffde220, cr), 0x2222, cr);
+    write64bits_dram(va2pa(0x3fffffff8, cr), 0x3333, cr);
+    flush_store_buffer(cr);
+
+    int match = 1;
+    match = match && va2pa(0x7ffffffee220, cr) != va2pa(0x7ffffffde220, cr);
+    match = match && read64bits_dram(va2pa(0x7ffffffee220, cr), cr) == 0x1111;
+    match = match && read64bits_dram(va2pa(0x7ffffffde220, cr), cr) == 0x2222;
+    match = match && read64bits_dram(va2pa(0x3fffffff8, cr), cr) == 0x3333;
+    match = match && read64bits_dram(va2pa(0x200000000, cr), cr) == 0x0;
+
+#if NUM_CORE >= 2
+    // core 1 has decoded hlt: the data 64 KiB away shares no code line with it
+    core_t *c1 = &large.cores[1];
+    const uint8_t hlt = 0xf4;
+    writecode_dram(va2pa(0x00400000, cr), &hlt, 1, cr);
+    c1->rip = 0x00400000;
+    c1->fetch_mode = FETCH_X86;
+    run_until(c1, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    write64bits_dram(va2pa(0x00400000, cr) + (1 << 16), 0x0, cr);
+    flush_store_buffer(cr);
+    match = match && c1->halt == 1 && c1->flush_pending == 0;
+    write8bits_dram(va2pa(0x00400000, cr), 0xf4, cr);
+    flush_store_buffer(cr);
+    match = match && c1->flush_pending == 1;
+#endif
+
+    // demand-zero again after the reset
+    reset_machine(&large);
+    match = match && read64bits_dram(va2pa(0x7ffffffee220, cr), cr) == 0x0;
+
+    if (match)
+    {
+        printf("large memory match\n");
+    }
+    else
+    {
+        printf("large memory mismatch\n");
+    }
+    free_machine(&large);
+}
+
+#if ENABLE_PAGE_WALK == 1
+// the leaf entry of vaddr in the page tables at pml4
+static uint64_t read_pte(uint64_t pml4, uint64_t vaddr, core_t *cr)
+{
+    uint64_t e = pml4;
+    for (int level = 0; level < PAGE_TABLE_LEVEL; ++ level)
+    {
+        e = read64bits_dram((e & PTE_FRAME) + ((vaddr >> (39 - 9 * level)) & 0x1ff) * 8, cr);
+    }
+    return e;
+}
+#endif
+
+// sum(a, 4) at cpl 3 through the page tables: the stack is read-only at first
+static void TestPageWalk()
+{
+    static machine_t paged;
+    init_machine(&paged, 1 << 20);
+    core_t *cr = &paged.cores[0];
+
+    uint64_t pml4 = 0x1000;
+    uint64_t next_frame = 0x2000;
+    memset_dram(pml4, 0, PAGE_SIZE, cr);
+    map_page(pml4, 0x00400000, 0x80000, PTE_USER, &next_frame, cr);
+    map_page(pml4, 0x00401000, 0x83000, PTE_USER, &next_frame, cr);
+    map_page(pml4, 0x7ffffffed000, 0x81000, PTE_USER, &next_frame, cr);
+    map_page(pml4, 0x7ffffffee000, 0x82000, PTE_USER, &next_frame, cr);
+
+    // by the physical addresses
+    writecode_dram(0x80000, sum_code, sizeof(sum_code), cr);
+    write64bits_dram(0x82220, 0x000000000040004d, cr);     // rsp: return address
+    write64bits_dram(0x81000, 0x3, cr);                     // a
+    write64bits_dram(0x81008, 0x5, cr);
+    write64bits_dram(0x81010, 0x7, cr);
+    write64bits_dram(0x81018, 0xb, cr);
+
+    cr->pdbr = pml4;
+    cr->cpl = 3;
+    cr->reg.rsi = 0x4;
+    cr->reg.rdi = 0x7ffffffed000;
+    cr->reg.rbp = 0x7ffffffee230;
+    cr->reg.rsp = 0x7ffffffee220;
+    cr->rip = 0x00400000;
+    cr->fetch_mode = FETCH_X86;
+
+    int match = 1;
+    uint64_t paddr;
+#if ENABLE_PAGE_WALK == 0
+    // pdbr is ignored
+    match = match && translate_va(0x00400010, PF_FETCH, cr, &paddr) == 1 && paddr == 0x00400010 % (1 << 20);
+#else
+    match = match && translate_va(0x00400010, PF_FETCH, cr, &paddr) == 1 && paddr == 0x80010;
+    match = match && translate_va(0x00500000, 0, cr, &paddr) == 0 && cr->fault_code == PF_USER;
+
+    // push %rbp faults on the read-only stack before any change of the core
+    run_result_t run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_PAGE_FAULT && run.num_inst == 0;
+    match = match && cr->fault_vaddr == 0x7ffffffee218;
+    match = match && cr->fault_code == (PF_PROTECTION | PF_WRITE | PF_USER);
+    match = match && cr->rip == 0x00400000 && cr->reg.rsp == 0x7ffffffee220;
+    match = match && cr->walk_stats.num_fault == 2;
+    match = match && cr->walk_stats.num_read[3] > 0;
+    match = match && cr->walk_stats.num_read[0] >= cr->walk_stats.num_read[3];
+
+    // the handler maps the page writable and the program resumes
+    map_page(pml4, 0x7ffffffee000, 0x82000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    flush_store_buffer(cr);
+    match = match && run.reason == RUN_EXIT_HALT;
+    match = match && cr->reg.rax == 0x1a && cr->reg.rsp == 0x7ffffffee228;
+    match = match && cr->rip == 0x0040004e;
+    match = match && read64bits_dram(0x82210, cr) == 0x1a;     // s
+    match = match && read64bits_dram(0x82208, cr) == 0x4;      // i
+
+    // accessed and dirty set by the walks
+    match = match && (read_pte(pml4, 0x00400000, cr) & (PTE_ACCESSED | PTE_DIRTY)) == PTE_ACCESSED;
+    match = match && (read_pte(pml4, 0x7ffffffee000, cr) & PTE_DIRTY) != 0;
+    match = match && (read_pte(pml4, 0x00401000, cr) & PTE_ACCESSED) == 0;
+
+    // mov %rax,%cr3 is followed by hlt in the old tables
+    // and by mov %cr3,%rbx; hlt in the new ones
+    static const uint8_t old_code[4] = { 0x0f, 0x22, 0xd8, 0xf4 };
+    static const uint8_t new_code[7] = { 0x90, 0x90, 0x90, 0x0f, 0x20, 0xdb, 0xf4 };
+    writecode_dram(0x83000, old_code, sizeof(old_code), cr);
+    writecode_dram(0x84000, new_code, sizeof(new_code), cr);
+
+    uint64_t other = next_frame;
+    next_frame += PAGE_SIZE;
+    memset_dram(other, 0, PAGE_SIZE, cr);
+    map_page(other, 0x00401000, 0x84000, PTE_USER, &next_frame, cr);
+
+    cr->halt = 0;
+    cr->reg.rax = other;
+    cr->reg.rbx = 0;
+    cr->rip = 0x00401000;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_HALT;
+    match = match && cr->pdbr == other && cr->reg.rbx == other && cr->rip == 0x00401007;
+
+    // nop; nop; mov %rax,%rbx spanning into the unmapped page: the nops run first
+    static const uint8_t end_code[4] = { 0x90, 0x90, 0x48, 0x89 };
+    writecode_dram(0x84ffc, end_code, sizeof(end_code), cr);
+
+    cr->halt = 0;
+    cr->reg.rbx = 0;
+    cr->rip = 0x00401ffc;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_PAGE_FAULT && run.num_inst == 2;
+    match = match && cr->fault_vaddr == 0x00402000 && cr->rip == 0x00401ffe;
+
+    // the rest of the instruction is watched for writes: mov %rax,%rcx once rewritten
+    static const uint8_t next_code[2] = { 0xc3, 0xf4 };
+    writecode_dram(0x86000, next_code, sizeof(next_code), cr);
+    map_page(other, 0x00402000, 0x86000, PTE_USER, &next_frame, cr);
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_HALT && cr->reg.rbx == other && cr->rip == 0x00402002;
+
+    write8bits_dram(0x86000, 0xc1, cr);
+    cr->halt = 0;
+    cr->reg.rcx = 0;
+    cr->rip = 0x00401ffe;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_HALT && cr->reg.rcx == other;
+
+    // the accesses crossing a page boundary reach the frame of each page,
+    // which is not the one physically next: 0x89000 is never touched
+    map_page(other, 0x00410000, 0x8c000, PTE_USER, &next_frame, cr);
+    map_page(other, 0x00403000, 0x88000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+    map_page(other, 0x00404000, 0x8a000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+    map_page(other, 0x00406000, 0x8e000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+    map_page(other, 0x00407000, 0x90000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+    write64bits_dram(0x88ff8, 0x8877665544332211, cr);
+    write64bits_dram(0x89000, 0xeeeeeeeeeeeeeeee, cr);
+    write64bits_dram(0x8a000, 0x00000000ddccbbaa, cr);
+
+    // mov (%rsi),%rax; mov %rbx,0x2(%rsi); push %rbx; pop %rdi; hlt
+    // then mov (%rdx),%rcx; hlt and mov %rbx,(%rdx); hlt into the unmapped 0x00405000
+    static const uint8_t split_code[18] = {
+        0x48, 0x8b, 0x06, 0x48, 0x89, 0x5e, 0x02, 0x53, 0x5f, 0xf4,
+        0x48, 0x8b, 0x0a, 0xf4, 0x48, 0x89, 0x1a, 0xf4 };
+    writecode_dram(0x8c000, split_code, sizeof(split_code), cr);
+
+    cr->halt = 0;
+    cr->reg.rsi = 0x00403ffc;
+    cr->reg.rbx = 0x0123456789abcdef;
+    cr->reg.rsp = 0x00407004;
+    cr->rip = 0x00410000;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    flush_store_buffer(cr);
+    match = match && run.reason == RUN_EXIT_HALT && cr->rip == 0x0041000a;
+    match = match && cr->reg.rax == 0xddccbbaa88776655;
+    match = match && cr->reg.rdi == 0x0123456789abcdef && cr->reg.rsp == 0x00407004;
+    match = match && read32bits_dram(0x88ffc, cr) == 0xcdef6655;
+    match = match && read64bits_dram(0x8a000, cr) == 0x00000123456789ab;
+    match = match && read32bits_dram(0x8effc, cr) == 0x89abcdef;
+    match = match && read32bits_dram(0x90000, cr) == 0x01234567;
+    match = match && read64bits_dram(0x89000, cr) == 0xeeeeeeeeeeeeeeee;
+
+    // the second page faults: nothing is loaded or stored
+    write64bits_dram(0x8aff8, 0x5555555555555555, cr);
+    cr->halt = 0;
+    cr->reg.rcx = 0;
+    cr->reg.rdx = 0x00404ffc;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    match = match && run.reason == RUN_EXIT_PAGE_FAULT && run.num_inst == 0;
+    match = match && cr->fault_vaddr == 0x00405000 && cr->rip == 0x0041000a && cr->reg.rcx == 0;
+
+    cr->rip = 0x0041000e;
+    run = run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+    flush_store_buffer(cr);
+    match = match && run.reason == RUN_EXIT_PAGE_FAULT && run.num_inst == 0;
+    match = match && cr->fault_vaddr == 0x00405000 && cr->rip == 0x0041000e;
+    match = match && read64bits_dram(0x8aff8, cr) == 0x5555555555555555;
+#endif
+
+    if (match)
+    {
+        printf("page walk match\n");
+    }
+    else
+    {
+        printf("page walk mismatch\n");
+    }
+    free_machine(&paged);
+}
+
+#if ENABLE_PAGE_WALK == 1
+// sum(a, 4) by the code at 0x00400000 in the address space at pdbr
+static run_result_t RunSum(core_t *cr, uint64_t pdbr)
+{
+    cr->pdbr = pdbr;
+    cr->halt = 0;
+    cr->reg.rsi = 0x4;
+    cr->reg.rdi = 0x7ffffffed000;
+    cr->reg.rbp = 0x7ffffffee230;
+    cr->reg.rsp = 0x7ffffffee220;
+    cr->rip = 0x00400000;
+    return run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0);
+}
+
+// two address spaces sharing the code page, each with its own array and stack
+// the same addresses give other values once pdbr changes, by the host or by mov cr3
+static void TestTlb()
+{
+    static machine_t paged;
+    init_machine(&paged, 1 << 20);
+    core_t *cr = &paged.cores[0];
+    cr->cpl = 3;
+    cr->fetch_mode = FETCH_X86;
+
+    uint64_t next_frame = 0x1000;
+    uint64_t space[2];
+    for (int i = 0; i < 2; ++ i)
+    {
+        space[i] = next_frame;
+        next_frame += PAGE_SIZE;
+        memset_dram(space[i], 0, PAGE_SIZE, cr);
+        map_page(space[i], 0x00400000, 0x80000, PTE_USER, &next_frame, cr);
+        map_page(space[i], 0x7ffffffed000, 0x81000 + i * 0x2000, PTE_USER, &next_frame, cr);
+        map_page(space[i], 0x7ffffffee000, 0x82000 + i * 0x2000, PTE_USER | PTE_WRITABLE, &next_frame, cr);
+        write64bits_dram(0x82220 + i * 0x2000, 0x000000000040004d, cr);     // rsp: return address
+        for (int j = 0; j < 4; ++ j)
+        {
+            write64bits_dram(0x81000 + i * 0x2000 + j * 8, (j + 1) * (i == 0 ? 1 : 10), cr);
+        }
+    }
+    writecode_dram(0x80000, sum_code, sizeof(sum_code), cr);
+
+    // mov %rax,%cr3; hlt
+    static const uint8_t switch_code[4] = { 0x0f, 0x22, 0xd8, 0xf4 };
+    writecode_dram(0x80600, switch_code, sizeof(switch_code), cr);
+
+    int match = 1;
+    walk_stats_t *walk = &(cr->walk_stats);
+    tlb_stats_t *tlb = cr->tlb_stats;
+
+    match = match && RunSum(cr, space[0]).reason == RUN_EXIT_HALT && cr->reg.rax == 10;
+    match = match && RunSum(cr, space[1]).reason == RUN_EXIT_HALT && cr->reg.rax == 100;
+    uint64_t num_walk = walk->num_walk;
+
+    // back to the first address space: its translations were kept
+    match = match && RunSum(cr, space[0]).reason == RUN_EXIT_HALT && cr->reg.rax == 10;
+    // the code, the array and the stack of each address space
+    match = match && (ENABLE_TLB == 0 || (num_walk == 6 && walk->num_walk == num_walk));
+    match = match && (ENABLE_TLB == 0 || (tlb[TLB_L1I].num_miss == 2 && tlb[TLB_L1D].num_miss == 4));
+    match = match && (ENABLE_TLB == 0 || (tlb[TLB_L2].num_miss == walk->num_walk));
+    // the soft MMU takes the hits before the TLBs see them
+    match = match && (ENABLE_TLB == 0 || ENABLE_SOFT_MMU == 1 ||
+        tlb[TLB_L1D].num_hit > 10 * tlb[TLB_L1D].num_miss);
+    match = match && (ENABLE_SOFT_MMU == 0 ||
+        cr->soft_tlb->entries[(0x7ffffffee000 / PAGE_SIZE) % NUM_SOFT_TLB_ENTRY].write_tag == 0x7ffffffee000);
+
+    // a new array: map_page flushes the old translation
+    for (int j = 0; j < 4; ++ j)
+    {
+        write64bits_dram(0x85000 + j * 8, 5, cr);
+    }
+    map_page(space[0], 0x7ffffffed000, 0x85000, PTE_USER, &next_frame, cr);
+    match = match && RunSum(cr, space[0]).reason == RUN_EXIT_HALT && cr->reg.rax == 20;
+
+    // one page more than the ways of a set of the L1 data TLB: the first one is evicted
+    // and found again in the L2 TLB
+    for (int i = 0; i <= L1_DTLB_WAYS; ++ i)
+    {
+        map_page(space[0], 0x10000000 + i * L1_DTLB_SETS * PAGE_SIZE, 0x86000, PTE_USER, &next_frame, cr);
+    }
+    uint64_t paddr;
+    for (int i = 0; i <= L1_DTLB_WAYS; ++ i)
+    {
+        match = match && translate_va(0x10000008 + i * L1_DTLB_SETS * PAGE_SIZE, 0, cr, &paddr) == 1;
+        match = match && paddr == 0x86008;
+    }
+    num_walk = walk->num_walk;
+    tlb_stats_t l2 = tlb[TLB_L2];
+    match = match && translate_va(0x10000010, 0, cr, &paddr) == 1 && paddr == 0x86010;
+    match = match && (ENABLE_TLB == 0 || (tlb[TLB_L1D].num_evict > 0));
+    match = match && (ENABLE_TLB == 0 || (walk->num_walk == num_walk && tlb[TLB_L2].num_hit == l2.num_hit + 1));
+
+    // switch to the second address space keeping its translations, then back flushing them
+    uint64_t flushes = tlb[TLB_L1D].num_flush;
+    cr->pdbr = space[0];
+    cr->halt = 0;
+    cr->reg.rax = space[1] | CR3_NOFLUSH;
+    cr->rip = 0x00400600;
+    match = match && run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0).reason == RUN_EXIT_HALT;
+    match = match && cr->pdbr == space[1];
+    num_walk = walk->num_walk;
+    match = match && RunSum(cr, space[1]).reason == RUN_EXIT_HALT && cr->reg.rax == 100;
+    match = match && (ENABLE_TLB == 0 || (walk->num_walk == num_walk && tlb[TLB_L1D].num_flush == flushes));
+
+    cr->halt = 0;
+    cr->reg.rax = space[0];
+    cr->rip = 0x00400600;
+    match = match && run_until(cr, MAX_NUM_INSTRUCTION_CYCLE, 0, 0).reason == RUN_EXIT_HALT;
+    num_walk = walk->num_walk;
+    match = match && RunSum(cr, space[0]).reason == RUN_EXIT_HALT && cr->reg.rax == 20;
+    // the hlt after the switch walked for the code page already
+    match = match && (ENABLE_TLB == 0 || (walk->num_walk == num_walk + 2 && tlb[TLB_L1D].num_flush == flushes + 1));
+
+    if (match)
+    {
+        printf("tlb match\n");
+    }
+    else
+    {
+        printf("tlb mismatch\n");
+    }
+    free_machine(&paged);
+}
+#endif